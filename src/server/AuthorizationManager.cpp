@@ -8,7 +8,10 @@
 #include "globals.h"
 
 #include <QCryptographicHash>
+#include <QThreadStorage>
 #include "library/sysadm-general.h" //simplification functions
+#include "library/sysadm-metrics.h"
+#include <QElapsedTimer>
 
 // Stuff for PAM to work
 #include <sys/types.h>
@@ -34,11 +37,18 @@
 #define AUTHCHARS QString("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789")
 #define TOKENLENGTH 20
 
+//qrand() keeps a separate seed for each thread - make sure every thread generating tokens is seeded
+static QThreadStorage<bool> randSeeded;
+
 AuthorizationManager::AuthorizationManager() : QObject(){
-  HASH.clear();
+  TOKENS.clear();
+  SSLCHECK.clear();
   IPFAIL.clear();
-  //initialize the random number generator (need to generate auth tokens)
-  qsrand(QDateTime::currentMSecsSinceEpoch());
+  //Expired tokens are dropped on lookup - periodically clean out the ones which are never looked up again
+  purgeTimer = new QTimer(this);
+    purgeTimer->setInterval(TIMEOUTSECS*1000);
+    connect(purgeTimer, SIGNAL(timeout()), this, SLOT(purgeExpired()) );
+  purgeTimer->start();
 }
 
 AuthorizationManager::~AuthorizationManager(){
@@ -49,48 +59,58 @@ AuthorizationManager::~AuthorizationManager(){
 void AuthorizationManager::clearAuth(QString token){
   if(token.isEmpty() || token.length() < TOKENLENGTH){ return; } //not a valid token
   //clear an authorization token
-  QString id = hashID(token);
-  //qDebug() << "Clear Auth:" << id;
-  if(!id.isEmpty()){ HASH.remove(id); }
+  //qDebug() << "Clear Auth:" << token;
+  QWriteLocker lock(&tokenLock);
+  TOKENS.remove(token);
 }
 
 bool AuthorizationManager::checkAuth(QString token){
 	//see if the given token is valid
-  bool ok = false;
-  QString id = hashID(token);
-  if(!id.isEmpty()){
-    //Also verify that the token has not timed out
-    ok = (HASH[id] > QDateTime::currentDateTime());
-    if(ok){ HASH.insert(id, QDateTime::currentDateTime().addSecs(TIMEOUTSECS)); } //valid - bump the timestamp
-  }
+  QElapsedTimer timer; timer.start();
+  bool ok = checkAuthInternal(token);
+  sysadm::Metrics::record("stage", "auth", timer.nsecsElapsed()/1000);
   return ok;
 }
 
-bool AuthorizationManager::hasFullAccess(QString token){
-  bool ok = false;
-  QString id = hashID(token);
-  if(!id.isEmpty()){
+bool AuthorizationManager::checkAuthInternal(QString token){
+  qint64 now = QDateTime::currentMSecsSinceEpoch();
+  bool expired = false;
+  { //read lock scope
+    QReadLocker lock(&tokenLock);
+    QHash<QString, auth_token>::const_iterator it = TOKENS.constFind(token);
+    if(it==TOKENS.constEnd()){ return false; }
     //Also verify that the token has not timed out
-    if( HASH[id] > QDateTime::currentDateTime() ){  
-      ok = id.section("::::",1,1)=="operator";
+    qint64 expires = it.value().expires.loadAcquire();
+    if(expires > now){
+      //valid - bump the timestamp (another thread may have bumped it already - only ever move it forward)
+      qint64 bumped = now + TIMEOUTSECS*1000;
+      while(expires < bumped && !it.value().expires.testAndSetOrdered(expires, bumped)){
+        expires = it.value().expires.loadAcquire();
+      }
+      return true;
     }
+    expired = true;
   }
-  return ok;
+  if(expired){ removeExpiredToken(token); }
+  return false;
+}
+
+bool AuthorizationManager::hasFullAccess(QString token){
+  auth_token info;
+  if(!validToken(token, &info)){ return false; }
+  return info.isOperator;
 }
 
 QString AuthorizationManager::userForToken(QString token){
-  QString id = hashID(token);
-  if(!id.isEmpty()){
-    return id.section("::::",2,2);
-  }else{
-    return "";
-  }
+  auth_token info;
+  if(!validToken(token, &info)){ return ""; }
+  return info.user;
 }
 
 //SSL Certificate register/revoke/list
 bool AuthorizationManager::RegisterCertificate(QString token, QString pubkey, QString nickname, QString email){
   if(!checkAuth(token)){ return false; }
-  QString user = hashID(token).section("::::",2,2); //get the user name from the currently-valid token
+  QString user = userForToken(token); //get the user name from the currently-valid token
   //NOTE: The public key should be a base64 encoded string
   CONFIG->setValue("RegisteredCerts/"+user+"/"+pubkey, "Nickname: "+nickname+"\nEmail: "+email+"\nDate Registered: "+QDateTime::currentDateTime().toString(Qt::ISODate) );
   return true;
@@ -105,7 +125,7 @@ bool AuthorizationManager::RegisterCertificateInternal(QString user, QByteArray
 
 bool AuthorizationManager::RevokeCertificate(QString token, QString key, QString user){
   //user will be the current user if not empty - cannot touch other user's certs without full perms on current session
-  QString cuser = hashID(token).section("::::",2,2);
+  QString cuser = userForToken(token);
   if(user.isEmpty()){ user = cuser; } //only probe current user
   if(user !=cuser){
     //Check permissions for this cross-user action
@@ -125,7 +145,7 @@ void AuthorizationManager::ListCertificates(QString token, QJsonObject *out){
     //qDebug() << "Found SSL Keys to List:" << keys;
   }else{
     //Only list certs for current user
-    QString cuser = hashID(token).section("::::",2,2);
+    QString cuser = userForToken(token);
     keys = CONFIG->allKeys().filter("RegisteredCerts/"+cuser+"/");
     //qDebug() << "Found SSL Keys to List:" << keys;
   }
@@ -169,8 +189,9 @@ void AuthorizationManager::ListCertificateChecksums(QJsonObject *out){
 //Generic functions
 int AuthorizationManager::checkAuthTimeoutSecs(QString token){
 	//Return the number of seconds that a token is valid for
-  if(!HASH.contains(token)){ return 0; } //invalid token
-  return QDateTime::currentDateTime().secsTo( HASH[token] );
+  auth_token info;
+  if(!validToken(token, &info)){ return 0; } //invalid token
+  return (info.expires.loadAcquire() - QDateTime::currentMSecsSinceEpoch())/1000;
 }
 
 
@@ -241,15 +262,11 @@ QString AuthorizationManager::LoginService(QHostAddress host, QString service){
 
 //Stage 1 SSL Login Check: Generation of random string for this user
 QString AuthorizationManager::GenerateEncCheckString(){
-  QString key;
-  for(int i=0; i<TOKENLENGTH; i++){
-    key.append( AUTHCHARS.at( qrand() % AUTHCHARS.length() ) );
-  }
-  if(HASH.contains("SSL_CHECK_STRING/"+key)){ key = GenerateEncCheckString(); } //get a different one
-  else{
-    //insert this new key into the hash for later
-    HASH.insert("SSL_CHECK_STRING/"+key, QDateTime::currentDateTime().addSecs(30) ); //only keep a key "alive" for 30 seconds
-  }
+  QString key = randomString(TOKENLENGTH);
+  QMutexLocker lock(&sslMutex);
+  while(SSLCHECK.contains(key)){ key = randomString(TOKENLENGTH); } //get a different one
+  //insert this new key into the hash for later
+  SSLCHECK.insert(key, QDateTime::currentDateTime().addSecs(30) ); //only keep a key "alive" for 30 seconds
   //qDebug() << "New SSL test string:" << key;
   return key;
 }
@@ -292,29 +309,30 @@ QString AuthorizationManager::LoginUC(QHostAddress host, QString encstring){
   bool ok = false;
   //qDebug() << "SSL Auth Attempt";
     //First clean out any old strings/keys
-    QStringList pubkeys = QStringList(HASH.keys()).filter("SSL_CHECK_STRING/"); //temporary, re-use variable below
-    for(int i=0; i<pubkeys.length(); i++){ 
+    QDateTime now = QDateTime::currentDateTime();
+    sslMutex.lock();
+    for(QHash<QString, QDateTime>::iterator it = SSLCHECK.begin(); it!=SSLCHECK.end(); ){
       //Check expiration time on each initial string
-      if(QDateTime::currentDateTime() > HASH[pubkeys[i]]){ 
-        //Note: normally only 1 request per user at a time, but it is possible for a couple different clients to try 
-        // and authenticate as the same user (but different keys) at nearly the same time - so keep a short valid-string time frame (<30 seconds)
-        // to mitigate this possibility (need to prevent the second user-auth request from invalidating the first before the first auth handshake is finished)
-        HASH.remove(pubkeys[i]); //initstring expired - go ahead and remove it to reduce calc time later
-      }
+      //Note: normally only 1 request per user at a time, but it is possible for a couple different clients to try 
+      // and authenticate as the same user (but different keys) at nearly the same time - so keep a short valid-string time frame (<30 seconds)
+      // to mitigate this possibility (need to prevent the second user-auth request from invalidating the first before the first auth handshake is finished)
+      if(now > it.value()){ it = SSLCHECK.erase(it); } //initstring expired - go ahead and remove it to reduce calc time later
+      else{ ++it; }
     }
-    //Now re-use the "pubkeys" variable for the public SSL keys
+    sslMutex.unlock();
     QString user;
-    pubkeys = CONFIG->allKeys().filter("RegisteredCerts/"); //Format: "RegisteredCerts/<user>/<key>"
+    QStringList pubkeys = CONFIG->allKeys().filter("RegisteredCerts/"); //Format: "RegisteredCerts/<user>/<key>"
     //qDebug() << " - Check pubkeys";// << pubkeys;
     for(int i=0; i<pubkeys.length() && !ok; i++){
       //Decrypt the string with this pubkey - and compare to the outstanding initstrings
       QString key = DecryptSSLString(encstring, pubkeys[i].section("/",2,-1));
-      if(HASH.contains("SSL_CHECK_STRING/"+key)){
+      sslMutex.lock();
+      //Remove the initstring from the hash (already used)
+      ok = (SSLCHECK.remove(key) > 0);
+      sslMutex.unlock();
+      if(ok){
         //Valid reponse found
 	//qDebug() << " - Found Valid Key";
-        ok = true;
-        //Remove the initstring from the hash (already used)
-        HASH.remove("SSL_CHECK_STRING/"+key);
         user = pubkeys[i].section("/",1,1);
       }
     }
@@ -589,39 +607,62 @@ QStringList keys; //Format: "RegisteredCerts/<user>/<key>" (value is full text)
 //               PRIVATE
 // =========================
 QString AuthorizationManager::generateNewToken(bool isOp, QString user){
-  QString tok;
-  for(int i=0; i<TOKENLENGTH; i++){
-    tok.append( AUTHCHARS.at( qrand() % AUTHCHARS.length() ) );
-  }
-  
-  if( !hashID(tok).isEmpty() ){ 
+  QString tok = randomString(TOKENLENGTH);
+  QWriteLocker lock(&tokenLock);
+  while( TOKENS.contains(tok) ){ 
     //Just in case the randomizer came up with something identical - re-run it
-    tok = generateNewToken(isOp, user);
-  }else{ 
-    //unique token created - add it to the hash with the current time (+timeout)
-    QString id = tok + "::::"+(isOp ? "operator" : "user")+"::::"+user; //append operator status to auth key
-    HASH.insert(id, QDateTime::currentDateTime().addSecs(TIMEOUTSECS) );
-    //qDebug() << "Current HASH Contents:" << HASH.keys();
+    tok = randomString(TOKENLENGTH);
   }
+  //unique token created - add it to the hash with the current time (+timeout)
+  auth_token info;
+    info.user = user;
+    info.isOperator = isOp;
+    info.expires.storeRelease(QDateTime::currentMSecsSinceEpoch() + TIMEOUTSECS*1000);
+  TOKENS.insert(tok, info);
+  //qDebug() << "Current number of tokens:" << TOKENS.count();
   return tok;
 }
 
-QStringList AuthorizationManager::getUserGroups(QString user){
-  QProcess proc;
-  QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-  env.insert("LANG", "C");
-  env.insert("LC_All", "C");
-  proc.setProcessEnvironment(env);
-  proc.setProcessChannelMode(QProcess::MergedChannels);
-  proc.start("id", QStringList() << "-nG" << user);
-  if(!proc.waitForStarted(30000)){ return QStringList(); } //process never started - max wait of 30 seconds
-  while(!proc.waitForFinished(500)){
-    if(proc.state() != QProcess::Running){ break; } //somehow missed the finished signal
-    QCoreApplication::processEvents();
+bool AuthorizationManager::validToken(QString token, auth_token *info){
+  bool expired = false;
+  { //read lock scope
+    QReadLocker lock(&tokenLock);
+    QHash<QString, auth_token>::const_iterator it = TOKENS.constFind(token);
+    if(it==TOKENS.constEnd()){ return false; }
+    expired = ( it.value().expires.loadAcquire() <= QDateTime::currentMSecsSinceEpoch() );
+    if(!expired && info!=0){ *info = it.value(); }
+  }
+  if(expired){ removeExpiredToken(token); return false; } //timed out
+  return true;
+}
+
+void AuthorizationManager::removeExpiredToken(QString token){
+  QWriteLocker lock(&tokenLock);
+  QHash<QString, auth_token>::iterator it = TOKENS.find(token);
+  //Re-check now that we have the write lock - the token might have been bumped in the meantime
+  if(it!=TOKENS.end() && it.value().expires.loadAcquire() <= QDateTime::currentMSecsSinceEpoch()){
+    TOKENS.erase(it);
+  }
+}
+
+QString AuthorizationManager::randomString(int length){
+  if(!randSeeded.hasLocalData()){
+    //first use on this thread
+    qsrand( QDateTime::currentMSecsSinceEpoch() ^ reinterpret_cast<quintptr>(QThread::currentThreadId()) );
+    randSeeded.setLocalData(true);
+  }
+  QString str;
+  for(int i=0; i<length; i++){
+    str.append( AUTHCHARS.at( qrand() % AUTHCHARS.length() ) );
   }
-  QStringList out = QString(proc.readAllStandardOutput()).remove("\n").split(" ");
+  return str;
+}
+
+QStringList AuthorizationManager::getUserGroups(QString user){
+  QString groups = sysadm::General::RunCommand("id", QStringList() << "-nG" << user, "", QStringList() << "LANG=C" << "LC_ALL=C");
+  QStringList out = groups.remove("\n").split(" ");
   //qDebug() << "Found Groups for user:" << user << out;
-  return out;	
+  return out;
 }
 
 bool AuthorizationManager::local_checkActive(QString user){
@@ -643,24 +684,43 @@ bool AuthorizationManager::local_checkActive(QString user){
 
 bool AuthorizationManager::BumpFailCount(QString host){
   //Returns: true if the failure count is over the limit
-  //key: "<IP>::::<failnum>"
-  QStringList keys = QStringList(IPFAIL.keys()).filter(host+"::::");
-  int fails = 0;
-  if(!keys.isEmpty()){
-    //Take the existing key/value and put a new one in (this limits the filter to 1 value maximum)
-    QDateTime last = IPFAIL.take(keys[0]);
-    if(last.addSecs(BlackList_AuthFailResetMinutes*60) > QDateTime::currentDateTime() ){
-     fails = keys[0].section("::::",1,1).toInt();
-    }
+  QDateTime now = QDateTime::currentDateTime();
+  QMutexLocker lock(&failMutex);
+  host_fails &info = IPFAIL[host]; //inserts a new entry as needed
+  if(info.last.isNull() || info.last.addSecs(BlackList_AuthFailResetMinutes*60) <= now ){
+    info.fails = 0; //new host or the last failure is too old - reset the count
   }
-  fails++;
-  IPFAIL.insert(host+"::::"+QString::number(fails), QDateTime::currentDateTime() );
-  return (fails>=BlackList_AuthFailsToBlock);	
+  info.fails++;
+  info.last = now;
+  return (info.fails>=BlackList_AuthFailsToBlock);	
 }
 
 void AuthorizationManager::ClearHostFail(QString host){
-  QStringList keys = QStringList(IPFAIL.keys()).filter(host+"::::");
-  for(int i=0; i<keys.length(); i++){ IPFAIL.remove(keys[i]); }
+  QMutexLocker lock(&failMutex);
+  IPFAIL.remove(host);
+}
+
+void AuthorizationManager::purgeExpired(){
+  qint64 now = QDateTime::currentMSecsSinceEpoch();
+  tokenLock.lockForWrite();
+  for(QHash<QString, auth_token>::iterator it = TOKENS.begin(); it!=TOKENS.end(); ){
+    if(it.value().expires.loadAcquire() <= now){ it = TOKENS.erase(it); }
+    else{ ++it; }
+  }
+  tokenLock.unlock();
+  QDateTime cdt = QDateTime::currentDateTime();
+  sslMutex.lock();
+  for(QHash<QString, QDateTime>::iterator it = SSLCHECK.begin(); it!=SSLCHECK.end(); ){
+    if(cdt > it.value()){ it = SSLCHECK.erase(it); }
+    else{ ++it; }
+  }
+  sslMutex.unlock();
+  failMutex.lock();
+  for(QHash<QString, host_fails>::iterator it = IPFAIL.begin(); it!=IPFAIL.end(); ){
+    if(it.value().last.addSecs(BlackList_AuthFailResetMinutes*60) <= cdt){ it = IPFAIL.erase(it); }
+    else{ ++it; }
+  }
+  failMutex.unlock();
 }
 
 QString AuthorizationManager::DecryptSSLString(QString encstring, QString pubkey){
@@ -8,6 +8,23 @@
 
 #include "globals-qt.h"
 
+#include <QReadWriteLock>
+#include <QMutex>
+#include <QAtomicInteger>
+
+//Information about a single authorized session (token is the hash key)
+struct auth_token{
+  QString user;
+  bool isOperator;
+  mutable QAtomicInteger<qint64> expires; //msecs since epoch (bumped while only holding the read lock)
+};
+
+//Information about failed logins from a single host (host is the hash key)
+struct host_fails{
+  int fails;
+  QDateTime last;
+};
+
 class AuthorizationManager : public QObject{
 	Q_OBJECT
 public:
@@ -49,8 +66,14 @@ public:
 	QByteArray pubkeyForMd5(QString md5_base64);
 	
 private:
-	QHash<QString, QDateTime> HASH;
-	QHash <QString, QDateTime> IPFAIL;
+	//NOTE: Requests are evaluated on multiple threads at the same time - always use the locks
+	QHash<QString, auth_token> TOKENS; //token -> session info
+	QReadWriteLock tokenLock; //read-mostly: only add/remove takes the write lock
+	QHash<QString, QDateTime> SSLCHECK; //SSL check string -> expiration
+	QMutex sslMutex;
+	QHash<QString, host_fails> IPFAIL; //host -> failure info
+	QMutex failMutex;
+	QTimer *purgeTimer;
 
 	QString generateNewToken(bool isOperator, QString name);
 	QStringList getUserGroups(QString user);
@@ -60,12 +83,11 @@ private:
 	bool BumpFailCount(QString host);
 	void ClearHostFail(QString host);
 
-	//token->hashID filter simplification
-	QString hashID(QString token){
-	  QStringList tmp = QStringList(HASH.keys()).filter(token+"::::");
-	  if(tmp.isEmpty()){ return ""; }
-	  else{ return tmp.first(); }
-	}
+	//token->session lookup (removes the token if it has expired)
+	bool validToken(QString token, auth_token *info = 0);
+	bool checkAuthInternal(QString token); //checkAuth() without the timing
+	void removeExpiredToken(QString token);
+	QString randomString(int length);
 	
 	//SSL Decrypt function
 	QString DecryptSSLString(QString encstring, QString pubkey);
@@ -74,6 +96,9 @@ private:
 	bool pam_checkPW(QString user, QString pass);
 	void pam_logFailure(int ret);
 	
+private slots:
+	void purgeExpired(); //remove all expired tokens/check strings
+
 signals:
 	void BlockHost(QHostAddress); //block a host address temporarily
 	
@@ -7,6 +7,8 @@
 
 #include "globals.h"
 
+#include <algorithm>
+
 
 // ================================
 //  DProcess Class (Internal)
@@ -14,7 +16,16 @@
 DProcess::DProcess(QObject *parent) : QProcess(parent){
     //Setup the process
     bool notify = false;
+    jobnum = 0;
+    jobstate = QUEUED;
+    queue = 0;
+    qprev = qnext = 0;
+    lastsent = 0;
+    upinterval = DPROCESS_UPDATE_MIN;
+    outputLimit = DISPATCHER_OUTPUT_BYTES;
+    output = QSharedPointer<DOutputBuffer>(new DOutputBuffer(outputLimit));
     uptimer = new QTimer(this);
+      uptimer->setSingleShot(true);
     connect(uptimer, SIGNAL(timeout()), this, SLOT(emitUpdate()) );
     this->setProcessEnvironment(QProcessEnvironment::systemEnvironment());
     this->setProcessChannelMode(QProcess::MergedChannels);
@@ -29,15 +40,16 @@ DProcess::~DProcess(){
   }
 }
 
-void DProcess::procReady(){
+void DProcess::procSetup(){
   rawcmds = cmds;
   proclog.insert("cmd_list",QJsonArray::fromStringList(cmds));
   proclog.insert("process_id",ID);
   proclog.insert("state","pending");
+}
+
+void DProcess::procReady(){
   this->emit ProcUpdate(ID, proclog);
-      uptimer->setSingleShot(false);
-      uptimer->setInterval(2000); //2 second intervals for "pending" pings
-  uptimer->start();
+  //No more updates until it starts (pending jobs do not change - nothing to ping about)
 }
 
 void DProcess::startProc(){
@@ -46,19 +58,19 @@ void DProcess::startProc(){
     proclog.insert("state","finished");
     proclog.insert("time_finished", QDateTime::currentDateTime().toString(Qt::ISODate));
     proclog.remove("current_cmd");
-    emit ProcFinished(ID, proclog);
+    emit ProcFinished(ID, getProcLog());
     return;
   }
   if(proclog.value("state").toString()=="pending"){
     //first cmd started
-    if(uptimer->isActive()){ uptimer->stop(); }
-      uptimer->setSingleShot(true);
-      uptimer->setInterval(1000); //1 second intervals while running
+    sincesent.start();
     proclog.insert("time_started", QDateTime::currentDateTime().toString(Qt::ISODate));
     proclog.insert("state","running");
     this->emit ProcUpdate(ID, proclog);
   }
   cCmd = cmds.takeFirst();
+  logcmds << cCmd;
+  logstart << output->size();
   success = false; //not finished yet
   proclog.insert("current_cmd",cCmd);
   //qDebug() << "Proc Starting:" << ID << cmd;
@@ -74,8 +86,23 @@ bool DProcess::isDone(){
 }
 
 QJsonObject DProcess::getProcLog(){
-  //Now return the current version of the log
-  return proclog;
+  //Now return the current version of the log (with the output of each command - only the last "outputLimit" bytes of each,
+  //  even if the spill file has all of it: the rest can be fetched with readOutput)
+  QJsonObject log = proclog;
+  qint64 size = output->size();
+  bool truncated = output->truncated();
+  for(int i=0; i<logcmds.length(); i++){
+    qint64 end = (i+1<logcmds.length()) ? logstart[i+1] : size;
+    qint64 from = qMax(logstart[i], end-outputLimit);
+    if(from>logstart[i]){ truncated = true; }
+    qint64 start = 0;
+    QByteArray data = output->read(from, (int) (end-from), &start);
+    if(start>from){ data.truncate( qMax((qint64) 0, end-start) ); } //the start of it is gone
+    log.insert(logcmds[i], log.value(logcmds[i]).toString().append( QString::fromLocal8Bit(data) ) );
+  }
+  log.insert("output_size", size);
+  if(truncated){ log.insert("output_truncated", true); }
+  return log;
 }
 
 void DProcess::cmdError(QProcess::ProcessError err){
@@ -88,35 +115,49 @@ void DProcess::cmdFinished(int ret, QProcess::ExitStatus status){
   //determine success/failure
   success = (status==QProcess::NormalExit && ret==0);
   //update the log before starting another command
-  proclog.insert(cCmd, proclog.value(cCmd).toString().append(this->readAllStandardOutput()) );
+  output->append(this->readAllStandardOutput());
   proclog.insert("return_codes/"+cCmd, QString::number(ret));
 
   //Now run any additional commands
   //qDebug() << "Proc Finished:" << ID << success << proclog;
   if(success && !cmds.isEmpty()){
-    emit ProcUpdate(ID, proclog);
+    emitUpdate(); //the rest of the output for this command
     startProc();
   }else{
     proclog.insert("state","finished");
     proclog.remove("current_cmd");
     proclog.insert("time_finished", QDateTime::currentDateTime().toString(Qt::ISODate));
-    emit ProcFinished(ID, proclog);
+    emit ProcFinished(ID, getProcLog());
   }
 }
 
 void DProcess::updateLog(){
-  QString tmp = this->readAllStandardOutput();
-  lognew.append(tmp);
-  proclog.insert(cCmd, proclog.value(cCmd).toString().append(tmp) );
-  if(!uptimer->isActive()){ uptimer->start(); }
+  output->append(this->readAllStandardOutput());
+  if(uptimer->isActive()){ return; } //update already scheduled - it will pick this up too
+  qint64 idle = sincesent.elapsed();
+  if(idle >= upinterval){
+    //Output was quiet: send it out right away (after anything else which already came in is read)
+    upinterval = qMax(DPROCESS_UPDATE_MIN, upinterval/2);
+    uptimer->start(0);
+  }else{
+    //Output keeps coming: batch more of it into each update
+    upinterval = qMin(DPROCESS_UPDATE_MAX, upinterval*2);
+    uptimer->start(upinterval - idle);
+  }
 }
 
 void DProcess::emitUpdate(){
   QJsonObject tmp = proclog;
   //only emit the latest changes to the log - not the full thing
-  tmp.insert(cCmd, lognew );
+  // (if the output came in faster than the buffer can hold, this starts at the oldest byte still available)
+  qint64 start = lastsent;
+  QByteArray data = output->read(lastsent, (int) qMin(output->size()-lastsent, (qint64) outputLimit), &start);
+  lastsent = start + data.size();
+  sincesent.start();
+  if(!cCmd.isEmpty()){ tmp.insert(cCmd, QString::fromLocal8Bit(data) ); }
+  tmp.insert("output_offset", start);
+  tmp.insert("output_size", lastsent);
   emit ProcUpdate(ID, tmp);
-  lognew.clear();
 }
 
 // ================================
@@ -124,93 +165,114 @@ void DProcess::emitUpdate(){
 // ================================
 Dispatcher::Dispatcher(){
   qRegisterMetaType<Dispatcher::PROC_QUEUE>("Dispatcher::PROC_QUEUE");
-  connect(this, SIGNAL(mkprocs(Dispatcher::PROC_QUEUE, DProcess*)), this, SLOT(mkProcs(Dispatcher::PROC_QUEUE, DProcess*)) );
-  connect(this, SIGNAL(checkProcs()), this, SLOT(CheckQueues()) );
+  connect(this, SIGNAL(mkprocs(QString, DProcess*)), this, SLOT(mkProcs(QString, DProcess*)) );
+  //Built-in queues (limits can be changed from the config file)
+  maxTotal = 0;
+  runningTotal = 0;
+  nextTurn = 0;
+  checkScheduled = false;
+  outputBytes = DISPATCHER_OUTPUT_BYTES;
+  defineQueue(queueToString(NO_QUEUE), 0); //everything in parallel
+  defineQueue(queueToString(PKG_QUEUE), 1); //only one pkg process can run at a time
+  defineQueue(queueToString(IOCAGE_QUEUE), 1);
+  journal = 0;
+  journalTimer = 0;
+  journalSeq = 0;
+  journalDone = 0;
 }
 
 Dispatcher::~Dispatcher(){
-
+  qDeleteAll(ORDER);
 }
 
 QJsonObject Dispatcher::listJobs(){
   QJsonObject out;
-  for(int i=0; i<enum_length; i++){
-    PROC_QUEUE queue = static_cast<PROC_QUEUE>(i);
-    if(HASH.contains(queue)){
-      QJsonObject obj;
-      QList<DProcess*> list = HASH[queue];
-      for(int j=0; j<list.length(); j++){
+  QReadLocker lock(&jobLock);
+  for(int i=0; i<ORDER.length(); i++){
+    if(ORDER[i]->first==0){ continue; }
+    QJsonObject obj;
+    int pos = 0;
+    for(DProcess *P = ORDER[i]->first; P!=0; P = P->qnext, pos++){
 	QJsonObject proc;
-          proc.insert("commands", QJsonArray::fromStringList(list[j]->rawcmds));
-          if(queue!=NO_QUEUE){ proc.insert("queue_position",QString::number(j)); }
-	  if( list[j]->isRunning() ){ proc.insert("state", "running");  }
-	  else if(list[j]->isDone() ){ proc.insert("state", "finished"); }
+          proc.insert("commands", QJsonArray::fromStringList(P->rawcmds));
+          if(ORDER[i]->maxRunning!=0){ proc.insert("queue_position",QString::number(pos)); }
+	  if(P->jobstate==DProcess::STARTED){ proc.insert("state", "running");  }
 	  else{ proc.insert("state","pending"); }
-        obj.insert(list[j]->ID, proc);
-      } //end loop over list
-      QString qname;
-      switch(queue){
-        case NO_QUEUE:
-         qname="no_queue"; break;
-        case PKG_QUEUE:
-         qname="pkg_queue"; break;
-        case IOCAGE_QUEUE:
-         qname="iocage_queue"; break;
-      }
-      out.insert(qname,obj);
-    }
-  } //end loop over queue types
+        obj.insert(P->ID, proc);
+    } //end loop over list
+    out.insert(ORDER[i]->name, obj);
+  } //end loop over queues
+  return out;
+}
+
+QJsonObject Dispatcher::listQueues(){
+  QJsonObject out;
+  QReadLocker lock(&jobLock);
+  for(int i=0; i<ORDER.length(); i++){
+    QJsonObject obj;
+      obj.insert("max_running", ORDER[i]->maxRunning);
+      obj.insert("priority", ORDER[i]->priority);
+      obj.insert("depends", QJsonArray::fromStringList(ORDER[i]->depends));
+      obj.insert("running", ORDER[i]->running);
+      if(ORDER[i]->subRunning>0){ obj.insert("sub_running", ORDER[i]->subRunning); }
+      obj.insert("jobs", ORDER[i]->count);
+    out.insert(ORDER[i]->name, obj);
+  }
   return out;
 }
 
 QJsonObject Dispatcher::killJobs(QStringList ids){
   QStringList killed;
-  for(int i=0; i<enum_length; i++){
-    PROC_QUEUE queue = static_cast<PROC_QUEUE>(i);
-    if(HASH.contains(queue)){
-      QList<DProcess*> list = HASH[queue];
-      for(int j=0; j<list.length(); j++){
-	if(ids.contains(list[j]->ID)){
-          killed << list[j]->ID;
-          QTimer::singleShot(10, list[j], SLOT(kill())); //10ms buffer
-        }
-      } //end loop over list
+  QReadLocker lock(&jobLock);
+  for(int i=0; i<ids.length(); i++){
+    QMultiHash<QString, DProcess*>::const_iterator it = JOBS.constFind(ids[i]);
+    for( ; it!=JOBS.constEnd() && it.key()==ids[i]; ++it){
+      killed << ids[i];
+      QTimer::singleShot(10, it.value(), SLOT(kill())); //10ms buffer
     }
-  } //end loop over queue types
+  }
   QJsonObject obj;
     obj.insert("jobs", QJsonArray::fromStringList(killed));
   return obj;
 }
 
 bool Dispatcher::isJobActive(QString ID){
-  //qDebug() << " - Is Job Active:" << ID;
-  for(int i=0; i<enum_length; i++){
-    PROC_QUEUE queue = static_cast<PROC_QUEUE>(i);
-    if(HASH.contains(queue)){
-      QList<DProcess*> list = HASH[queue];
-      for(int j=0; j<list.length(); j++){
-	if(ID == list[j]->ID){
-	  //qDebug() << " -- " << !list[j]->isDone();
-          return !(list[j]->isDone());
-        }
-      } //end loop over list
-    }
+  //Finished jobs are taken out of the index right away
+  QReadLocker lock(&jobLock);
+  return JOBS.contains(ID);
+}
+
+QStringList Dispatcher::jobIDs(QString prefix){
+  QReadLocker lock(&jobLock);
+  if(prefix.isEmpty()){ return JOBS.uniqueKeys(); }
+  QStringList ids;
+  for(QMultiHash<QString, DProcess*>::const_iterator it = JOBS.constBegin(); it!=JOBS.constEnd(); ++it){
+    if(it.key().startsWith(prefix) && !ids.contains(it.key())){ ids << it.key(); }
   }
-  //qDebug() << " -- NO";
-  return false; //could not find process with this ID
+  return ids;
 }
 
 void Dispatcher::start(QString queuefile){
   //Setup connections here (in case it was moved to different thread after creation)
   //connect(this, SIGNAL(mkprocs(Dispatcher::PROC_QUEUE, DProcess*)), this, SLOT(mkProcs(Dispatcher::PROC_QUEUE, DProcess*)) );
-  //connect(this, SIGNAL(checkProcs()), this, SLOT(checkQueues()) );
+  if(journal!=0){ return; } //already started
+  queue_file = queuefile;
+  journalTimer = new QTimer(this);
+    journalTimer->setSingleShot(true);
+    journalTimer->setInterval(200); //max time a journal record waits for the disk
+  connect(journalTimer, SIGNAL(timeout()), this, SLOT(journalSync()) );
   //load any previously-unrun processes
-  // TO DO
+  journalReplay();
 }
 
 void Dispatcher::stop(){
   //save any currently-unrun processes for next time the server starts
-  // TO DO
+  // (the journal is always up to date - just make sure it is on disk)
+  if(journal==0){ return; }
+  journalSync();
+  journal->close();
+  delete journal;
+  journal = 0;
 }
 
 //Overloaded Main Calling Functions (single command, or multiple in-order commands)
@@ -227,12 +289,92 @@ DProcess* Dispatcher::queueProcess(Dispatcher::PROC_QUEUE queue, QString ID, QSt
   //This is the primary queueProcess() function - all the overloads end up here to do the actual work
   //For multi-threading, need to emit a signal/slot for this action (object creations need to be in same thread as parent)
   //qDebug() << "Queue Process:" << queue << ID << cmds;
+  return queueNamedProcess(queueToString(queue), ID, cmds, workdir);
+}
+DProcess* Dispatcher::queueNamedProcess(QString queue, QString ID, QStringList cmds, QString workdir){
   DProcess *P = createProcess(ID, cmds, workdir);
   this->emit mkprocs(queue, P);
   return P;
 }
 
+void Dispatcher::defineQueue(QString name, int maxRunning, int priority, QStringList depends){
+  QWriteLocker lock(&jobLock);
+  DispatchQueue *Q = QUEUES.value(name, 0);
+  if(Q==0){
+    Q = new DispatchQueue;
+    Q->name = name;
+    Q->first = Q->last = Q->pending = 0;
+    Q->count = 0;
+    Q->running = 0;
+    Q->subRunning = 0;
+    Q->parent = 0;
+    //Link up the sub-queues ("<queue>:<name>") with their main queue
+    if(name.contains(":")){ Q->parent = QUEUES.value(name.section(":",0,0), 0); }
+    for(int i=0; i<ORDER.length(); i++){
+      if(ORDER[i]->name.section(":",0,0)==name && ORDER[i]->name.contains(":")){ ORDER[i]->parent = Q; }
+    }
+    QUEUES.insert(name, Q);
+    ORDER << Q;
+  }
+  Q->maxRunning = qMax(0, maxRunning);
+  Q->priority = priority;
+  Q->depends = depends;
+  Q->depends.removeAll(name);
+  //Keep the queues sorted by priority (stable - same-priority queues stay in creation order)
+  std::stable_sort(ORDER.begin(), ORDER.end(), [](DispatchQueue *A, DispatchQueue *B){ return A->priority > B->priority; });
+}
+
+void Dispatcher::setMaxRunning(int max){
+  maxTotal = qMax(0, max);
+}
+
 // === PRIVATE ===
+QString Dispatcher::queueToString(Dispatcher::PROC_QUEUE queue){
+  switch(queue){
+    case PKG_QUEUE: return "pkg_queue";
+    case IOCAGE_QUEUE: return "iocage_queue";
+    default: return "no_queue";
+  }
+}
+
+DispatchQueue* Dispatcher::queue(QString name){
+  //Note: the queues are only created from the dispatcher thread, so no read lock is needed here
+  if(name.isEmpty()){ name = queueToString(NO_QUEUE); }
+  if(!QUEUES.contains(name)){
+    //Undefined queue: one job at a time (make sure the main queue of a sub-queue exists first so they get linked up)
+    if(name.contains(":")){ queue(name.section(":",0,0)); }
+    defineQueue(name, 1);
+  }
+  return QUEUES.value(name);
+}
+
+void Dispatcher::removeProcess(DProcess *P){
+  QWriteLocker lock(&jobLock);
+  DispatchQueue *Q = P->queue;
+  if(Q==0){ return; } //already removed
+  if(P->qprev!=0){ P->qprev->qnext = P->qnext; }
+  else{ Q->first = P->qnext; }
+  if(P->qnext!=0){ P->qnext->qprev = P->qprev; }
+  else{ Q->last = P->qprev; }
+  if(Q->pending==P){ Q->pending = P->qnext; }
+  P->qprev = P->qnext = 0;
+  P->queue = 0;
+  Q->count--;
+  if(P->jobstate==DProcess::STARTED){
+    Q->running--;
+    runningTotal--;
+    if(Q->parent!=0){ Q->parent->subRunning--; }
+  }
+  P->jobstate = DProcess::FINISHED;
+  keepOutput(P);
+  //Remove this job from the index (other jobs might use the same ID)
+  QMultiHash<QString, DProcess*>::iterator it = JOBS.find(P->ID);
+  while(it!=JOBS.end() && it.key()==P->ID){
+    if(it.value()==P){ JOBS.erase(it); break; }
+    ++it;
+  }
+}
+
 //Simplification routine for setting up a process
 DProcess* Dispatcher::createProcess(QString ID, QStringList cmds, QString workdir){
   DProcess *P = new DProcess();
@@ -240,26 +382,52 @@ DProcess* Dispatcher::createProcess(QString ID, QStringList cmds, QString workdi
     P->cmds = cmds;
     P->ID = ID;
     if(!workdir.isEmpty()){ P->setWorkingDirectory(workdir); }
+    QString spill;
+    if(!outputSpillDir.isEmpty()){ spill = outputSpillDir+"/"+QUuid::createUuid().toString().remove("{").remove("}")+".log"; }
+    P->outputLimit = outputBytes;
+    P->output = QSharedPointer<DOutputBuffer>(new DOutputBuffer(outputBytes, spill));
   return P;
 }
 
 // === PRIVATE SLOTS ===
-void Dispatcher::mkProcs(Dispatcher::PROC_QUEUE queue, DProcess *P){
+void Dispatcher::mkProcs(QString queue, DProcess *P){
   //qDebug() << "mkProcs()";
-  QList<DProcess*> list = HASH.value(queue);
-  list << P;
+  journalSubmit(queue, P);
+  addProcess(queue, P);
+}
+
+void Dispatcher::addProcess(QString queue, DProcess *P){
   //qDebug() << " - add to queue:" << queue;
-  HASH.insert(queue,list);
+  DispatchQueue *Q = this->queue(queue);
+  P->procSetup(); //listJobs() reads rawcmds from other threads as soon as the job is linked in
+  jobLock.lockForWrite();
+    P->queue = Q;
+    P->qprev = Q->last;
+    P->qnext = 0;
+    if(Q->last!=0){ Q->last->qnext = P; }
+    else{ Q->first = P; }
+    Q->last = P;
+    if(Q->pending==0){ Q->pending = P; }
+    Q->count++;
+    JOBS.insert(P->ID, P);
+  jobLock.unlock();
   connect(P, SIGNAL(ProcFinished(QString, QJsonObject)), this, SLOT(ProcFinished(QString, QJsonObject)) );
   connect(P, SIGNAL(ProcUpdate(QString, QJsonObject)), this, SLOT(ProcUpdated(QString, QJsonObject)) );
   P->procReady();
-  QTimer::singleShot(30, this, SIGNAL(checkProcs()) );
+  scheduleCheck();
 }
 
 void Dispatcher::ProcFinished(QString ID, QJsonObject log){
   //Find the process with this ID and close it down (with proper events)
   //qDebug() << " - Got Proc Finished Signal:" << ID;
   LogManager::log(LogManager::DISPATCH, log);
+  DProcess *P = qobject_cast<DProcess*>(sender());
+  if(P!=0 && P->queue!=0){
+    journalState(P, "finished", log);
+    removeProcess(P);
+    P->deleteLater();
+  }
+  emit DispatchFinished(ID);
   //First emit any subsystem-specific event, falling back on the raw log
   QJsonObject ev = CreateDispatcherEventNotification(ID,log, true);
   if(!ev.isEmpty()){
@@ -267,7 +435,7 @@ void Dispatcher::ProcFinished(QString ID, QJsonObject log){
   }else{
     emit DispatchEvent(log);
   }
-  QTimer::singleShot(30, this, SIGNAL(checkProcs()) );
+  scheduleCheck();
 }
 
 void Dispatcher::ProcUpdated(QString ID, QJsonObject log){
@@ -278,33 +446,52 @@ void Dispatcher::ProcUpdated(QString ID, QJsonObject log){
   }
 }
 
+void Dispatcher::scheduleCheck(){
+  if(checkScheduled){ return; }
+  checkScheduled = true;
+  QMetaObject::invokeMethod(this, "CheckQueues", Qt::QueuedConnection);
+}
+
 void Dispatcher::CheckQueues(){
-//qDebug() << "Check Queues...";
-for(int i=0; i<enum_length; i++){
-    PROC_QUEUE queue = static_cast<PROC_QUEUE>(i);
-    //qDebug() << "Got queue:" << queue;
-    if(HASH.contains(queue)){
-      //qDebug() << "Hash has queue";
-      QList<DProcess*> list = HASH[queue];
-      //qDebug() << "Length:" << list.length();
-      for(int j=0; j<list.length(); j++){
-	//qDebug() << "Check Proc:" << list[j]->ID;
-	if(j>0 && queue!=NO_QUEUE){ break; } //done with this - only first item in these queues should run at a time
-	if( !list[j]->isRunning() ){
-	  if(list[j]->isDone() ){
-	    //qDebug() << "Remove Finished Proc:" << list[j]->ID;
-	    list.takeAt(j)->deleteLater();
-	    HASH.insert(queue, list); //replace the list in the hash since it changed
-	    j--;
-	  }else{
-	    //Need to start this one - has not run yet
-	    //qDebug() << "Call Start Proc:" << list[j]->ID;
-	    emit DispatchStarting(list[j]->ID);
-	    list[j]->startProc();
-	  }
-	}
-      } //end loop over list
+  //qDebug() << "Check Queues...";
+  checkScheduled = false;
+  //Finished jobs are already gone and the running counts are kept up to date - just start pending jobs
+  // Each queue points at its first pending job, so this only walks the queues (not the jobs in them)
+  // Note: only this thread changes the lists, so they can be walked without the lock (it is only needed for the changes)
+  //The queues take turns (one job each per round, highest priority first) so a queue with lots of jobs cannot
+  // take every free slot. Once the total limit is reached the queue which could not start a job goes first next time.
+  int num = ORDER.length();
+  if(nextTurn>=num){ nextTurn = 0; }
+  bool started = true;
+  while(started){
+    started = false;
+    for(int n=0; n<num; n++){
+      int index = (nextTurn+n) % num;
+      DispatchQueue *Q = ORDER[index];
+      if(Q->pending==0){ continue; } //nothing waiting
+      //Main queues and their sub-queues never run at the same time
+      bool blocked = (Q->subRunning>0) || (Q->parent!=0 && Q->parent->running>0);
+      for(int d=0; d<Q->depends.length() && !blocked; d++){
+        blocked = (QUEUES.contains(Q->depends[d]) && QUEUES[Q->depends[d]]->running>0);
+      }
+      if(blocked){ continue; }
+      if(Q->maxRunning>0 && Q->running>=Q->maxRunning){ continue; } //queue is full
+      if(maxTotal>0 && runningTotal>=maxTotal){ nextTurn = index; return; } //everything is full - this queue is next
+      //Need to start this one - has not run yet
+      DProcess *P = Q->pending;
+      //qDebug() << "Call Start Proc:" << P->ID;
+      jobLock.lockForWrite();
+        Q->pending = P->qnext;
+        P->jobstate = DProcess::STARTED;
+        Q->running++;
+        runningTotal++;
+        if(Q->parent!=0){ Q->parent->subRunning++; }
+      jobLock.unlock();
+      emit DispatchStarting(P->ID);
+      journalState(P, "running");
+      P->startProc(); //P might be finished (and removed) by the time this returns
+      started = true;
     }
-
-  } //end loop over queue types
+  }
+  nextTurn = 0; //nothing is waiting for a free slot - back to priority order
 }
@@ -8,6 +8,41 @@
 
 #include "globals-qt.h"
 
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+
+struct DispatchQueue;
+
+//Default amount of output kept in memory for each job (bytes)
+#define DISPATCHER_OUTPUT_BYTES 1048576
+//Range for the time between output updates of a job (msecs) - short when the output trickles in, long when it floods in
+#define DPROCESS_UPDATE_MIN 50
+#define DPROCESS_UPDATE_MAX 2000
+
+// == Output of a job: the last "capacity" bytes in memory (+ all of it in a spill file if one is given) ==
+//  Offsets are bytes since the job started - readers can ask for the output from any offset
+//  (DispatcherOutput.cpp)
+class DOutputBuffer{
+public:
+	DOutputBuffer(int capacity, QString spillfile = "");
+	~DOutputBuffer(); //removes the spill file
+
+	void append(const QByteArray &data);
+	qint64 size(); //bytes written so far
+	bool truncated(); //true if some of the output can no longer be read
+	//Read up to "maxlen" bytes from "offset" (moved up to the oldest byte still available - "start" gets the actual offset)
+	QByteArray read(qint64 offset, int maxlen, qint64 *start = 0);
+
+private:
+	QMutex mutex;
+	QByteArray ring; //byte N is at N%cap (grows up to cap)
+	int cap;
+	qint64 total;
+	QFile *spill;
+	qint64 firstOffset(); //oldest byte which can still be read (no lock)
+};
 
 // == Simple Process class for running sequential commands ==
 class DProcess : public QProcess{
@@ -18,12 +53,23 @@ public:
 
 	QString ID;
 	QStringList cmds;
+	qint64 jobnum; //number of the job in the dispatcher journal (0: not journaled)
+
+	//Dispatcher bookkeeping (only changed by the dispatcher, under its job lock)
+	enum JOB_STATE { QUEUED = 0, STARTED, FINISHED };
+	JOB_STATE jobstate;
+	DispatchQueue *queue; //0 once the job has been removed from its queue
+	DProcess *qprev, *qnext; //intrusive list of the jobs in the queue
 
 	//output variables for logging purposes
 	bool success;
 	//QDateTime t_started, t_finished;
 	QStringList rawcmds; //copy of cmds at start of process
 
+	//Output of all the commands (bounded - shared with the dispatcher so it can still be read after the job is done)
+	QSharedPointer<DOutputBuffer> output;
+	int outputLimit; //max bytes of output for each command in a log/update (the configured buffer size)
+
 	//Get the current process log (can be run during/after the process runs)
 	QJsonObject getProcLog();
 	//Process Status
@@ -31,13 +77,19 @@ public:
 	bool isDone();
 
 public slots:
-	void procReady(); //all the input arguments have been setup - and the proc is ready to be started
+	void procSetup(); //all the input arguments have been setup (call before the dispatcher publishes the job to other threads)
+	void procReady(); //the proc is queued and ready to be started (sends the "pending" update)
 	void startProc();
 
 private:
-	QString cCmd, lognew;
-	QJsonObject proclog;
-	QTimer *uptimer;
+	QString cCmd;
+	QJsonObject proclog; //state/times/return codes (the output lives in the output buffer)
+	QStringList logcmds; //commands started so far
+	QList<qint64> logstart; //output offset where each of those commands started
+	qint64 lastsent; //output offset of the first byte not sent with an update yet
+	QTimer *uptimer; //single-shot: next output update
+	QElapsedTimer sincesent; //time since the last output update
+	int upinterval; //current time between output updates (adaptive)
 
 private slots:
 	void cmdError(QProcess::ProcessError);
@@ -52,18 +104,35 @@ signals:
 };
 
 
+// == Job queue (defined at runtime - the PROC_QUEUE values are the built-in queues) ==
+struct DispatchQueue{
+	QString name;
+	int maxRunning; //max jobs running at the same time (0: no limit)
+	int priority; //higher priority queues get the free job slots first
+	QStringList depends; //do not start jobs while any of these queues have jobs running
+	DProcess *first, *last; //jobs in submission order (linked through DProcess::qprev/qnext)
+	DProcess *pending; //first job which has not been started (jobs start in order - everything after this one is pending too)
+	int count; //jobs in the queue
+	int running; //jobs running right now
+	DispatchQueue *parent; //"<queue>" for a "<queue>:<name>" sub-queue (they never run at the same time as each other)
+	int subRunning; //jobs running right now in the sub-queues of this one
+};
+
 class Dispatcher : public QObject{
 	Q_OBJECT
 public:
 	enum PROC_QUEUE { NO_QUEUE = 0, PKG_QUEUE, IOCAGE_QUEUE };
-#define enum_length 3 //This needs to be the number of items  in the enum above
 
 	Dispatcher();
 	~Dispatcher();
 
 	QJsonObject listJobs();
+	QJsonObject listQueues(); //queue settings and number of running/pending jobs
 	QJsonObject killJobs(QStringList ids);
+	//Output of a running (or recently finished) job from the given byte offset
+	QJsonObject readOutput(QString ID, qint64 offset, int maxlen);
 	bool isJobActive(QString ID); //returns true if a job with this ID is running/pending
+	QStringList jobIDs(QString prefix = ""); //IDs of the running/pending jobs (optionally only the ones starting with "prefix")
 
 public slots:
 	//Main start/stop
@@ -75,16 +144,54 @@ public slots:
 	DProcess* queueProcess(QString ID, QStringList cmds, QString workdir = ""); //uses NO_QUEUE
 	DProcess* queueProcess(Dispatcher::PROC_QUEUE, QString ID, QString cmd, QString workdir = "");
 	DProcess* queueProcess(Dispatcher::PROC_QUEUE, QString ID, QStringList cmds, QString workdir = "");
+	//Any queue by name - undefined queues get created with maxRunning=1
+	//  ("<queue>:<name>" sub-queues wait on "<queue>" and the other way around - sub-queues only run in parallel with each other)
+	DProcess* queueNamedProcess(QString queue, QString ID, QStringList cmds, QString workdir = "");
+
+	//Queue settings (call before the dispatcher is moved to its thread, or through a queued connection)
+	void defineQueue(QString name, int maxRunning, int priority = 0, QStringList depends = QStringList());
+	void setMaxRunning(int max); //max jobs running over all the queues (0: no limit)
+	void setOutputLimits(int bytes, QString spilldir = ""); //output kept in memory per job, directory for the full output (empty: none)
 
 private:
 	// Queue file
 	QString queue_file;
 
 	//Internal lists
-	QHash<PROC_QUEUE, QList<DProcess*> > HASH;
+	QHash<QString, DispatchQueue*> QUEUES;
+	QList<DispatchQueue*> ORDER; //by priority (highest first)
+	QMultiHash<QString, DProcess*> JOBS; //ID -> job (every job still in a queue)
+	QReadWriteLock jobLock; //queues + index (listJobs/isJobActive get called from the request threads)
+	int maxTotal, runningTotal;
+	int nextTurn; //ORDER index which gets the first free slot once the total limit is reached
+	int nextTurn; //ORDER index which gets the first free slot once the total limit is reached
+	bool checkScheduled; //CheckQueues() is already queued up
+	void scheduleCheck(); //run CheckQueues() once control gets back to the event loop (coalesces bursts of submissions/finishes)
+	int outputBytes;
+	QString outputSpillDir;
+	QHash<QString, QSharedPointer<DOutputBuffer> > FINISHED; //output of the recently finished jobs (for readOutput)
+	QQueue<QString> finishedOrder; //oldest first
+	DispatchQueue* queue(QString name); //creates undefined queues
+	void removeProcess(DProcess *P); //take a job out of its queue + the index
+	void keepOutput(DProcess *P); //keep the output of a finished job around for a while (DispatcherOutput.cpp)
 
 	//Simplification routine for setting up a process
 	DProcess* createProcess(QString ID, QStringList cmds, QString workdir = "");
+	void addProcess(QString queue, DProcess *P); //add to the queue and get it ready to run
+	static QString queueToString(Dispatcher::PROC_QUEUE);
+
+	// Job journal: one JSON object per line (DispatcherJournal.cpp)
+	QFile *journal;
+	QTimer *journalTimer; //batches the fsync() calls
+	qint64 journalSeq; //number of the last job submitted
+	int journalDone; //jobs finished since the last compaction
+	QHash<qint64, QJsonObject> journalJobs; //unfinished job number -> submit record
+	void journalReplay(); //requeue unfinished jobs from the last run
+	bool journalCompact(); //rewrite the journal with only the unfinished jobs
+	void journalWrite(QJsonObject rec);
+	void journalSubmit(QString queue, DProcess *P);
+	void journalState(DProcess *P, QString state, QJsonObject log = QJsonObject());
+
 	QJsonObject CreateDispatcherEventNotification(QString, QJsonObject, bool);
 
 	// Functions to do parsing out dispatcher queued tasks
@@ -92,7 +199,8 @@ private:
 	void parseIohyveFetchOutput(QString outputLog, QJsonObject *out);
 
 private slots:
-	void mkProcs(Dispatcher::PROC_QUEUE, DProcess *P);
+	void journalSync(); //flush + fsync the pending journal records
+	void mkProcs(QString queue, DProcess *P);
 	void ProcFinished(QString ID, QJsonObject log);
 	void ProcUpdated(QString ID, QJsonObject log);
 	void CheckQueues();
@@ -101,10 +209,10 @@ signals:
 	//Main signals
 	void DispatchEvent(QJsonObject obj); //obj is the data associated with the process
 	void DispatchStarting(QString ID);
+	void DispatchFinished(QString ID); //job is out of the queues (isJobActive() is false from now on)
 
 	//Signals for private usage
-	void mkprocs(Dispatcher::PROC_QUEUE, DProcess*);
-	void checkProcs();
+	void mkprocs(QString, DProcess*);
 
 };
 
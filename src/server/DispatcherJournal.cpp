@@ -0,0 +1,140 @@
+// ===============================
+// PC-BSD REST API Server
+// Available under the 3-clause BSD License
+// =================================
+// Append-only journal of the dispatcher jobs (so queued jobs survive a restart)
+// Records (one JSON object per line):
+//   {"op":"submit", "job":<num>, "id":<ID>, "queue":<queue>, "cmds":[<cmd>,...], "workdir":<dir>, "time":<ISO>}
+//   {"op":"running", "job":<num>, "time":<ISO>}
+//   {"op":"finished", "job":<num>, "success":<bool>, "return_codes":{<cmd>:<code>,...}, "time":<ISO>}
+//=================================
+#include "Dispatcher.h"
+#include "globals.h"
+
+#include <QSaveFile>
+
+#include <algorithm>
+#include <unistd.h>
+
+//Rewrite the journal after this many jobs finish (keeps the file - and the replay time - small)
+#define JOURNAL_COMPACT_JOBS 256
+
+void Dispatcher::journalReplay(){
+  QHash<qint64, QJsonObject> pending, running;
+  QFile file(queue_file);
+  if(file.open(QIODevice::ReadOnly)){
+    while(!file.atEnd()){
+      QJsonObject rec = QJsonDocument::fromJson(file.readLine()).object();
+      if(rec.isEmpty()){ continue; } //partial line from a crash
+      qint64 num = rec.value("job").toVariant().toLongLong();
+      QString op = rec.value("op").toString();
+      if(num>journalSeq){ journalSeq = num; }
+      if(op=="submit"){ pending.insert(num, rec); }
+      else if(op=="running" && pending.contains(num)){ running.insert(num, pending.take(num)); }
+      else if(op=="finished"){ pending.remove(num); running.remove(num); }
+    }
+    file.close();
+  }
+  //Jobs which were in the middle of running might have been half-done - do not start those again automatically
+  QList<qint64> nums = running.keys();
+  for(int i=0; i<nums.length(); i++){
+    qDebug() << "Dispatcher job interrupted by a restart:" << running[nums[i]].value("id").toString();
+  }
+  journalJobs = pending;
+  if(!journalCompact()){ qDebug() << "Could not write the dispatcher journal:" << queue_file; return; }
+  //Now requeue the pending jobs (in the original order)
+  nums = pending.keys();
+  std::sort(nums.begin(), nums.end());
+  for(int i=0; i<nums.length(); i++){
+    QJsonObject rec = pending[nums[i]];
+    QStringList cmds;
+    QJsonArray arr = rec.value("cmds").toArray();
+    for(int j=0; j<arr.count(); j++){ cmds << arr[j].toString(); }
+    DProcess *P = createProcess(rec.value("id").toString(), cmds, rec.value("workdir").toString());
+    P->jobnum = nums[i];
+    addProcess(rec.value("queue").toString(), P);
+  }
+  if(!nums.isEmpty()){ qDebug() << "Restored dispatcher jobs:" << nums.length(); }
+}
+
+bool Dispatcher::journalCompact(){
+  if(journal!=0){ journalSync(); journal->close(); delete journal; journal = 0; }
+  QDir dir;
+  dir.mkpath(queue_file.section("/",0,-2));
+  //Write the new file out to the side first, then swap it in (never lose the old one)
+  QSaveFile save(queue_file);
+  if(!save.open(QIODevice::WriteOnly | QIODevice::Truncate)){ return false; }
+  QList<qint64> nums = journalJobs.keys();
+  std::sort(nums.begin(), nums.end());
+  for(int i=0; i<nums.length(); i++){
+    QJsonObject rec = journalJobs[nums[i]];
+    bool running = rec.take("running").toBool();
+    save.write( QJsonDocument(rec).toJson(QJsonDocument::Compact)+"\n" );
+    if(running){
+      QJsonObject state;
+        state.insert("op", "running");
+        state.insert("job", nums[i]);
+      save.write( QJsonDocument(state).toJson(QJsonDocument::Compact)+"\n" );
+    }
+  }
+  if(!save.commit()){ return false; }
+  journalDone = 0;
+  //Re-open for appending
+  journal = new QFile(queue_file);
+  if(!journal->open(QIODevice::WriteOnly | QIODevice::Append)){
+    delete journal;
+    journal = 0;
+    return false;
+  }
+  return true;
+}
+
+void Dispatcher::journalWrite(QJsonObject rec){
+  if(journal==0){ return; } //journal not started
+  rec.insert("time", QDateTime::currentDateTime().toString(Qt::ISODate));
+  journal->write( QJsonDocument(rec).toJson(QJsonDocument::Compact)+"\n" );
+  journal->flush(); //into the OS right away - the fsync gets batched
+  if(journalTimer!=0 && !journalTimer->isActive()){ journalTimer->start(); }
+}
+
+void Dispatcher::journalSubmit(QString queue, DProcess *P){
+  if(journal==0){ return; }
+  P->jobnum = ++journalSeq;
+  QJsonObject rec;
+    rec.insert("op", "submit");
+    rec.insert("job", P->jobnum);
+    rec.insert("id", P->ID);
+    rec.insert("queue", queue);
+    rec.insert("cmds", QJsonArray::fromStringList(P->cmds));
+    if(!P->workingDirectory().isEmpty()){ rec.insert("workdir", P->workingDirectory()); }
+  journalJobs.insert(P->jobnum, rec);
+  journalWrite(rec);
+}
+
+void Dispatcher::journalState(DProcess *P, QString state, QJsonObject log){
+  if(journal==0 || P->jobnum<1){ return; }
+  QJsonObject rec;
+    rec.insert("op", state);
+    rec.insert("job", P->jobnum);
+  if(state=="finished"){
+    rec.insert("success", P->success);
+    QJsonObject codes;
+    QStringList keys = log.keys().filter("return_codes/");
+    for(int i=0; i<keys.length(); i++){ codes.insert(keys[i].section("/",1,-1), log.value(keys[i])); }
+    rec.insert("return_codes", codes);
+    journalJobs.remove(P->jobnum);
+    journalDone++;
+  }else if(journalJobs.contains(P->jobnum)){
+    journalJobs[P->jobnum].insert("running", true); //kept through compactions
+  }
+  journalWrite(rec);
+  if(journalDone >= JOURNAL_COMPACT_JOBS){ journalCompact(); }
+}
+
+// === PRIVATE SLOTS ===
+void Dispatcher::journalSync(){
+  if(journalTimer!=0 && journalTimer->isActive()){ journalTimer->stop(); }
+  if(journal==0){ return; }
+  journal->flush();
+  ::fsync(journal->handle());
+}
@@ -0,0 +1,149 @@
+// ===============================
+// PC-BSD REST API Server
+// Available under the 3-clause BSD License
+// =================================
+// Output capture for the dispatcher jobs
+//  - every job keeps the last N bytes of output in a ring buffer (the rest is dropped, or only kept in the spill file)
+//  - updates only carry the new output (+ its byte offset), clients can fetch any range with the "read_output" action
+//=================================
+#include "Dispatcher.h"
+#include "globals.h"
+
+#include <string.h>
+
+//Number of finished jobs which keep their output around for readOutput()
+#define DISPATCHER_KEEP_OUTPUT 32
+//Largest single read
+#define DISPATCHER_READ_MAX 1048576
+
+// ================================
+//  DOutputBuffer
+// ================================
+DOutputBuffer::DOutputBuffer(int capacity, QString spillfile){
+  cap = qMax(capacity, 1024);
+  total = 0;
+  spill = 0;
+  if(!spillfile.isEmpty()){
+    spill = new QFile(spillfile);
+    if(!spill->open(QIODevice::ReadWrite | QIODevice::Truncate)){
+      qDebug() << "Could not open dispatcher output file:" << spillfile;
+      delete spill;
+      spill = 0;
+    }
+  }
+}
+
+DOutputBuffer::~DOutputBuffer(){
+  if(spill!=0){
+    spill->close();
+    spill->remove();
+    delete spill;
+  }
+}
+
+void DOutputBuffer::append(const QByteArray &data){
+  if(data.isEmpty()){ return; }
+  QMutexLocker lock(&mutex);
+  if(spill!=0){
+    spill->seek(spill->size());
+    spill->write(data);
+  }
+  const char *ptr = data.constData();
+  qint64 num = data.size();
+  if(num > cap){ ptr += (num-cap); total += (num-cap); num = cap; } //only the end of it fits
+  while(num>0){
+    int pos = total % cap;
+    int len = qMin(num, (qint64) (cap-pos));
+    if(ring.size() < pos+len){ ring.resize(pos+len); } //still growing
+    memcpy(ring.data()+pos, ptr, len);
+    ptr += len;
+    num -= len;
+    total += len;
+  }
+}
+
+qint64 DOutputBuffer::size(){
+  QMutexLocker lock(&mutex);
+  return total;
+}
+
+bool DOutputBuffer::truncated(){
+  QMutexLocker lock(&mutex);
+  return (firstOffset() > 0);
+}
+
+QByteArray DOutputBuffer::read(qint64 offset, int maxlen, qint64 *start){
+  QMutexLocker lock(&mutex);
+  QByteArray out;
+  offset = qBound((qint64) 0, offset, total);
+  if(spill==0 || offset >= total-ring.size()){
+    //Memory (move up to the oldest byte still there)
+    offset = qMax(offset, firstOffset());
+    int len = qMin((qint64) maxlen, total-offset);
+    while(len>0){
+      int pos = offset % cap;
+      int chunk = qMin(len, cap-pos);
+      out.append(ring.constData()+pos, chunk);
+      offset += chunk;
+      len -= chunk;
+    }
+    if(start!=0){ *start = offset - out.size(); }
+  }else{
+    //Older output: from the spill file
+    spill->flush();
+    if(spill->seek(offset)){ out = spill->read( qMin((qint64) maxlen, total-offset) ); }
+    if(start!=0){ *start = offset; }
+  }
+  return out;
+}
+
+qint64 DOutputBuffer::firstOffset(){
+  if(spill!=0){ return 0; }
+  return total - ring.size();
+}
+
+// ================================
+//  Dispatcher
+// ================================
+void Dispatcher::setOutputLimits(int bytes, QString spilldir){
+  outputBytes = bytes;
+  outputSpillDir = spilldir;
+  if(!spilldir.isEmpty()){
+    QDir dir;
+    dir.mkpath(spilldir);
+  }
+}
+
+QJsonObject Dispatcher::readOutput(QString ID, qint64 offset, int maxlen){
+  QJsonObject out;
+  QSharedPointer<DOutputBuffer> buf;
+  QString state = "finished";
+  jobLock.lockForRead();
+    DProcess *P = JOBS.value(ID, 0);
+    if(P!=0){
+      buf = P->output;
+      state = (P->jobstate==DProcess::STARTED) ? "running" : "pending";
+    }else{
+      buf = FINISHED.value(ID);
+    }
+  jobLock.unlock();
+  if(buf.isNull()){ return out; } //unknown job (or it finished too long ago)
+  if(maxlen<=0 || maxlen>DISPATCHER_READ_MAX){ maxlen = DISPATCHER_READ_MAX; }
+  qint64 start = 0;
+  QByteArray data = buf->read(offset, maxlen, &start);
+  out.insert("job_id", ID);
+  out.insert("state", state);
+  out.insert("offset", start);
+  out.insert("length", data.size());
+  out.insert("output_size", buf->size());
+  out.insert("output", QString::fromLocal8Bit(data));
+  return out;
+}
+
+void Dispatcher::keepOutput(DProcess *P){
+  //Note: called with the job lock held
+  if(P->output.isNull()){ return; }
+  if(!FINISHED.contains(P->ID)){ finishedOrder.enqueue(P->ID); }
+  FINISHED.insert(P->ID, P->output);
+  while(finishedOrder.length() > DISPATCHER_KEEP_OUTPUT){ FINISHED.remove(finishedOrder.dequeue()); }
+}
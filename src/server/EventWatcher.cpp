@@ -11,6 +11,7 @@
 #include "library/sysadm-update.h"
 #include "library/sysadm-systemmanager.h"
 #include "library/sysadm-pkg.h"
+#include "library/sysadm-sampler.h"
 
 // === PUBLIC ===
 EventWatcher::EventWatcher(){
@@ -411,6 +412,10 @@ void EventWatcher::CheckSystemState(){
     sysadm::PKG::list_repos(false); //check/update repo databases
   }
 
+  //Load averages from the background sampler (CPU + any extra metrics)
+  QJsonObject load = sysadm::SystemSampler::summary();
+  if(!load.isEmpty()){ obj.insert("load", load); }
+
   // Priority 0-10
   obj.insert("priority", DisplayPriority(priority) );
 
@@ -0,0 +1,129 @@
+// ===============================
+//  PC-BSD REST API Server
+// Available under the 3-clause BSD License
+// Written by: Ken Moore <ken@pcbsd.org> 2015-2016
+// =================================
+#include "RequestScheduler.h"
+#include "library/sysadm-metrics.h"
+
+//Pool runnable for a single request
+class SchedulerRunnable : public QRunnable{
+public:
+  SchedulerRunnable(RequestScheduler *scheduler, RequestScheduler::LANE lane, QString connID, std::function<void()> job, qint64 queuedAt){
+    sched = scheduler; slane = lane; conn = connID; func = job; queued = queuedAt;
+    this->setAutoDelete(true);
+  }
+  void run(){
+    sysadm::Metrics::record("stage", "queue_wait", (QDateTime::currentMSecsSinceEpoch() - queued)*1000);
+    func();
+    sched->requestFinished(slane, conn);
+  }
+private:
+  RequestScheduler *sched;
+  RequestScheduler::LANE slane;
+  QString conn;
+  std::function<void()> func;
+  qint64 queued; //msecs since epoch
+};
+
+RequestScheduler::RequestScheduler(){
+  for(int i=0; i<2; i++){
+    LANES[i].pool = new QThreadPool();
+    LANES[i].running = 0;
+    LANES[i].completed = 0;
+  }
+  rejected = 0;
+  //Default limits (config file values are loaded on startup)
+  int cpus = QThread::idealThreadCount();
+  setLimits( (cpus<2 ? 2 : cpus), 8, 256, 4);
+}
+
+RequestScheduler::~RequestScheduler(){
+  for(int i=0; i<2; i++){
+    LANES[i].pool->waitForDone();
+    delete LANES[i].pool;
+  }
+}
+
+void RequestScheduler::setLimits(int fastThreads, int blockingThreads, int maxQueued, int maxPerConnection){
+  QMutexLocker lock(&mutex);
+  if(fastThreads>0){ LANES[FAST_LANE].pool->setMaxThreadCount(fastThreads); }
+  if(blockingThreads>0){ LANES[BLOCKING_LANE].pool->setMaxThreadCount(blockingThreads); }
+  if(maxQueued>=0){ this->maxQueued = maxQueued; }
+  if(maxPerConnection>0){ this->maxPerConn = maxPerConnection; }
+}
+
+bool RequestScheduler::queueRequest(QString connID, LANE lane, std::function<void()> job){
+  QMutexLocker lock(&mutex);
+  if(queuedCount() >= maxQueued){ rejected++; return false; } //too many waiting - shed the load
+  sched_job J;
+    J.conn = connID;
+    J.func = job;
+    J.queued = QDateTime::currentMSecsSinceEpoch();
+  LANES[lane].queue << J;
+  startNext(lane);
+  return true;
+}
+
+void RequestScheduler::dropConnection(QString connID){
+  QMutexLocker lock(&mutex);
+  for(int i=0; i<2; i++){
+    for(int j=0; j<LANES[i].queue.length(); j++){
+      const QString &conn = LANES[i].queue[j].conn;
+      //Also drops the requests of any bridge clients on this connection ("<connID>/<bridge client>")
+      if(conn==connID || conn.startsWith(connID+"/")){ LANES[i].queue.removeAt(j); j--; }
+    }
+  }
+}
+
+QJsonObject RequestScheduler::stats(){
+  QMutexLocker lock(&mutex);
+  QJsonObject out;
+  qint64 now = QDateTime::currentMSecsSinceEpoch();
+  for(int i=0; i<2; i++){
+    QJsonObject L;
+    L.insert("threads", LANES[i].pool->maxThreadCount());
+    L.insert("running", LANES[i].running);
+    L.insert("queued", LANES[i].queue.length());
+    L.insert("completed", QString::number(LANES[i].completed));
+    L.insert("connections", LANES[i].connRunning.count());
+    if(!LANES[i].queue.isEmpty()){ L.insert("oldest_queued_ms", QString::number(now - LANES[i].queue.first().queued)); }
+    out.insert( (i==FAST_LANE ? "fast" : "blocking"), L);
+  }
+  out.insert("max_queued", maxQueued);
+  out.insert("max_per_connection", maxPerConn);
+  out.insert("rejected", QString::number(rejected));
+  return out;
+}
+
+void RequestScheduler::requestFinished(LANE lane, QString connID){
+  QMutexLocker lock(&mutex);
+  sched_lane &L = LANES[lane];
+  L.running--;
+  L.completed++;
+  int num = L.connRunning.value(connID,1) - 1;
+  if(num>0){ L.connRunning.insert(connID, num); }
+  else{ L.connRunning.remove(connID); }
+  startNext(lane);
+}
+
+// === PRIVATE ===
+int RequestScheduler::queuedCount(){
+  return LANES[FAST_LANE].queue.length() + LANES[BLOCKING_LANE].queue.length();
+}
+
+void RequestScheduler::startNext(LANE lane){
+  sched_lane &L = LANES[lane];
+  while(L.running < L.pool->maxThreadCount() && !L.queue.isEmpty()){
+    //Find the oldest request whose connection is still under the limit
+    int index = -1;
+    for(int i=0; i<L.queue.length() && index<0; i++){
+      if(L.connRunning.value(L.queue[i].conn,0) < maxPerConn){ index = i; }
+    }
+    if(index<0){ break; } //everything waiting is from connections which are already at the limit
+    sched_job J = L.queue.takeAt(index);
+    L.running++;
+    L.connRunning.insert(J.conn, L.connRunning.value(J.conn,0)+1);
+    L.pool->start(new SchedulerRunnable(this, lane, J.conn, J.func, J.queued));
+  }
+}
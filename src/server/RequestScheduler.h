@@ -0,0 +1,67 @@
+// ===============================
+//  PC-BSD REST API Server
+// Available under the 3-clause BSD License
+// Written by: Ken Moore <ken@pcbsd.org> 2015-2016
+// =================================
+//  Scheduler for the evaluation of client requests
+//  - Two lanes (thread pools): quick requests and requests which run external utilities
+//  - A connection can only have a limited number of requests running in each lane
+//  - Queued requests are limited - anything over the limit gets rejected (503 reply)
+// =================================
+#ifndef _PCBSD_SYSADM_SERVER_REQUEST_SCHEDULER_H
+#define _PCBSD_SYSADM_SERVER_REQUEST_SCHEDULER_H
+
+#include "globals-qt.h"
+
+#include <QMutex>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include <functional>
+
+class RequestScheduler{
+public:
+	enum LANE{ FAST_LANE = 0, BLOCKING_LANE = 1 };
+
+	RequestScheduler();
+	~RequestScheduler();
+
+	//Change the limits (called on startup with the config file values)
+	void setLimits(int fastThreads, int blockingThreads, int maxQueued, int maxPerConnection);
+
+	//Queue up a request for the given connection ID ("<connection>/<bridge client ID>" for clients relayed through a bridge)
+	// Returns false if the queue is full (request needs to be refused)
+	bool queueRequest(QString connID, LANE lane, std::function<void()> job);
+	//Remove any queued requests for a connection which is closing
+	void dropConnection(QString connID);
+
+	//Current queue/lane information
+	QJsonObject stats();
+
+	//Internal - called from the pool threads when a request is finished
+	void requestFinished(LANE lane, QString connID);
+
+private:
+	struct sched_job{
+	  QString conn;
+	  std::function<void()> func;
+	  qint64 queued; //msecs since epoch
+	};
+	struct sched_lane{
+	  QList<sched_job> queue;
+	  QHash<QString, int> connRunning; //connection ID -> number running
+	  QThreadPool *pool;
+	  int running;
+	  qint64 completed;
+	};
+
+	QMutex mutex;
+	sched_lane LANES[2];
+	int maxQueued, maxPerConn;
+	qint64 rejected;
+
+	int queuedCount(); //mutex must be locked
+	void startNext(LANE lane); //mutex must be locked
+};
+
+#endif
@@ -115,6 +115,8 @@ QString RestOutputStruct::assembleMessage(){
         firstline.append(" 403 Forbidden"); break;
       case NOTFOUND:
         firstline.append(" 404 Not Found"); break;
+      case SERVICEUNAVAILABLE:
+        firstline.append(" 503 Service Unavailable"); break;
     }
     headers << firstline;
     headers << "Server: SysAdm/1.0";
@@ -169,6 +171,9 @@ QString RestOutputStruct::assembleMessage(){
       case NOTFOUND:
 	oname = onamesp = "error";
 	out_err.insert("code","404"); out_err.insert("message", "Not Found"); break;
+      case SERVICEUNAVAILABLE:
+	oname = onamesp = "error";
+	out_err.insert("code","503"); out_err.insert("message", "Service Unavailable"); break;
       default:
 	break;
       }
@@ -185,3 +190,74 @@ QString RestOutputStruct::assembleMessage(){
     return doc.toJson(QJsonDocument::Compact);
   }
 }
+
+// === INPUT FRAMER ===
+RestInputFramer::RestInputFramer(int maxbytes){
+  maxsize = maxbytes;
+  clear();
+}
+
+RestInputFramer::~RestInputFramer(){}
+
+void RestInputFramer::append(const QByteArray &data){
+  buffer.append(data);
+  scan();
+  // If the current message is larger than the limit and still not complete
+  // somebody is screwing with us, lets clear the buffer
+  if(buffer.size() > maxsize){
+    buffer.clear();
+    scanpos = depth = 0;
+    instring = escaped = false;
+  }
+}
+
+bool RestInputFramer::hasMessage(){
+  return !ready.isEmpty();
+}
+
+QByteArray RestInputFramer::takeMessage(){
+  if(ready.isEmpty()){ return QByteArray(); }
+  return ready.dequeue();
+}
+
+void RestInputFramer::clear(){
+  buffer.clear();
+  ready.clear();
+  scanpos = depth = 0;
+  instring = escaped = false;
+}
+
+void RestInputFramer::scan(){
+  //Only the outer JSON object braces matter - anything before the first "{" is REST headers
+  // Note: UTF-8 multi-byte sequences never contain ASCII bytes, so this is safe on the raw data
+  int consumed = 0; //start of the message being scanned (everything before it is already framed)
+  const char *data = buffer.constData();
+  for( ; scanpos<buffer.size(); scanpos++){
+    char ch = data[scanpos];
+    if(depth==0){
+      if(ch=='{'){ depth = 1; instring = escaped = false; }
+      continue;
+    }
+    if(instring){
+      if(escaped){ escaped = false; }
+      else if(ch=='\\'){ escaped = true; }
+      else if(ch=='"'){ instring = false; }
+      continue;
+    }
+    if(ch=='"'){ instring = true; }
+    else if(ch=='{'){ depth++; }
+    else if(ch=='}'){
+      depth--;
+      if(depth==0){
+        //Full message found
+        ready.enqueue( buffer.mid(consumed, scanpos+1-consumed).trimmed() );
+        consumed = scanpos+1;
+      }
+    }
+  }
+  //Drop the framed messages from the front of the buffer (only once per scan - not once per message)
+  if(consumed>0){
+    buffer.remove(0, consumed);
+    scanpos -= consumed;
+  }
+}
@@ -42,7 +42,7 @@ public:
 
 class RestOutputStruct{
 public:
-	enum ExitCode{OK, CREATED, ACCEPTED, NOCONTENT, RESETCONTENT, PARTIALCONTENT, PROCESSING, BADREQUEST, UNAUTHORIZED, FORBIDDEN, NOTFOUND };
+	enum ExitCode{OK, CREATED, ACCEPTED, NOCONTENT, RESETCONTENT, PARTIALCONTENT, PROCESSING, BADREQUEST, UNAUTHORIZED, FORBIDDEN, NOTFOUND, SERVICEUNAVAILABLE };
 	RestInputStruct in_struct;
 	ExitCode CODE;
 	QStringList Header; //REST output header lines
@@ -56,4 +56,27 @@ public:
 	QString assembleMessage(); //normal operation - no special processing needed
 };
 
+//Incremental framer for the raw TCP/REST input stream
+// - Messages may arrive fragmented across reads or pipelined several per read
+// - Keeps the scanning state between reads so each byte is only looked at once
+class RestInputFramer{
+public:
+	RestInputFramer(int maxbytes = 128000);
+	~RestInputFramer();
+
+	void append(const QByteArray &data); //add new raw data from the socket
+	bool hasMessage(); //a complete message is waiting
+	QByteArray takeMessage(); //next complete message (REST headers + JSON body)
+	void clear();
+
+private:
+	QByteArray buffer; //unframed data
+	QQueue<QByteArray> ready; //complete messages (in order)
+	int maxsize; //maximum size of a single unfinished message
+	int scanpos, depth;
+	bool instring, escaped;
+
+	void scan();
+};
+
 #endif
@@ -8,6 +8,9 @@
 // =================================
 #include <WebSocket.h>
 
+#include <QReadWriteLock>
+#include <QAtomicInteger>
+
 //sysadm library interface classes
 #include "library/sysadm-beadm.h"
 #include "library/sysadm-general.h"
@@ -26,92 +29,305 @@
 #include "library/sysadm-moused.h"
 #include "library/sysadm-powerd.h"
 #include "library/sysadm-sourcectl.h"
+#include "library/sysadm-metrics.h"
+#include "library/sysadm-executor.h"
 
 #define DEBUG 0
 //#define SCLISTDELIM QString("::::") //SysCache List Delimiter
-RestOutputStruct::ExitCode WebSocket::AvailableSubsystems(bool allaccess, QJsonObject *out){
+
+// === AVAILABLE SUBSYSTEMS ===
+//The probe results are shared by all connections and re-checked on a timer (not per-request)
+#define SUBSYS_RW 0 //"read/write" for everybody
+#define SUBSYS_LIMITED_READ 1 //"read" only for sessions without full access
+#define SUBSYS_REPROBE_SECS 300 //re-check the installed utilities every 5 minutes
+static QHash<QString, int> SUBSYSTEMS; //"namespace/name" -> access flag
+static QReadWriteLock subsysLock;
+static QAtomicInteger<qint64> subsysNextProbe(0); //msecs since epoch
+
+void WebSocket::ProbeSubsystems(){
   //Probe the various subsystems to see what is available through this server
-  //Output format:
-  /*<out>{
-	<namespace1/name1> : <read/write/other>,
-	<namespace2/name2> : <read/write/other>,
-      }
-  */
+  QHash<QString, int> avail;
+  //When replaying command fixtures, treat every utility as installed
+  bool replay = (sysadm::CommandExecutor::currentName()=="replay");
+  auto utilityExists = [replay](QString path){ return (replay || QFile::exists(path)); };
   // - server settings (always available)
-  out->insert("rpc/settings","read/write");
-  out->insert("rpc/logs", allaccess ? "read/write" : "read");
-
+  avail.insert("rpc/settings", SUBSYS_RW);
+  avail.insert("rpc/logs", SUBSYS_LIMITED_READ);
+  // - server latency metrics (always available)
+  avail.insert("rpc/metrics", SUBSYS_RW);
   // - beadm
-  if(QFile::exists("/usr/local/sbin/beadm")){
-    out->insert("sysadm/beadm", "read/write");
-  }
-
+  if(utilityExists("/usr/local/sbin/beadm")){ avail.insert("sysadm/beadm", SUBSYS_RW); }
   // - dispatcher (Internal to server - always available)
   //"read" is the event notifications, "write" is the ability to queue up jobs
-  out->insert("rpc/dispatcher", allaccess ? "read/write" : "read");
-
+  avail.insert("rpc/dispatcher", SUBSYS_LIMITED_READ);
   // - filesystem
-  out->insert("sysadm/fs","read/write");
-
+  avail.insert("sysadm/fs", SUBSYS_RW);
   // - network
-  out->insert("sysadm/network","read/write");
-
+  avail.insert("sysadm/network", SUBSYS_RW);
   // - lifepreserver
-  if(QFile::exists("/usr/local/bin/lpreserver")){
-    out->insert("sysadm/lifepreserver", "read/write");
-  }
-
+  if(utilityExists("/usr/local/bin/lpreserver")){ avail.insert("sysadm/lifepreserver", SUBSYS_RW); }
   // - iocage
-  if(QFile::exists("/usr/local/bin/iocage")){
-    out->insert("sysadm/iocage", "read/write");
-  }
-
+  if(utilityExists("/usr/local/bin/iocage")){ avail.insert("sysadm/iocage", SUBSYS_RW); }
   // - iohyve
-  if(QFile::exists("/usr/local/sbin/iohyve")){
-    out->insert("sysadm/iohyve", "read/write");
-  }
-
+  if(utilityExists("/usr/local/sbin/iohyve")){ avail.insert("sysadm/iohyve", SUBSYS_RW); }
   // - zfs
-  if(QFile::exists("/sbin/zfs") && QFile::exists("/sbin/zpool")){
-    out->insert("sysadm/zfs", allaccess ? "read/write" : "read");
-  }
-
+  if(utilityExists("/sbin/zfs") && utilityExists("/sbin/zpool")){ avail.insert("sysadm/zfs", SUBSYS_LIMITED_READ); }
   // - pkg
-  if(QFile::exists("/usr/local/sbin/pkg")){
-    out->insert("sysadm/pkg", "read/write");
-  }
-
+  if(utilityExists("/usr/local/sbin/pkg")){ avail.insert("sysadm/pkg", SUBSYS_RW); }
   // - Generic system information
-  out->insert("sysadm/systemmanager","read/write");
-
+  avail.insert("sysadm/systemmanager", SUBSYS_RW);
   // - PC-BSD/TrueOS Updater
-  if(QFile::exists("/usr/local/bin/pc-updatemanager")){
-    out->insert("sysadm/update", "read/write");
-  }
-
+  if(utilityExists("/usr/local/bin/pc-updatemanager")){ avail.insert("sysadm/update", SUBSYS_RW); }
   // - User Manager
-  out->insert("sysadm/users","read/write");
+  avail.insert("sysadm/users", SUBSYS_RW);
   //- Service Manager
-  out->insert("sysadm/services","read/write");
+  avail.insert("sysadm/services", SUBSYS_RW);
   // - Firewall Manager
-  out->insert("sysadm/firewall","read/write");
-
+  avail.insert("sysadm/firewall", SUBSYS_RW);
   // - moused
-  if(QFile::exists("/usr/sbin/moused")){
-    out->insert("sysadm/moused", "read/write");
-  }
+  if(utilityExists("/usr/sbin/moused")){ avail.insert("sysadm/moused", SUBSYS_RW); }
   // - powerd
-  if(QFile::exists("/usr/sbin/powerd")){
-    out->insert("sysadm/powerd", "read/write");
-  }
+  if(utilityExists("/usr/sbin/powerd")){ avail.insert("sysadm/powerd", SUBSYS_RW); }
   // - sourcectl
-  if(QFile::exists("/usr/local/bin/git")){
-    out->insert("sysadm/sourcectl", "read/write");
-  }
+  if(utilityExists("/usr/local/bin/git")){ avail.insert("sysadm/sourcectl", SUBSYS_RW); }
+
+  //Now swap the new list into place
+  QWriteLocker lock(&subsysLock);
+  SUBSYSTEMS = avail;
+  subsysNextProbe.storeRelease( QDateTime::currentMSecsSinceEpoch() + SUBSYS_REPROBE_SECS*1000 );
+}
 
+static void checkSubsystemProbe(){
+  //Re-run the probe if the cached list is too old
+  qint64 next = subsysNextProbe.loadAcquire();
+  if(next > QDateTime::currentMSecsSinceEpoch()){ return; }
+  //Only let one thread do the probe - everybody else uses the current list
+  if(subsysNextProbe.testAndSetOrdered(next, next + SUBSYS_REPROBE_SECS*1000)){ WebSocket::ProbeSubsystems(); }
+}
+
+RestOutputStruct::ExitCode WebSocket::AvailableSubsystems(bool allaccess, QJsonObject *out){
+  //Output format:
+  /*<out>{
+	<namespace1/name1> : <read/write/other>,
+	<namespace2/name2> : <read/write/other>,
+      }
+  */
+  checkSubsystemProbe();
+  QReadLocker lock(&subsysLock);
+  for(QHash<QString, int>::const_iterator it = SUBSYSTEMS.constBegin(); it!=SUBSYSTEMS.constEnd(); ++it){
+    out->insert(it.key(), (allaccess || it.value()==SUBSYS_RW) ? "read/write" : "read");
+  }
   return RestOutputStruct::OK;
 }
 
+bool WebSocket::SubsystemAvailable(QString nsname){
+  checkSubsystemProbe();
+  QReadLocker lock(&subsysLock);
+  return SUBSYSTEMS.contains(nsname);
+}
+
+// === BACKEND REQUEST HANDLERS ===
+//Simple library calls: the result is returned under the action name
+// (needresult: an empty result means the inputs were invalid)
+template<typename T>
+static backend_handler simpleAction(QString act, T (*fn)(), int flags, bool needresult = false){
+  backend_handler H;
+  H.flags = flags;
+  H.func = [act, fn, needresult](WebSocket*, const RestInputStruct&, QJsonObject *out) -> RestOutputStruct::ExitCode{
+    T res = fn();
+    if(needresult && res.isEmpty()){ return RestOutputStruct::BADREQUEST; }
+    out->insert(act, res);
+    return RestOutputStruct::OK;
+  };
+  return H;
+}
+
+template<typename T>
+static backend_handler simpleAction(QString act, T (*fn)(QJsonObject), int flags, bool needresult = false){
+  backend_handler H;
+  H.flags = flags;
+  H.func = [act, fn, needresult](WebSocket*, const RestInputStruct &IN, QJsonObject *out) -> RestOutputStruct::ExitCode{
+    T res = fn(IN.args.toObject());
+    if(needresult && res.isEmpty()){ return RestOutputStruct::BADREQUEST; }
+    out->insert(act, res);
+    return RestOutputStruct::OK;
+  };
+  return H;
+}
+
+QHash<QString, backend_handler> WebSocket::RegisterBackendHandlers(){
+  //Keys: "namespace/name/action" for individual actions, "namespace/name" for subsystems which parse the action themselves
+  // NOTE: all keys are lowercase
+  QHash<QString, backend_handler> H;
+  const int FAST = backend_handler::FAST;
+  const int BLOCKING = backend_handler::BLOCKING;
+  backend_handler tmp;
+
+  // - server settings/logs/dispatcher
+  tmp.flags = FAST;
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmSettingsRequest(IN.args, out); };
+  H.insert("rpc/settings", tmp);
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmLogsRequest(IN.fullaccess, IN.args, out); };
+  H.insert("rpc/logs", tmp);
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateDispatcherRequest(IN.fullaccess, IN.args, out); };
+  H.insert("rpc/dispatcher", tmp);
+  tmp.flags = FAST | backend_handler::FULLACCESS;
+  H.insert("rpc/dispatcher/run", tmp);
+  H.insert("rpc/dispatcher/kill", tmp);
+  tmp.flags = FAST;
+  tmp.func = [](WebSocket*, const RestInputStruct&, QJsonObject *out){
+    out->insert("read", sysadm::Metrics::summary());
+    return RestOutputStruct::OK;
+  };
+  H.insert("rpc/metrics/read", tmp);
+
+  // - beadm
+  H.insert("sysadm/beadm/listbes", simpleAction("listbes", &sysadm::BEADM::listBEs, BLOCKING) );
+  H.insert("sysadm/beadm/renamebe", simpleAction("renamebe", &sysadm::BEADM::renameBE, BLOCKING) );
+  H.insert("sysadm/beadm/activatebe", simpleAction("activatebe", &sysadm::BEADM::activateBE, BLOCKING) );
+  H.insert("sysadm/beadm/createbe", simpleAction("createbe", &sysadm::BEADM::createBE, BLOCKING) );
+  H.insert("sysadm/beadm/destroybe", simpleAction("destroybe", &sysadm::BEADM::destroyBE, BLOCKING) );
+  H.insert("sysadm/beadm/mountbe", simpleAction("mountbe", &sysadm::BEADM::mountBE, BLOCKING) );
+  H.insert("sysadm/beadm/umountbe", simpleAction("umountbe", &sysadm::BEADM::umountBE, BLOCKING) );
+
+  // - filesystem
+  tmp.flags = FAST;
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmFSRequest(IN.args, out); };
+  H.insert("sysadm/fs", tmp);
+
+  // - network
+  tmp.flags = BLOCKING;
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmNetworkRequest(IN.args, out); };
+  H.insert("sysadm/network", tmp);
+
+  // - lifepreserver
+  H.insert("sysadm/lifepreserver/addreplication", simpleAction("addreplication", &sysadm::LifePreserver::addReplication, BLOCKING) );
+  H.insert("sysadm/lifepreserver/createsnap", simpleAction("createsnap", &sysadm::LifePreserver::createSnapshot, BLOCKING) );
+  H.insert("sysadm/lifepreserver/cronscrub", simpleAction("cronscrub", &sysadm::LifePreserver::scheduleScrub, BLOCKING) );
+  H.insert("sysadm/lifepreserver/cronsnap", simpleAction("cronsnap", &sysadm::LifePreserver::scheduleSnapshot, BLOCKING) );
+  H.insert("sysadm/lifepreserver/initreplication", simpleAction("initreplication", &sysadm::LifePreserver::initReplication, BLOCKING) );
+  H.insert("sysadm/lifepreserver/listcron", simpleAction("listcron", &sysadm::LifePreserver::listCron, BLOCKING) );
+  H.insert("sysadm/lifepreserver/listreplication", simpleAction("listreplication", &sysadm::LifePreserver::listReplication, BLOCKING) );
+  H.insert("sysadm/lifepreserver/listsnap", simpleAction("listsnap", &sysadm::LifePreserver::listSnap, BLOCKING) );
+  H.insert("sysadm/lifepreserver/removereplication", simpleAction("removereplication", &sysadm::LifePreserver::removeReplication, BLOCKING) );
+  H.insert("sysadm/lifepreserver/removesnap", simpleAction("removesnap", &sysadm::LifePreserver::removeSnapshot, BLOCKING) );
+  H.insert("sysadm/lifepreserver/revertsnap", simpleAction("revertsnap", &sysadm::LifePreserver::revertSnapshot, BLOCKING) );
+  H.insert("sysadm/lifepreserver/runreplication", simpleAction("runreplication", &sysadm::LifePreserver::runReplication, BLOCKING) );
+  H.insert("sysadm/lifepreserver/savesettings", simpleAction("savesettings", &sysadm::LifePreserver::saveSettings, BLOCKING) );
+  H.insert("sysadm/lifepreserver/settings", simpleAction("settings", &sysadm::LifePreserver::settings, BLOCKING) );
+
+  // - systemmanager
+  H.insert("sysadm/systemmanager/batteryinfo", simpleAction("batteryinfo", &sysadm::SysMgmt::batteryInfo, BLOCKING) );
+  H.insert("sysadm/systemmanager/cpupercentage", simpleAction("cpupercentage", &sysadm::SysMgmt::cpuPercentage, FAST) );
+  H.insert("sysadm/systemmanager/cputemps", simpleAction("cputemps", &sysadm::SysMgmt::cpuTemps, BLOCKING) );
+  H.insert("sysadm/systemmanager/externalmounts", simpleAction("externalmounts", &sysadm::SysMgmt::externalDevicePaths, BLOCKING) );
+  H.insert("sysadm/systemmanager/halt", simpleAction("halt", &sysadm::SysMgmt::systemHalt, BLOCKING) );
+  H.insert("sysadm/systemmanager/killproc", simpleAction("killproc", &sysadm::SysMgmt::killProc, BLOCKING) );
+  H.insert("sysadm/systemmanager/memorystats", simpleAction("memorystats", &sysadm::SysMgmt::memoryStats, FAST) );
+  H.insert("sysadm/systemmanager/procinfo", simpleAction("procinfo", &sysadm::SysMgmt::procInfo, BLOCKING) );
+  H.insert("sysadm/systemmanager/reboot", simpleAction("reboot", &sysadm::SysMgmt::systemReboot, BLOCKING) );
+  H.insert("sysadm/systemmanager/getsysctl", simpleAction("getsysctl", &sysadm::SysMgmt::getSysctl, BLOCKING) );
+  H.insert("sysadm/systemmanager/setsysctl", simpleAction("setsysctl", &sysadm::SysMgmt::setSysctl, BLOCKING) );
+  H.insert("sysadm/systemmanager/sysctllist", simpleAction("sysctllist", &sysadm::SysMgmt::sysctlList, BLOCKING) );
+  H.insert("sysadm/systemmanager/systeminfo", simpleAction("systeminfo", &sysadm::SysMgmt::systemInfo, FAST) );
+  H.insert("sysadm/systemmanager/deviceinfo", simpleAction("deviceinfo", &sysadm::SysMgmt::systemDevices, BLOCKING) );
+
+  // - update
+  tmp.flags = BLOCKING;
+  tmp.func = [](WebSocket*, const RestInputStruct &IN, QJsonObject *out){
+    bool fastcheck = IN.args.toObject().value("force").toString().toLower()!="true";
+    out->insert("checkupdates", sysadm::Update::checkUpdates(fastcheck));
+    return RestOutputStruct::OK;
+  };
+  H.insert("sysadm/update/checkupdates", tmp);
+  H.insert("sysadm/update/listbranches", simpleAction("listbranches", &sysadm::Update::listBranches, BLOCKING) );
+  H.insert("sysadm/update/startupdate", simpleAction("startupdate", &sysadm::Update::startUpdate, BLOCKING) );
+  H.insert("sysadm/update/stopupdate", simpleAction("stopupdate", &sysadm::Update::stopUpdate, BLOCKING) );
+  H.insert("sysadm/update/applyupdate", simpleAction("applyupdate", &sysadm::Update::applyUpdates, BLOCKING) );
+  H.insert("sysadm/update/listsettings", simpleAction("listsettings", &sysadm::Update::readSettings, BLOCKING) );
+  H.insert("sysadm/update/changesettings", simpleAction("changesettings", &sysadm::Update::writeSettings, BLOCKING) );
+  H.insert("sysadm/update/listlogs", simpleAction("listlogs", &sysadm::Update::listLogs, BLOCKING) );
+  tmp.func = [](WebSocket*, const RestInputStruct &IN, QJsonObject *out) -> RestOutputStruct::ExitCode{
+    if(!IN.args.toObject().contains("logs")){ return RestOutputStruct::BADREQUEST; }
+    out->insert("readlogs", sysadm::Update::readLog(IN.args.toObject()) );
+    return RestOutputStruct::OK;
+  };
+  H.insert("sysadm/update/readlogs", tmp);
+
+  // - iocage (empty result = invalid inputs)
+  H.insert("sysadm/iocage/activatepool", simpleAction("activatepool", &sysadm::Iocage::activatePool, BLOCKING, true) );
+  H.insert("sysadm/iocage/deactivatepool", simpleAction("deactivatepool", &sysadm::Iocage::deactivatePool, BLOCKING, true) );
+  H.insert("sysadm/iocage/activatestatus", simpleAction("activatestatus", &sysadm::Iocage::activateStatus, BLOCKING, true) );
+  H.insert("sysadm/iocage/listjails", simpleAction("listjails", &sysadm::Iocage::listJails, BLOCKING, true) );
+  H.insert("sysadm/iocage/listtemplates", simpleAction("listtemplates", &sysadm::Iocage::listTemplates, BLOCKING, true) );
+  H.insert("sysadm/iocage/cleantemplates", simpleAction("cleantemplates", &sysadm::Iocage::cleanTemplates, BLOCKING, true) );
+  H.insert("sysadm/iocage/listreleases", simpleAction("listreleases", &sysadm::Iocage::listReleases, BLOCKING, true) );
+  H.insert("sysadm/iocage/fetchreleases", simpleAction("fetchreleases", &sysadm::Iocage::fetchReleases, BLOCKING, true) );
+  H.insert("sysadm/iocage/cleanreleases", simpleAction("cleanreleases", &sysadm::Iocage::cleanReleases, BLOCKING, true) );
+  H.insert("sysadm/iocage/listplugins", simpleAction("listplugins", &sysadm::Iocage::listPlugins, BLOCKING, true) );
+  H.insert("sysadm/iocage/createplugin", simpleAction("createplugin", &sysadm::Iocage::fetchPlugin, BLOCKING, true) );
+
+  // - iohyve
+  H.insert("sysadm/iohyve/adddisk", simpleAction("adddisk", &sysadm::Iohyve::addDisk, BLOCKING) );
+  H.insert("sysadm/iohyve/create", simpleAction("create", &sysadm::Iohyve::createGuest, BLOCKING) );
+  H.insert("sysadm/iohyve/delete", simpleAction("delete", &sysadm::Iohyve::deleteGuest, BLOCKING) );
+  H.insert("sysadm/iohyve/deletedisk", simpleAction("deletedisk", &sysadm::Iohyve::deleteDisk, BLOCKING) );
+  H.insert("sysadm/iohyve/listdisks", simpleAction("listdisks", &sysadm::Iohyve::listDisks, BLOCKING) );
+  H.insert("sysadm/iohyve/listvms", simpleAction("listvms", &sysadm::Iohyve::listVMs, BLOCKING) );
+  H.insert("sysadm/iohyve/listisos", simpleAction("listisos", &sysadm::Iohyve::listISOs, BLOCKING) );
+  H.insert("sysadm/iohyve/fetchiso", simpleAction("fetchiso", &sysadm::Iohyve::fetchISO, BLOCKING) );
+  H.insert("sysadm/iohyve/install", simpleAction("install", &sysadm::Iohyve::installGuest, BLOCKING) );
+  H.insert("sysadm/iohyve/issetup", simpleAction("issetup", &sysadm::Iohyve::isSetup, BLOCKING) );
+  H.insert("sysadm/iohyve/renameiso", simpleAction("renameiso", &sysadm::Iohyve::renameISO, BLOCKING) );
+  H.insert("sysadm/iohyve/rmiso", simpleAction("rmiso", &sysadm::Iohyve::rmISO, BLOCKING) );
+  H.insert("sysadm/iohyve/resizedisk", simpleAction("resizedisk", &sysadm::Iohyve::resizeDisk, BLOCKING) );
+  H.insert("sysadm/iohyve/setup", simpleAction("setup", &sysadm::Iohyve::setupIohyve, BLOCKING) );
+  H.insert("sysadm/iohyve/start", simpleAction("start", &sysadm::Iohyve::startGuest, BLOCKING) );
+  H.insert("sysadm/iohyve/stop", simpleAction("stop", &sysadm::Iohyve::stopGuest, BLOCKING) );
+  H.insert("sysadm/iohyve/version", simpleAction("version", &sysadm::Iohyve::version, BLOCKING) );
+
+  // - subsystems which still parse their own actions
+  tmp.flags = BLOCKING;
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmZfsRequest(IN.args, out); };
+  H.insert("sysadm/zfs", tmp);
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmPkgRequest(IN.args, out); };
+  H.insert("sysadm/pkg", tmp);
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmUserRequest(IN.fullaccess, ws->AUTHSYSTEM->userForToken(ws->SockAuthToken), IN.args, out); };
+  H.insert("sysadm/users", tmp);
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmServiceRequest(IN.args, out); };
+  H.insert("sysadm/services", tmp);
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmFirewallRequest(IN.args, out); };
+  H.insert("sysadm/firewall", tmp);
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmMousedRequest(IN.args, out); };
+  H.insert("sysadm/moused", tmp);
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmPowerdRequest(IN.args, out); };
+  H.insert("sysadm/powerd", tmp);
+  tmp.func = [](WebSocket *ws, const RestInputStruct &IN, QJsonObject *out){ return ws->EvaluateSysadmSourceCTLRequest(IN.args, out); };
+  H.insert("sysadm/sourcectl", tmp);
+
+  for(QHash<QString, backend_handler>::iterator it = H.begin(); it!=H.end(); ++it){ it.value().key = it.key(); }
+  return H;
+}
+
+const backend_handler* WebSocket::BackendHandler(QString namesp, QString name, QString action){
+  //Inputs must already be lowercase
+  static const QHash<QString, backend_handler> HANDLERS = RegisterBackendHandlers(); //only built once
+  QString key = namesp+"/"+name;
+  QHash<QString, backend_handler>::const_iterator it;
+  if(!action.isEmpty()){
+    it = HANDLERS.constFind(key+"/"+action);
+    if(it!=HANDLERS.constEnd()){ return &(it.value()); }
+  }
+  it = HANDLERS.constFind(key);
+  if(it!=HANDLERS.constEnd()){ return &(it.value()); }
+  return 0;
+}
+
+QString WebSocket::BackendAction(const QJsonValue &args){
+  if(!args.isObject()){ return ""; }
+  return args.toObject().value("action").toString().toLower();
+}
+
 RestOutputStruct::ExitCode WebSocket::EvaluateBackendRequest(const RestInputStruct &IN, QJsonObject *out){
   /*Inputs:
 	"namesp" - namespace for the request
@@ -125,55 +341,25 @@ RestOutputStruct::ExitCode WebSocket::EvaluateBackendRequest(const RestInputStru
   //Get/Verify subsystems
   if(namesp=="rpc" && name=="query"){
     return AvailableSubsystems(IN.fullaccess, out);
-  }else{
-    QJsonObject avail;
-    AvailableSubsystems(IN.fullaccess, &avail);
-    if(!avail.contains(namesp+"/"+name)){ return RestOutputStruct::NOTFOUND; }
+  }else if(!SubsystemAvailable(namesp+"/"+name)){
+    return RestOutputStruct::NOTFOUND;
   }
   //qDebug() << "Evaluate Backend Request:" << namesp << name;
-  //Go through and forward this request to the appropriate sub-system
-  if(namesp=="rpc" && name=="settings"){
-    return EvaluateSysadmSettingsRequest(IN.args, out);
-  }else if(namesp=="rpc" && name=="logs"){
-    return EvaluateSysadmLogsRequest(IN.fullaccess, IN.args, out);
-  }else if(namesp=="rpc" && name=="dispatcher"){
-    return EvaluateDispatcherRequest(IN.fullaccess, IN.args, out);
-  }else if(namesp=="sysadm" && name=="beadm"){
-    return EvaluateSysadmBEADMRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="fs"){
-    return EvaluateSysadmFSRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="iocage"){
-    return EvaluateSysadmIocageRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="iohyve"){
-    return EvaluateSysadmIohyveRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="lifepreserver"){
-    return EvaluateSysadmLifePreserverRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="network"){
-    return EvaluateSysadmNetworkRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="systemmanager"){
-    return EvaluateSysadmSystemMgmtRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="update"){
-    return EvaluateSysadmUpdateRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="zfs"){
-    return EvaluateSysadmZfsRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="pkg"){
-    return EvaluateSysadmPkgRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="users"){
-    return EvaluateSysadmUserRequest(IN.fullaccess, AUTHSYSTEM->userForToken(SockAuthToken), IN.args, out);
-  }else if(namesp=="sysadm" && name=="services"){
-    return EvaluateSysadmServiceRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="firewall"){
-    return EvaluateSysadmFirewallRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="moused"){
-    return EvaluateSysadmMousedRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="powerd"){
-    return EvaluateSysadmPowerdRequest(IN.args, out);
-  }else if(namesp=="sysadm" && name=="sourcectl"){
-    return EvaluateSysadmSourceCTLRequest(IN.args, out);
-  }else{
+  //Now forward this request to the appropriate handler
+  QString action = BackendAction(IN.args);
+  const backend_handler *handler = BackendHandler(namesp, name, action);
+  if(handler==0){
+    sysadm::Metrics::record("backend", "unknown", 0);
     return RestOutputStruct::BADREQUEST;
   }
-
+  if( (handler->flags & backend_handler::FULLACCESS) && !IN.fullaccess ){ return RestOutputStruct::FORBIDDEN; }
+  QElapsedTimer timer; timer.start();
+  RestOutputStruct::ExitCode ret = handler->func(this, IN, out);
+  qint64 usecs = timer.nsecsElapsed()/1000;
+  sysadm::Metrics::record("stage", "backend", usecs);
+  //Only registered names (never the raw client input) - every name gets a histogram which is kept forever
+  sysadm::Metrics::record("backend", handler->key, usecs);
+  return ret;
 }
 
 // === SYSADM SSL SETTINGS ===
@@ -328,6 +514,18 @@ RestOutputStruct::ExitCode WebSocket::EvaluateDispatcherRequest(bool allaccess,
   }else if(act=="list"){
     QJsonObject info = DISPATCHER->listJobs();
     out->insert("jobs", info);
+  }else if(act=="list_queues"){
+    //Dispatcher queue settings and job counts
+    out->insert("queues", DISPATCHER->listQueues());
+  }else if(act=="request_queue"){
+    //Current state of the request scheduler (queue depth/running per lane)
+    out->insert("request_queue", SCHEDULER->stats());
+  }else if(act=="read_output" && in_args.toObject().contains("job_id") ){
+    //Output of a job from a byte offset (running jobs, or one of the last few finished ones)
+    QJsonObject args = in_args.toObject();
+    QJsonObject info = DISPATCHER->readOutput(args.value("job_id").toString(), args.value("offset").toVariant().toLongLong(), args.value("length").toInt());
+    if(info.isEmpty()){ return RestOutputStruct::NOTFOUND; }
+    out->insert("read_output", info);
   }else if(act=="kill" && in_args.toObject().contains("job_id") ){
     if(!allaccess){ return RestOutputStruct::FORBIDDEN; } //this user does not have permission to modify jobs
     QStringList ids;
@@ -344,47 +542,6 @@ RestOutputStruct::ExitCode WebSocket::EvaluateDispatcherRequest(bool allaccess,
   return RestOutputStruct::OK;
 }
 
-//==== SYSADM -- BEADM ====
-RestOutputStruct::ExitCode WebSocket::EvaluateSysadmBEADMRequest(const QJsonValue in_args, QJsonObject *out){
-  if(in_args.isObject()){
-    QStringList keys = in_args.toObject().keys();
-    bool ok = false;
-    if(keys.contains("action")){
-      QString act = JsonValueToString(in_args.toObject().value("action")).toLower();
-      if(act=="listbes"){
-	ok = true;
-        out->insert("listbes", sysadm::BEADM::listBEs());
-      }else if(act=="renamebe"){
-	ok = true;
-        out->insert("renamebe", sysadm::BEADM::renameBE(in_args.toObject()));
-      }else if(act=="activatebe"){
-	ok = true;
-        out->insert("activatebe", sysadm::BEADM::activateBE(in_args.toObject()));
-      }else if(act=="createbe"){
-	ok = true;
-        out->insert("createbe", sysadm::BEADM::createBE(in_args.toObject()));
-      }else if(act=="destroybe"){
-	ok = true;
-        out->insert("destroybe", sysadm::BEADM::destroyBE(in_args.toObject()));
-      }else if(act=="mountbe"){
-	ok = true;
-        out->insert("mountbe", sysadm::BEADM::mountBE(in_args.toObject()));
-     }else if(act=="umountbe"){
-	ok = true;
-        out->insert("umountbe", sysadm::BEADM::umountBE(in_args.toObject()));
-      }
-    } //end of "action" key usage
-
-    //If nothing done - return the proper code
-    if(!ok){
-      return RestOutputStruct::BADREQUEST;
-    }
-  }else{  // if(in_args.isArray()){
-    return RestOutputStruct::BADREQUEST;
-  }
-  return RestOutputStruct::OK;
-}
-
 //==== SYSADM -- FS ====
 RestOutputStruct::ExitCode WebSocket::EvaluateSysadmFSRequest(const QJsonValue in_args, QJsonObject *out){
   if(in_args.isObject()){
@@ -473,389 +630,6 @@ RestOutputStruct::ExitCode WebSocket::EvaluateSysadmNetworkRequest(const QJsonVa
   return RestOutputStruct::OK;
 }
 
-//==== SYSADM -- LifePreserver ====
-RestOutputStruct::ExitCode WebSocket::EvaluateSysadmLifePreserverRequest(const QJsonValue in_args, QJsonObject *out){
-  if(in_args.isObject()){
-    QStringList keys = in_args.toObject().keys();
-    bool ok = false;
-    if(keys.contains("action")){
-      QString act = JsonValueToString(in_args.toObject().value("action"));
-      if(act=="addreplication"){
-	ok = true;
-        out->insert("addreplication", sysadm::LifePreserver::addReplication(in_args.toObject()));
-      }
-      if(act=="createsnap"){
-	ok = true;
-        out->insert("createsnap", sysadm::LifePreserver::createSnapshot(in_args.toObject()));
-      }
-      if(act=="cronscrub"){
-	ok = true;
-        out->insert("cronscrub", sysadm::LifePreserver::scheduleScrub(in_args.toObject()));
-      }
-      if(act=="cronsnap"){
-	ok = true;
-        out->insert("cronsnap", sysadm::LifePreserver::scheduleSnapshot(in_args.toObject()));
-      }
-      if(act=="initreplication"){
-	ok = true;
-        out->insert("initreplication", sysadm::LifePreserver::initReplication(in_args.toObject()));
-      }
-      if(act=="listcron"){
-	ok = true;
-        out->insert("listcron", sysadm::LifePreserver::listCron());
-      }
-      if(act=="listreplication"){
-	ok = true;
-        out->insert("listreplication", sysadm::LifePreserver::listReplication());
-      }
-      if(act=="listsnap"){
-	ok = true;
-        out->insert("listsnap", sysadm::LifePreserver::listSnap(in_args.toObject()));
-      }
-      if(act=="removereplication"){
-	ok = true;
-        out->insert("removereplication", sysadm::LifePreserver::removeReplication(in_args.toObject()));
-      }
-      if(act=="removesnap"){
-	ok = true;
-        out->insert("removesnap", sysadm::LifePreserver::removeSnapshot(in_args.toObject()));
-      }
-      if(act=="revertsnap"){
-	ok = true;
-        out->insert("revertsnap", sysadm::LifePreserver::revertSnapshot(in_args.toObject()));
-      }
-      if(act=="runreplication"){
-	ok = true;
-        out->insert("runreplication", sysadm::LifePreserver::runReplication(in_args.toObject()));
-      }
-      if(act=="savesettings"){
-	ok = true;
-        out->insert("savesettings", sysadm::LifePreserver::saveSettings(in_args.toObject()));
-      }
-      if(act=="settings"){
-	ok = true;
-        out->insert("settings", sysadm::LifePreserver::settings());
-      }
-
-    } //end of "action" key usage
-
-    //If nothing done - return the proper code
-    if(!ok){
-      return RestOutputStruct::BADREQUEST;
-    }
-  }else{  // if(in_args.isArray()){
-    return RestOutputStruct::BADREQUEST;
-  }
-  return RestOutputStruct::OK;
-}
-
-//==== SYSADM -- SysMgmt ====
-RestOutputStruct::ExitCode WebSocket::EvaluateSysadmSystemMgmtRequest(const QJsonValue in_args, QJsonObject *out){
-  if(in_args.isObject()){
-    QStringList keys = in_args.toObject().keys();
-    bool ok = false;
-    if(keys.contains("action")){
-      QString act = JsonValueToString(in_args.toObject().value("action"));
-      if(act=="batteryinfo"){
-	ok = true;
-        out->insert("batteryinfo", sysadm::SysMgmt::batteryInfo());
-      }
-      else if(act=="cpupercentage"){
-	ok = true;
-        out->insert("cpupercentage", sysadm::SysMgmt::cpuPercentage());
-      }
-      else if(act=="cputemps"){
-	ok = true;
-        out->insert("cputemps", sysadm::SysMgmt::cpuTemps());
-      }
-      else if(act=="externalmounts"){
-	ok = true;
-        out->insert("externalmounts", sysadm::SysMgmt::externalDevicePaths());
-      }
-      else if(act=="halt"){
-	ok = true;
-        out->insert("halt", sysadm::SysMgmt::systemHalt());
-      }
-      else if(act=="killproc"){
-	ok = true;
-        out->insert("killproc", sysadm::SysMgmt::killProc(in_args.toObject()));
-      }
-      else if(act=="memorystats"){
-	ok = true;
-        out->insert("memorystats", sysadm::SysMgmt::memoryStats());
-      }
-      else if(act=="procinfo"){
-	ok = true;
-        out->insert("procinfo", sysadm::SysMgmt::procInfo());
-      }
-      else if(act=="reboot"){
-	ok = true;
-        out->insert("reboot", sysadm::SysMgmt::systemReboot());
-      }
-      else if(act=="getsysctl"){
-	ok = true;
-        out->insert("getsysctl", sysadm::SysMgmt::getSysctl(in_args.toObject()));
-      }
-      else if(act=="setsysctl"){
-	ok = true;
-        out->insert("setsysctl", sysadm::SysMgmt::setSysctl(in_args.toObject()));
-      }
-      else if(act=="sysctllist"){
-	ok = true;
-        out->insert("sysctllist", sysadm::SysMgmt::sysctlList());
-      }
-      else if(act=="systeminfo"){
-	ok = true;
-        out->insert("systeminfo", sysadm::SysMgmt::systemInfo());
-      }
-      else if(act=="deviceinfo"){
-        ok = true;
-        out->insert("deviceinfo", sysadm::SysMgmt::systemDevices());
-      }
-
-    } //end of "action" key usage
-
-    //If nothing done - return the proper code
-    if(!ok){
-      return RestOutputStruct::BADREQUEST;
-    }
-  }else{  // if(in_args.isArray()){
-    return RestOutputStruct::BADREQUEST;
-  }
-  return RestOutputStruct::OK;
-}
-
-//==== SYSADM -- Update ====
-RestOutputStruct::ExitCode WebSocket::EvaluateSysadmUpdateRequest(const QJsonValue in_args, QJsonObject *out){
-  if(in_args.isObject()){
-    QStringList keys = in_args.toObject().keys();
-    bool ok = false;
-    if(keys.contains("action")){
-      QString act = JsonValueToString(in_args.toObject().value("action"));
-      if(act=="checkupdates"){
-	ok = true;
-        bool fastcheck = true;
-        fastcheck = in_args.toObject().value("force").toString().toLower()!="true";
-        out->insert("checkupdates", sysadm::Update::checkUpdates(fastcheck));
-
-      }else if(act=="listbranches"){
-	ok = true;
-        out->insert("listbranches", sysadm::Update::listBranches());
-
-      }else if(act=="startupdate"){
-	ok = true;
-	out->insert("startupdate", sysadm::Update::startUpdate(in_args.toObject()) );
-
-      }else if(act=="stopupdate"){
-	ok = true;
-	out->insert("stopupdate", sysadm::Update::stopUpdate() );
-
-      }else if(act=="applyupdate"){
-	ok = true;
-	out->insert("applyupdate", sysadm::Update::applyUpdates() );
-
-      }else if(act=="listsettings"){
-	ok = true;
-	out->insert("listsettings", sysadm::Update::readSettings() );
-
-      }else if(act=="changesettings"){
-	ok = true;
-	out->insert("changesettings", sysadm::Update::writeSettings(in_args.toObject()) );
-
-      }else if(act=="listlogs"){
-        ok = true;
-        out->insert("listlogs", sysadm::Update::listLogs() );
-
-      }else if(act=="readlogs" && in_args.toObject().contains("logs") ){
-        ok = true;
-        out->insert("readlogs", sysadm::Update::readLog(in_args.toObject()) );
-      }
-
-    } //end of "action" key usage
-
-    //If nothing done - return the proper code
-    if(!ok){
-      return RestOutputStruct::BADREQUEST;
-    }
-  }else{  // if(in_args.isArray()){
-    return RestOutputStruct::BADREQUEST;
-  }
-  return RestOutputStruct::OK;
-}
-
-//==== SYSADM -- iocage ====
-RestOutputStruct::ExitCode WebSocket::EvaluateSysadmIocageRequest(const QJsonValue in_args, QJsonObject *out){
-  if(in_args.isObject()){
-    QStringList keys = in_args.toObject().keys();
-    bool ok = false;
-    if(keys.contains("action")){
-      QString act = JsonValueToString(in_args.toObject().value("action"));
-      QJsonObject retObj;
-      if(act=="activatepool"){  retObj = sysadm::Iocage::activatePool(in_args.toObject());  }
-      else if(act=="deactivatepool"){retObj = sysadm::Iocage::deactivatePool(in_args.toObject()); }
-      else if(act=="activatestatus"){ retObj = sysadm::Iocage::activateStatus(); }
-      /*if(act=="execjail"){
-	ok = true;
-        out->insert("execjail", sysadm::Iocage::execJail(in_args.toObject()));
-      }
-      else if(act=="df"){
-	ok = true;
-        out->insert("df", sysadm::Iocage::df());
-      }
-      else if(act=="destroyjail"){
-	ok = true;
-        out->insert("destroyjail", sysadm::Iocage::destroyJail(in_args.toObject()));
-      }
-      else if(act=="createjail"){
-	ok = true;
-        out->insert("createjail", sysadm::Iocage::createJail(in_args.toObject()));
-      }
-      else if(act=="clonejail"){
-	ok = true;
-        out->insert("clonejail", sysadm::Iocage::cloneJail(in_args.toObject()));
-      }
-      else if(act=="cleanall"){
-	ok = true;
-        out->insert("cleanall", sysadm::Iocage::cleanAll());
-      }
-      else if(act=="cleanjails"){
-	ok = true;
-        out->insert("cleanjails", sysadm::Iocage::cleanJails());
-      }
-      else if(act=="capjail"){
-	ok = true;
-        out->insert("capjail", sysadm::Iocage::capJail(in_args.toObject()));
-      }
-      else if(act=="stopjail"){
-	ok = true;
-        out->insert("stopjail", sysadm::Iocage::stopJail(in_args.toObject()));
-      }
-      else if(act=="startjail"){
-	ok = true;
-        out->insert("startjail", sysadm::Iocage::startJail(in_args.toObject()));
-      }
-      else if(act=="getjailsettings"){
-	ok = true;
-        out->insert("getjailsettings", sysadm::Iocage::getJailSettings(in_args.toObject()));
-      }*/
-
-      //JAILS (GENERIC)
-      else if(act=="listjails"){ retObj = sysadm::Iocage::listJails(); }
-      //TEMPLATES
-      else if(act=="listtemplates"){ retObj = sysadm::Iocage::listTemplates(); }
-      else if(act=="cleantemplates"){ retObj = sysadm::Iocage::cleanTemplates(); }
-      //RELEASES
-      else if(act=="listreleases"){ retObj = sysadm::Iocage::listReleases(); }
-      else if(act=="fetchreleases"){ retObj = sysadm::Iocage::fetchReleases(in_args.toObject()); }
-      else if(act=="cleanreleases"){ retObj = sysadm::Iocage::cleanReleases(); }
-      //PLUGINS
-      else if(act=="listplugins"){  retObj = sysadm::Iocage::listPlugins(); }
-      else if(act=="createplugin"){ retObj = sysadm::Iocage::fetchPlugin(in_args.toObject()); }
-
-      ok = !retObj.keys().isEmpty();
-      if(ok){ out->insert(act,retObj); }
-    } //end of "action" key usage
-
-    //If nothing done - return the proper code
-    if(!ok ){
-      return RestOutputStruct::BADREQUEST;
-    }
-  }else{  // if(in_args.isArray()){
-    return RestOutputStruct::BADREQUEST;
-  }
-  return RestOutputStruct::OK;
-}
-
-//==== SYSADM -- iohyve ====
-RestOutputStruct::ExitCode WebSocket::EvaluateSysadmIohyveRequest(const QJsonValue in_args, QJsonObject *out){
-  if(in_args.isObject()){
-    QStringList keys = in_args.toObject().keys();
-    bool ok = false;
-    if(keys.contains("action")){
-      QString act = JsonValueToString(in_args.toObject().value("action"));
-      //qDebug() << " - iohyve action:" << act;
-      if(act=="adddisk"){
-	ok = true;
-        out->insert("adddisk", sysadm::Iohyve::addDisk(in_args.toObject()));
-      }
-      if(act=="create"){
-	ok = true;
-        out->insert("create", sysadm::Iohyve::createGuest(in_args.toObject()));
-      }
-      if(act=="delete"){
-	ok = true;
-        out->insert("delete", sysadm::Iohyve::deleteGuest(in_args.toObject()));
-      }
-      if(act=="deletedisk"){
-	ok = true;
-        out->insert("deletedisk", sysadm::Iohyve::deleteDisk(in_args.toObject()));
-      }
-      else if(act=="listdisks"){
-	ok = true;
-        out->insert("listdisks", sysadm::Iohyve::listDisks(in_args.toObject()));
-      }
-      else if(act=="listvms"){
-	ok = true;
-        out->insert("listvms", sysadm::Iohyve::listVMs());
-      }
-      else if(act=="listisos"){
-        ok = true;
-	out->insert("listisos", sysadm::Iohyve::listISOs());
-      }
-      else if(act=="fetchiso"){
-	ok = true;
-	//DProcess fetchproc;
-        out->insert("fetchiso", sysadm::Iohyve::fetchISO(in_args.toObject()));
-      }
-      else if(act=="install"){
-	ok = true;
-        out->insert("install", sysadm::Iohyve::installGuest(in_args.toObject()));
-      }
-      else if(act=="issetup"){
-	ok = true;
-        out->insert("issetup", sysadm::Iohyve::isSetup());
-      }
-      else if(act=="renameiso"){
-	ok = true;
-        out->insert("renameiso", sysadm::Iohyve::renameISO(in_args.toObject()));
-      }
-      else if(act=="rmiso"){
-	ok = true;
-        out->insert("rmiso", sysadm::Iohyve::rmISO(in_args.toObject()));
-      }
-      else if(act=="resizedisk"){
-	ok = true;
-        out->insert("resizedisk", sysadm::Iohyve::resizeDisk(in_args.toObject()));
-      }
-      else if(act=="setup"){
-	ok = true;
-        out->insert("setup", sysadm::Iohyve::setupIohyve(in_args.toObject()));
-      }
-      else if(act=="start"){
-	ok = true;
-        out->insert("start", sysadm::Iohyve::startGuest(in_args.toObject()));
-      }
-      else if(act=="stop"){
-	ok = true;
-        out->insert("stop", sysadm::Iohyve::stopGuest(in_args.toObject()));
-      }
-      else if(act=="version"){
-	ok = true;
-        out->insert("version", sysadm::Iohyve::version());
-      }
-      //qDebug() << " - iohyve action finished:" << act << ok;
-    } //end of "action" key usage
-
-    //If nothing done - return the proper code
-    if(!ok){
-      return RestOutputStruct::BADREQUEST;
-    }
-  }else{  // if(in_args.isArray()){
-    return RestOutputStruct::BADREQUEST;
-  }
-  return RestOutputStruct::OK;
-}
-
 // ==== SYSADM ZFS API ====
 RestOutputStruct::ExitCode WebSocket::EvaluateSysadmZfsRequest(const QJsonValue in_args, QJsonObject *out){
   if( ! in_args.isObject()){
@@ -937,14 +711,27 @@ RestOutputStruct::ExitCode WebSocket::EvaluateSysadmPkgRequest(const QJsonValue
 
   }else if(act=="list_categories"){
     //OPTIONAL: "repo"
-    QJsonArray cats = sysadm::PKG::list_categories(repo);
-    if(!cats.isEmpty()){ out->insert("list_categories", cats); }
+    QJsonObject counts;
+    QJsonArray cats = sysadm::PKG::list_categories(repo, &counts);
+    if(!cats.isEmpty()){
+      out->insert("list_categories", cats);
+      out->insert("category_counts", counts);
+    }
     else{ return RestOutputStruct::NOCONTENT; }
 
   }else if(act=="list_repos"){
-    QJsonArray repos = sysadm::PKG::list_repos();
+    QString jobID;
+    QJsonArray repos = sysadm::PKG::list_repos(false, &jobID);
+    if(repos.isEmpty() && jobID.isEmpty()){ return RestOutputStruct::NOCONTENT; }
     if(!repos.isEmpty()){ out->insert("list_repos", repos); }
-    else{ return RestOutputStruct::NOCONTENT; }
+    if(!jobID.isEmpty()){
+      //Repo databases are being updated in the background (see the dispatcher events for this ID)
+      QJsonObject update;
+        update.insert("status", "pending");
+        update.insert("proc_cmd", "pkg update");
+        update.insert("proc_id", jobID);
+      out->insert("repo_update", update);
+    }
 
   }else if(act=="pkg_install" && !pkgs.isEmpty() ){
     //REQUIRED: "pkg_origins"
@@ -1074,6 +861,7 @@ RestOutputStruct::ExitCode WebSocket::EvaluateSysadmServiceRequest(const QJsonVa
   if(action=="list_services"){
     QList<sysadm::Service> list = SMGR.GetServices();
     QList<bool> listEnabled = SMGR.isEnabled(list);
+    QList<bool> listRunning = SMGR.isRunning(list);
     QJsonObject services;
     for(int i=0; i<list.length(); i++){
       QJsonObject S;
@@ -1082,7 +870,7 @@ RestOutputStruct::ExitCode WebSocket::EvaluateSysadmServiceRequest(const QJsonVa
       S.insert("path", list[i].Path);
       S.insert("description", list[i].Description);
       S.insert("is_enabled", listEnabled[i] ? "true" : "false" );
-      S.insert("is_running",SMGR.isRunning(list[i]) ? "true" : "false" );
+      S.insert("is_running", listRunning[i] ? "true" : "false" );
       //S.insert("filename", list[i].Directory);
       //Need to add status info as well (isRunning, isEnabled);
       services.insert(list[i].Name, S);
@@ -7,6 +7,8 @@
 
 #include <QtConcurrent>
 #include <QHostInfo>
+#include <QElapsedTimer>
+#include "library/sysadm-metrics.h"
 #include <unistd.h>
 
 #define DEBUG 0
@@ -111,6 +113,7 @@ WebSocket::WebSocket(QObject *parent, QString url, QString ID, AuthorizationMana
 
 WebSocket::~WebSocket(){
   //qDebug() << "SOCKET Destroyed";
+  SCHEDULER->dropConnection(SockID); //don't start anything else that was queued for this connection
   if(SOCKET!=0 && SOCKET->isValid()){
     SOCKET->close();
     delete SOCKET;
@@ -150,16 +153,19 @@ bool WebSocket::isActive(){
 //=======================
 void WebSocket::sendReply(QString msg){
   //qDebug() << "Sending Socket Reply:" << msg;
+  QElapsedTimer timer; timer.start();
  if(SOCKET!=0 && SOCKET->isValid()){ SOCKET->sendTextMessage(msg); } //Websocket connection
  else if(TSOCKET!=0 && TSOCKET->isValid()){ 
     //TCP Socket connection
     TSOCKET->write(msg.toUtf8().data()); 
     TSOCKET->disconnectFromHost(); //TCP/REST connections are 1 connection per message.
  }
+  sysadm::Metrics::record("stage", "send", timer.nsecsElapsed()/1000);
 }
 
 void WebSocket::EvaluateREST(QString msg){
   //Parse the message into it's elements and proceed to the main data evaluation
+  QElapsedTimer timer; timer.start();
   RestInputStruct IN(msg, TSOCKET!=0);	
   if(SOCKET!=0 && !IN.Header.isEmpty() && !IN.bridgeID.isEmpty() ){
     if(BRIDGE.contains(IN.bridgeID)){
@@ -168,6 +174,7 @@ void WebSocket::EvaluateREST(QString msg){
     }
     IN.ParseBodyIntoJson();
   }
+  sysadm::Metrics::record("stage", "parse", timer.nsecsElapsed()/1000);
   if(DEBUG){
     qDebug() << "New REST Message:";
     qDebug() << "  VERB:" << IN.VERB << "URI:" << IN.URI;
@@ -202,7 +209,28 @@ void WebSocket::EvaluateREST(QString msg){
     }else if(isBridge && (IN.name=="response" || (IN.namesp=="events" && IN.name=="bridge") ) ){
       EvaluateResponse(IN);
     }else{
-      QtConcurrent::run(this, &WebSocket::EvaluateRequest, IN);
+      //Pick the scheduler lane based on the handler for this request
+      RequestScheduler::LANE lane = RequestScheduler::FAST_LANE;
+      if(IN.namesp.toLower()!="events"){
+        const backend_handler *handler = BackendHandler(IN.namesp.toLower(), IN.name.toLower(), BackendAction(IN.args));
+        if(handler!=0 && (handler->flags & backend_handler::BLOCKING) ){ lane = RequestScheduler::BLOCKING_LANE; }
+      }
+      //Fairness is per client: each client relayed through a bridge gets its own share
+      QString connID = SockID;
+      if(!IN.bridgeID.isEmpty()){ connID.append("/"+IN.bridgeID); }
+      if( !SCHEDULER->queueRequest(connID, lane, [this, IN](){ this->EvaluateRequest(IN); }) ){
+        //Server is too busy - refuse the request
+        RestOutputStruct out;
+          out.in_struct = IN;
+          out.CODE = RestOutputStruct::SERVICEUNAVAILABLE;
+        QString msg = out.assembleMessage();
+        if(SOCKET!=0 && !IN.bridgeID.isEmpty()){
+          //BRIDGE RELAY - alternate format
+          msg = AUTHSYSTEM->encryptString(msg, BRIDGE[IN.bridgeID].enc_key);
+          msg.prepend( IN.bridgeID+"\n");
+        }
+        this->emit SendMessage(msg);
+      }
     }
   }
 }
@@ -410,7 +438,9 @@ void WebSocket::EvaluateRequest(const RestInputStruct &REQ){
     }
   }
   //Return any information
+  QElapsedTimer timer; timer.start();
   QString msg = out.assembleMessage();
+  sysadm::Metrics::record("stage", "assemble", timer.nsecsElapsed()/1000);
   if(SOCKET!=0 && !REQ.bridgeID.isEmpty()){
    //BRIDGE RELAY - alternate format
    msg = AUTHSYSTEM->encryptString(msg, BRIDGE[REQ.bridgeID].enc_key);
@@ -565,46 +595,18 @@ void WebSocket::EvaluateMessage(const QString &msg){
 }
 
 void WebSocket::ParseIncoming(){
-  bool found = false;
-
-  // Check if we have a complete JSON request waiting to be parsed
-  QString JsonRequest;
-  for ( int i = 0; i<incomingbuffer.size(); i++) {
-    if(incomingbuffer[i]!='}'){ continue; } //only look for the end of a JSON block
-    JsonRequest = incomingbuffer.left(i+1);
-    //REST requests will have non-JSON at the top - trim that off
-    JsonRequest = "{"+JsonRequest.section("{",1,-1);
-    //JsonRequest.truncate(i);
-    //qDebug() << "Check JSON:" << JsonRequest;
-    if ( !QJsonDocument::fromJson(JsonRequest.toLocal8Bit()).isNull() )
-    {
-      // We have what looks like a valid JSON request, lets parse it now
-      //qDebug() << "TCP Message" << JsonRequest;
-      EvaluateREST(incomingbuffer.left(i+1)); //send the full message
-      incomingbuffer.remove(0, i);
-      found = true;
-      break;
-    }
+  // Evaluate any complete JSON requests waiting in the framer (in order)
+  while(incoming.hasMessage()){
+    //qDebug() << "TCP Message" << msg;
+    EvaluateREST( QString::fromUtf8(incoming.takeMessage()) ); //send the full message
   }
-  //if(!found){ qDebug() << "Bad Message:" << incomingbuffer; }
-  // If the buffer is larger than 128000 chars and no valid JSON somebody
-  // is screwing with us, lets clear the buffer
-  if ( ! found && incomingbuffer.size() > 128000 ) {
-    incomingbuffer="";
-    return;
-  }
-
-  // If we found a valid JSON request, but still have data, check for
-  // a second request waiting in the buffer
-  if ( found && incomingbuffer.size() > 2 )
-    ParseIncoming();
 }
 
 void WebSocket::EvaluateTcpMessage(){
   //Need to read the data from the Tcp socket and turn it into a string
   //qDebug() << "New TCP Message:";
   if(idletimer->isActive()){ idletimer->stop(); }
-  incomingbuffer.append(QString(TSOCKET->read(128000)));
+  incoming.append(TSOCKET->readAll());
 
   // Check for JSON in this incoming data
   ParseIncoming();
@@ -11,12 +11,23 @@
 #include "RestStructs.h"
 #include "AuthorizationManager.h"
 
+#include <functional>
+
 struct bridge_data{
   QByteArray enc_key;
   QString auth_tok;
   QList<EventWatcher::EVENT_TYPE> sendEvents;
 };
 
+class WebSocket;
+//Backend request handler (registered in WebBackend.cpp)
+struct backend_handler{
+  enum FLAGS{ FAST = 0, BLOCKING = 1, FULLACCESS = 2 }; //BLOCKING: runs external utilities or other long-running work
+  std::function<RestOutputStruct::ExitCode(WebSocket*, const RestInputStruct&, QJsonObject*)> func;
+  int flags;
+  QString key; //registered key (used as the metric name)
+};
+
 class WebSocket : public QObject{
 	Q_OBJECT
 public:
@@ -29,6 +40,12 @@ public:
 	void closeConnection();
 	bool isActive(); //check if the connection is still active/valid
 
+	//Probe which subsystems are available on this system (result is cached for all connections)
+	static void ProbeSubsystems();
+	//Find the handler for a backend request (all inputs lowercase - returns 0 if not found)
+	static const backend_handler* BackendHandler(QString namesp, QString name, QString action);
+	static QString BackendAction(const QJsonValue &args); //lowercase "action" from the request arguments
+
 private:
 	QTimer *idletimer, *connCheckTimer;
 	QWebSocket *SOCKET;
@@ -43,7 +60,7 @@ private:
 	bool isBridge;
 
 	// Where we store incoming Tcp data
-	QString incomingbuffer;
+	RestInputFramer incoming;
 	void ParseIncoming();
 
 	//Main connection communications procedure
@@ -59,33 +76,25 @@ private:
 	//Backend request/reply functions (contained in WebBackend.cpp)
 	// -- Subsystem listing routine
 	RestOutputStruct::ExitCode AvailableSubsystems(bool fullaccess, QJsonObject *out);
+	bool SubsystemAvailable(QString nsname); //"namespace/name" (lowercase)
 	// -- Main subsystem parser
 	RestOutputStruct::ExitCode EvaluateBackendRequest(const RestInputStruct&, QJsonObject *out);
+	// -- Handler table for the subsystems/actions
+	static QHash<QString, backend_handler> RegisterBackendHandlers();
 
 
 	// -- Individual subsystems
+	//  NOTE: beadm, iocage, iohyve, lifepreserver, systemmanager and update actions are registered individually
 	// -- Server Settings Modification API
 	RestOutputStruct::ExitCode EvaluateSysadmSettingsRequest(const QJsonValue in_args, QJsonObject *out);
 	// -- Server Log retrieval system
 	RestOutputStruct::ExitCode EvaluateSysadmLogsRequest(bool allaccess, const QJsonValue in_args, QJsonObject *out);
 	// -- rpc dispatcher API
 	RestOutputStruct::ExitCode EvaluateDispatcherRequest(bool allaccess, const QJsonValue in_args, QJsonObject *out);
-	// -- sysadm beadm API
-	RestOutputStruct::ExitCode EvaluateSysadmBEADMRequest(const QJsonValue in_args, QJsonObject *out);
 	// -- sysadm FS API
 	RestOutputStruct::ExitCode EvaluateSysadmFSRequest(const QJsonValue in_args, QJsonObject *out);
-	// -- sysadm iocage API
-	RestOutputStruct::ExitCode EvaluateSysadmIocageRequest(const QJsonValue in_args, QJsonObject *out);
-	// -- sysadm iohyve API
-	RestOutputStruct::ExitCode EvaluateSysadmIohyveRequest(const QJsonValue in_args, QJsonObject *out);
 	// -- sysadm Network API
 	RestOutputStruct::ExitCode EvaluateSysadmNetworkRequest(const QJsonValue in_args, QJsonObject *out);
-	// -- sysadm LifePreserver API
-	RestOutputStruct::ExitCode EvaluateSysadmLifePreserverRequest(const QJsonValue in_args, QJsonObject *out);
-	// -- sysadm info API
-	RestOutputStruct::ExitCode EvaluateSysadmSystemMgmtRequest(const QJsonValue in_args, QJsonObject *out);
-	// -- sysadm Update API
-	RestOutputStruct::ExitCode EvaluateSysadmUpdateRequest(const QJsonValue in_args, QJsonObject *out);
 	// -- sysadm ZFS API
 	RestOutputStruct::ExitCode EvaluateSysadmZfsRequest(const QJsonValue in_args, QJsonObject *out);
 	// -- sysadm PKG API
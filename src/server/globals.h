@@ -18,6 +18,8 @@ extern bool WS_MODE;
 extern EventWatcher *EVENTS;
 #include "Dispatcher.h"
 extern Dispatcher *DISPATCHER;
+#include "RequestScheduler.h"
+extern RequestScheduler *SCHEDULER;
 
 //Special defines
 #define BRIDGEPORTNUMBER 12149 //Default port for a sysadm-bridge
@@ -3,6 +3,9 @@ CONFIG 	+=  c++11
 
 HEADERS	+= 	$${PWD}/sysadm-global.h \
                 $${PWD}/sysadm-general.h \
+                $${PWD}/sysadm-command.h \
+                $${PWD}/sysadm-executor.h \
+                $${PWD}/sysadm-metrics.h \
                 $${PWD}/sysadm-beadm.h \
                 $${PWD}/sysadm-filesystem.h \
                 $${PWD}/sysadm-iocage.h \
@@ -10,7 +13,9 @@ HEADERS	+= 	$${PWD}/sysadm-global.h \
                 $${PWD}/sysadm-lifepreserver.h \
                 $${PWD}/sysadm-network.h \
                 $${PWD}/sysadm-firewall.h \
+                $${PWD}/sysadm-sampler.h \
                 $${PWD}/sysadm-servicemanager.h\
+                $${PWD}/sysadm-sysctl.h \
                 $${PWD}/sysadm-systemmanager.h\
                 $${PWD}/sysadm-update.h \
                 $${PWD}/sysadm-users.h \
@@ -23,6 +28,9 @@ HEADERS	+= 	$${PWD}/sysadm-global.h \
 
 SOURCES	+=	$${PWD}/NetDevice.cpp \
                 $${PWD}/sysadm-general.cpp \
+                $${PWD}/sysadm-command.cpp \
+                $${PWD}/sysadm-executor.cpp \
+                $${PWD}/sysadm-metrics.cpp \
                 $${PWD}/sysadm-beadm.cpp \
                 $${PWD}/sysadm-filesystem.cpp \
                 $${PWD}/sysadm-iocage.cpp \
@@ -30,7 +38,9 @@ SOURCES	+=	$${PWD}/NetDevice.cpp \
                 $${PWD}/sysadm-lifepreserver.cpp \
                 $${PWD}/sysadm-network.cpp \
                 $${PWD}/sysadm-firewall.cpp \
+                $${PWD}/sysadm-sampler.cpp \
                 $${PWD}/sysadm-servicemanager.cpp \
+                $${PWD}/sysadm-sysctl.cpp \
                 $${PWD}/sysadm-systemmanager.cpp \
                 $${PWD}/sysadm-update.cpp \
                 $${PWD}/sysadm-users.cpp \
@@ -0,0 +1,167 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+#include "sysadm-command.h"
+#include "sysadm-executor.h"
+
+#include <QEventLoop>
+#include <QFutureWatcher>
+
+using namespace sysadm;
+
+Command::Command() : QObject(){
+
+}
+
+Command::~Command(){
+
+}
+
+Command* Command::instance(){
+  //Created on first use (thread-safe static init) along with its own thread/event loop
+  static Command *inst = [](){
+    QThread *thread = new QThread();
+    Command *cmd = new Command();
+    cmd->moveToThread(thread);
+    thread->start();
+    return cmd;
+  }();
+  return inst;
+}
+
+//=================
+// Public functions
+//=================
+QFuture<CommandResult> Command::start(QString command, QStringList arguments, QString workdir, QStringList env){
+  pending_command *cmd = new pending_command;
+    cmd->command = command;
+    cmd->arguments = arguments;
+    cmd->workdir = workdir;
+    cmd->env = env;
+  cmd->future.reportStarted();
+  QFuture<CommandResult> fut = cmd->future.future();
+  instance()->enqueue(cmd);
+  return fut;
+}
+
+void Command::start(std::function<void(CommandResult)> callback, QString command, QStringList arguments, QString workdir, QStringList env){
+  pending_command *cmd = new pending_command;
+    cmd->command = command;
+    cmd->arguments = arguments;
+    cmd->workdir = workdir;
+    cmd->env = env;
+    cmd->callback = callback;
+  cmd->future.reportStarted();
+  instance()->enqueue(cmd);
+}
+
+CommandResult Command::run(QString command, QStringList arguments, QString workdir, QStringList env){
+  if(QThread::currentThread() != instance()->thread()){
+    return start(command, arguments, workdir, env).result(); //blocks until the result is reported
+  }
+  //Called from a callback on the command thread itself - keep its event loop going until this one is done
+  // (every other command still gets started and reaped in the meantime)
+  QFuture<CommandResult> fut = start(command, arguments, workdir, env);
+  QFutureWatcher<CommandResult> watcher;
+  QEventLoop loop;
+  connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()) );
+  watcher.setFuture(fut);
+  if(!fut.isFinished()){ loop.exec(); }
+  return fut.result();
+}
+
+QList<CommandResult> Command::waitForAll(QList< QFuture<CommandResult> > futures){
+  QList<CommandResult> out;
+  for(int i=0; i<futures.length(); i++){
+    futures[i].waitForFinished();
+    out << futures[i].result();
+  }
+  return out;
+}
+
+//=================
+// Internal functions
+//=================
+void Command::enqueue(pending_command *cmd){
+  queueMutex.lock();
+  QUEUE.enqueue(cmd);
+  queueMutex.unlock();
+  QMetaObject::invokeMethod(this, "launchPending", Qt::QueuedConnection);
+}
+
+QProcess* Command::setupProcess(pending_command *cmd, QObject *parent){
+  QProcess *proc = new QProcess(parent);
+    proc->setProcessChannelMode(QProcess::MergedChannels); //need output
+  //First setup the process environment as necessary
+  if(!cmd->env.isEmpty()){
+    QProcessEnvironment PE = QProcessEnvironment::systemEnvironment();
+    for(int i=0; i<cmd->env.length(); i++){
+      if(!cmd->env[i].contains("=")){ continue; }
+      PE.insert(cmd->env[i].section("=",0,0), cmd->env[i].section("=",1,100));
+    }
+    proc->setProcessEnvironment(PE);
+  }
+  //if a working directory is specified, use it
+  if(!cmd->workdir.isEmpty()){ proc->setWorkingDirectory(cmd->workdir); }
+  return proc;
+}
+
+void Command::finishCommand(pending_command *cmd, CommandResult res, bool ranProcess){
+  Metrics::record("command", Metrics::commandName(cmd->command), cmd->timer.nsecsElapsed()/1000);
+  if(ranProcess){ CommandExecutor::commandFinished(cmd->command, cmd->arguments, res, cmd->timer.elapsed()); }
+  cmd->future.reportResult(res);
+  cmd->future.reportFinished();
+  if(cmd->callback){ cmd->callback(res); }
+  delete cmd;
+}
+
+//=================
+// Private slots (command thread)
+//=================
+void Command::launchPending(){
+  queueMutex.lock();
+  QList<pending_command*> cmds = QUEUE;
+  QUEUE.clear();
+  queueMutex.unlock();
+  for(int i=0; i<cmds.length(); i++){
+    //See if the executor provides the result first (fixture replay)
+    CommandResult res;
+    int delay = 0;
+    cmds[i]->timer.start();
+    if(CommandExecutor::interceptCommand(cmds[i]->command, cmds[i]->arguments, &res, &delay)){
+      pending_command *cmd = cmds[i];
+      if(delay>0){ QTimer::singleShot(delay, this, [cmd, res](){ finishCommand(cmd, res, false); }); }
+      else{ finishCommand(cmd, res, false); }
+      continue;
+    }
+    QProcess *proc = setupProcess(cmds[i], this);
+    RUNNING.insert(proc, cmds[i]);
+    connect(proc, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(procFinished(int, QProcess::ExitStatus)) );
+    connect(proc, SIGNAL(error(QProcess::ProcessError)), this, SLOT(procError(QProcess::ProcessError)) );
+    //Now run the command (with any optional arguments)
+    if(cmds[i]->arguments.isEmpty()){ proc->start(cmds[i]->command); }
+    else{ proc->start(cmds[i]->command, cmds[i]->arguments); }
+  }
+}
+
+void Command::procFinished(int retcode, QProcess::ExitStatus status){
+  QProcess *proc = qobject_cast<QProcess*>(sender());
+  if(proc==0 || !RUNNING.contains(proc)){ return; }
+  CommandResult res;
+    res.exitcode = retcode;
+    res.success = (status==QProcess::NormalExit && retcode==0);
+    res.output = QString(proc->readAllStandardOutput());
+  finishCommand(RUNNING.take(proc), res);
+  proc->deleteLater();
+}
+
+void Command::procError(QProcess::ProcessError err){
+  if(err!=QProcess::FailedToStart){ return; } //finished() will still be emitted for the other errors
+  QProcess *proc = qobject_cast<QProcess*>(sender());
+  if(proc==0 || !RUNNING.contains(proc)){ return; }
+  finishCommand(RUNNING.take(proc), CommandResult());
+  proc->deleteLater();
+}
@@ -0,0 +1,80 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+#ifndef __PCBSD_LIB_UTILS_COMMAND_H
+#define __PCBSD_LIB_UTILS_COMMAND_H
+
+#include "sysadm-global.h"
+#include "sysadm-metrics.h"
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QTimer>
+
+#include <functional>
+
+namespace sysadm{
+
+//Output of a finished command
+struct CommandResult{
+  bool success; //process started and returned 0
+  int exitcode;
+  QString output; //stdout + stderr
+  CommandResult(){ success = false; exitcode = -1; }
+};
+
+//Asynchronous command runner
+// - All processes are owned by a single background thread and reaped from its event loop (SIGCHLD)
+// - Nothing here polls or calls processEvents(), so it is safe to use from any thread
+class Command : public QObject{
+	Q_OBJECT
+public:
+	//Start a command and return right away (the future gets the result when the process exits)
+	//Note: environment changes should be listed as such: <variable>=<value>
+	static QFuture<CommandResult> start(QString command, QStringList arguments = QStringList(), QString workdir = "", QStringList env = QStringList() );
+	//Start a command and call the function with the result when the process exits
+	//Note: The function is run on the background command thread - keep it short
+	static void start(std::function<void(CommandResult)> callback, QString command, QStringList arguments = QStringList(), QString workdir = "", QStringList env = QStringList() );
+
+	//Blocking versions (wait without polling - a callback on the command thread gets a local event loop)
+	static CommandResult run(QString command, QStringList arguments = QStringList(), QString workdir = "", QStringList env = QStringList() );
+	static QList<CommandResult> waitForAll(QList< QFuture<CommandResult> > futures); //wait for several started commands at once
+
+private:
+	struct pending_command{
+	  QString command, workdir;
+	  QStringList arguments, env;
+	  QFutureInterface<CommandResult> future;
+	  std::function<void(CommandResult)> callback;
+	  QElapsedTimer timer; //started with the process
+	};
+
+	Command();
+	~Command();
+	static Command* instance();
+
+	QMutex queueMutex;
+	QQueue<pending_command*> QUEUE; //not started yet
+	QHash<QProcess*, pending_command*> RUNNING;
+
+	void enqueue(pending_command *cmd);
+	static QProcess* setupProcess(pending_command *cmd, QObject *parent);
+	static void finishCommand(pending_command *cmd, CommandResult res, bool ranProcess = true);
+
+private slots:
+	void launchPending();
+	void procFinished(int, QProcess::ExitStatus);
+	void procError(QProcess::ProcessError);
+
+};
+
+} //end of sysadm namespace
+
+#endif
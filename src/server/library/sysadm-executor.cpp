@@ -0,0 +1,130 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+#include "sysadm-executor.h"
+
+#include <QCryptographicHash>
+#include <QReadWriteLock>
+#include <QSaveFile>
+
+using namespace sysadm;
+
+//Current executor (0: run the real processes)
+static CommandExecutor *EXECUTOR = 0;
+static QReadWriteLock execLock;
+
+//Full command line (single-string and split-argument versions of a command give the same line)
+inline QString commandLine(QString command, QStringList arguments){
+  return (QStringList() << command << arguments).join(" ").simplified();
+}
+
+//=================
+// CommandExecutor (static functions)
+//=================
+void CommandExecutor::install(CommandExecutor *exec){
+  QWriteLocker lock(&execLock);
+  if(EXECUTOR!=0){ delete EXECUTOR; }
+  EXECUTOR = exec;
+}
+
+bool CommandExecutor::install(QString mode, QString fixtureDir, int latency){
+  mode = mode.toLower();
+  if(mode=="process" || mode.isEmpty()){ install( (CommandExecutor*) 0); }
+  else if(fixtureDir.isEmpty()){ return false; }
+  else if(mode=="record"){ install( new RecordExecutor(fixtureDir) ); }
+  else if(mode=="replay"){ install( new ReplayExecutor(fixtureDir, latency) ); }
+  else{ return false; }
+  return true;
+}
+
+QString CommandExecutor::currentName(){
+  QReadLocker lock(&execLock);
+  return (EXECUTOR==0) ? "process" : EXECUTOR->name();
+}
+
+bool CommandExecutor::interceptCommand(QString command, QStringList arguments, CommandResult *result, int *delay){
+  QReadLocker lock(&execLock);
+  *delay = 0;
+  if(EXECUTOR==0){ return false; }
+  return EXECUTOR->intercept(command, arguments, result, delay);
+}
+
+void CommandExecutor::commandFinished(QString command, QStringList arguments, const CommandResult &result, qint64 msecs){
+  QReadLocker lock(&execLock);
+  if(EXECUTOR==0){ return; }
+  EXECUTOR->finished(command, arguments, result, msecs);
+}
+
+QString CommandExecutor::fixtureFile(QString dir, QString command, QStringList arguments){
+  QString line = commandLine(command, arguments);
+  QString hash = QCryptographicHash::hash(line.toUtf8(), QCryptographicHash::Sha1).toHex().left(16);
+  return dir+"/"+Metrics::commandName(line)+"-"+hash+".fixture";
+}
+
+//=================
+// RecordExecutor
+//=================
+RecordExecutor::RecordExecutor(QString fixtureDir){
+  DIR = fixtureDir;
+  QDir dir;
+  dir.mkpath(DIR);
+}
+
+void RecordExecutor::finished(QString command, QStringList arguments, const CommandResult &result, qint64 msecs){
+  //Fixture format: "key: value" header lines, a blank line, then the raw output
+  QStringList header;
+  header << "command: "+commandLine(command, arguments);
+  header << "exit: "+QString::number(result.exitcode);
+  header << "success: "+QString(result.success ? "true" : "false");
+  header << "msecs: "+QString::number(msecs);
+  QSaveFile file( fixtureFile(DIR, command, arguments) );
+  if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)){ return; }
+  file.write( (header.join("\n")+"\n\n").toUtf8() );
+  file.write( result.output.toUtf8() );
+  file.commit();
+}
+
+//=================
+// ReplayExecutor
+//=================
+ReplayExecutor::ReplayExecutor(QString fixtureDir, int latency){
+  DIR = fixtureDir;
+  LATENCY = latency;
+}
+
+bool ReplayExecutor::intercept(QString command, QStringList arguments, CommandResult *result, int *delay){
+  //Look for the exact command first, then a generic fixture for the executable (<executable>.fixture)
+  QString path = fixtureFile(DIR, command, arguments);
+  if(!QFile::exists(path)){ path = DIR+"/"+Metrics::commandName(commandLine(command, arguments))+".fixture"; }
+  QFile file(path);
+  if(!file.open(QIODevice::ReadOnly)){
+    //Never fall back on running the real utility in replay mode
+    qDebug() << "No command fixture:" << commandLine(command, arguments);
+    result->success = false;
+    result->exitcode = 127;
+    result->output.clear();
+    return true;
+  }
+  QByteArray data = file.readAll();
+  file.close();
+  int split = data.indexOf("\n\n");
+  if(split<0){ split = data.length(); }
+  QStringList header = QString::fromUtf8(data.left(split)).split("\n");
+  result->exitcode = 0;
+  int msecs = 0;
+  QString success;
+  for(int i=0; i<header.length(); i++){
+    QString key = header[i].section(":",0,0).simplified();
+    QString val = header[i].section(":",1,-1).simplified();
+    if(key=="exit"){ result->exitcode = val.toInt(); }
+    else if(key=="success"){ success = val; }
+    else if(key=="msecs"){ msecs = val.toInt(); }
+  }
+  result->success = success.isEmpty() ? (result->exitcode==0) : (success=="true"); //hand-written fixtures may only list the exit code
+  result->output = QString::fromUtf8(data.mid(split+2));
+  *delay = (LATENCY<0) ? msecs : LATENCY;
+  return true;
+}
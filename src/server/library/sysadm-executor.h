@@ -0,0 +1,71 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+//  Pluggable command executors (used by General::RunCommand() and Command)
+//  - "process": run the real utilities (default)
+//  - "record": run the real utilities and save the output/exit code of each one into a fixture directory
+//  - "replay": never run anything - serve the saved output from the fixture directory instead
+//===========================================
+#ifndef __PCBSD_LIB_UTILS_EXECUTOR_H
+#define __PCBSD_LIB_UTILS_EXECUTOR_H
+
+#include "sysadm-global.h"
+#include "sysadm-command.h"
+
+namespace sysadm{
+
+class CommandExecutor{
+public:
+	virtual ~CommandExecutor(){}
+	virtual QString name() = 0;
+	//Return true if the command was handled here (result filled in) instead of starting a process
+	//  "delay" is the number of milliseconds the caller should wait before using the result
+	virtual bool intercept(QString command, QStringList arguments, CommandResult *result, int *delay){
+	  Q_UNUSED(command); Q_UNUSED(arguments); Q_UNUSED(result); Q_UNUSED(delay);
+	  return false;
+	}
+	//Called with the result of every process that was actually run
+	virtual void finished(QString command, QStringList arguments, const CommandResult &result, qint64 msecs){
+	  Q_UNUSED(command); Q_UNUSED(arguments); Q_UNUSED(result); Q_UNUSED(msecs);
+	}
+
+	//Current executor (can be changed at any time - takes ownership)
+	static void install(CommandExecutor *exec);
+	//Setup an executor by name: "process", "record", or "replay"
+	//  latency (replay only): milliseconds per command, or -1 to use the time saved with each fixture
+	static bool install(QString mode, QString fixtureDir = "", int latency = 0);
+	static QString currentName();
+
+	//Wrappers used by the command runners
+	static bool interceptCommand(QString command, QStringList arguments, CommandResult *result, int *delay);
+	static void commandFinished(QString command, QStringList arguments, const CommandResult &result, qint64 msecs);
+
+	//Fixture file for a command (<executable>-<hash of the full command line>.fixture)
+	static QString fixtureFile(QString dir, QString command, QStringList arguments);
+};
+
+class RecordExecutor : public CommandExecutor{
+public:
+	RecordExecutor(QString fixtureDir);
+	QString name(){ return "record"; }
+	void finished(QString command, QStringList arguments, const CommandResult &result, qint64 msecs);
+private:
+	QString DIR;
+};
+
+class ReplayExecutor : public CommandExecutor{
+public:
+	ReplayExecutor(QString fixtureDir, int latency);
+	QString name(){ return "replay"; }
+	bool intercept(QString command, QStringList arguments, CommandResult *result, int *delay);
+private:
+	QString DIR;
+	int LATENCY;
+};
+
+} //end of sysadm namespace
+
+#endif
@@ -8,6 +8,12 @@
 //PLEASE: Keep the functions in the same order as listed in pcbsd-general.h
 
 #include "sysadm-global.h"
+#include "sysadm-command.h"
+#include "sysadm-executor.h"
+#include "sysadm-metrics.h"
+
+#include <QEventLoop>
+#include <QTimer>
 
 using namespace sysadm;
 
@@ -21,6 +27,26 @@ QString TRUEOS_ETCCONF(PREFIX + "/etc/trueos.conf");  // The default trueos.conf
 
 //Return CLI output (and success/failure)
 QString General::RunCommand(bool &success, QString command, QStringList arguments, QString workdir, QStringList env){
+  if(QCoreApplication::instance()!=0 && QThread::currentThread()!=QCoreApplication::instance()->thread()){
+    //Not on the main thread - hand the process off to the command thread and wait for the result
+    // (no need to keep an event loop running here)
+    CommandResult res = Command::run(command, arguments, workdir, env);
+    success = res.success;
+    return res.output;
+  }
+  //See if the executor provides the result first (fixture replay)
+  CommandResult res;
+  int delay = 0;
+  if(CommandExecutor::interceptCommand(command, arguments, &res, &delay)){
+    if(delay>0){
+      //Simulated run time - keep the event loop going like a real process would
+      QEventLoop loop;
+      QTimer::singleShot(delay, &loop, SLOT(quit()));
+      loop.exec();
+    }
+    success = res.success;
+    return res.output;
+  }
   QProcess proc;
     proc.setProcessChannelMode(QProcess::MergedChannels); //need output
   //First setup the process environment as necessary
@@ -37,12 +63,21 @@ QString General::RunCommand(bool &success, QString command, QStringList argument
     proc.setWorkingDirectory(workdir);
   }
   //Now run the command (with any optional arguments)
+  QElapsedTimer timer; timer.start();
   if(arguments.isEmpty()){ proc.start(command); }
   else{ proc.start(command, arguments); }
   //Wait for the process to finish (but don't block the event loop)
-  while( !proc.waitForFinished(500) ){ QCoreApplication::processEvents(); }
+  while( !proc.waitForFinished(500) ){
+    if(proc.state() != QProcess::Running){ break; } //never started or missed the finished signal
+    QCoreApplication::processEvents();
+  }
   success = (proc.exitCode()==0); //return success/failure
-  return QString(proc.readAllStandardOutput());
+  Metrics::record("command", Metrics::commandName(command), timer.nsecsElapsed()/1000);
+  res.exitcode = proc.exitCode();
+  res.success = success;
+  res.output = QString(proc.readAllStandardOutput());
+  CommandExecutor::commandFinished(command, arguments, res, timer.elapsed());
+  return res.output;
 }
 
 QString General::RunCommand(QString command, QStringList arguments, QString workdir, QStringList env){
@@ -60,17 +95,8 @@ bool General::RunQuickCommand(QString command, QStringList arguments,QString wor
 
 QStringList General::gitCMD(QString dir, QString cmd, QStringList args){
   //Run a quick command in the proper dir and return the output
-  QProcess proc;
-  proc.setProcessChannelMode(QProcess::MergedChannels);
-  if( !dir.isEmpty() && QFile::exists(dir) ){ proc.setWorkingDirectory(dir); }
-  if(args.isEmpty()){ proc.start(cmd); }
-  else{ proc.start(cmd, args); }
-  while(!proc.waitForFinished(300)){ QCoreApplication::processEvents(); }
-  QStringList out;
-  while(proc.canReadLine()){
-    out << QString( proc.readLine() );
-  }
-  return out;
+  if( !dir.isEmpty() && !QFile::exists(dir) ){ dir.clear(); }
+  return General::RunCommand(cmd, args, dir).split("\n", QString::SkipEmptyParts);
 }
 
 //=================
@@ -15,6 +15,7 @@ class General{
 public:
     //Non-event-blocking versions of QProcess::execute() or system()
     //Note: environment changes should be listed as such: [<variable>=<value>]
+    //Note: Off the main thread these wait on sysadm::Command (see sysadm-command.h for the asynchronous versions)
     // - Both success/log of output
     static QString RunCommand(bool &success, QString command, QStringList arguments = QStringList(), QString workdir = "", QStringList env = QStringList() );
     // - Log output only
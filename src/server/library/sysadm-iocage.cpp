@@ -188,12 +188,11 @@ QJsonObject Iocage::fetchReleases(QJsonObject inobj){
   if(inobj.value("releases").isArray()){ releases = General::JsonArrayToStringList(inobj.value("releases").toArray()); }
   else if(inobj.value("releases").isString()){ releases << inobj.value("releases").toString(); }
   //Now start up each of these downloads as appropriate
-  QStringList cids = DISPATCHER->listJobs().value("no_queue").toObject().keys(); //all currently running/pending jobs
   QString jobprefix = "sysadm_iocage_fetch_release_";
   QJsonArray started;
   for(int i=0; i<releases.length(); i++){
     releases[i] = releases[i].section(" ",0,0, QString::SectionSkipEmpty); //all valid releases are a single word - do not allow injection of other commands (or "(EOL)" tags on end)
-    if(cids.contains(jobprefix+releases[i]) ){ continue; } //this fetch job is already running - skip it for now
+    if(DISPATCHER->isJobActive(jobprefix+releases[i]) ){ continue; } //this fetch job is already running - skip it for now
     DISPATCHER->queueProcess(jobprefix+releases[i], "iocage fetch --verify -r "+releases[i]);
     started << jobprefix+releases[i];
   }
@@ -214,10 +213,9 @@ QJsonObject Iocage::fetchPlugin(QJsonObject inobj){
   }
 
   //Now start up each of these downloads as appropriate
-  QStringList cids = DISPATCHER->listJobs().value("no_queue").toObject().keys(); //all currently running/pending jobs
   QString jobprefix = "sysadm_iocage_fetch_plugin_";
     plugin = plugin.section(" ",0,0, QString::SectionSkipEmpty); //all valid releases are a single word - do not allow injection of other commands
-    if(cids.contains(jobprefix+plugin) ){ return QJsonObject(); } //this fetch job is already running
+    if(DISPATCHER->isJobActive(jobprefix+plugin) ){ return QJsonObject(); } //this fetch job is already running
     DISPATCHER->queueProcess(jobprefix+plugin, "iocage fetch -P --name "+plugin+" "+inet);
   retObject.insert("started_dispatcher_id", jobprefix+plugin);
   return retObject;
@@ -0,0 +1,161 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+#include "sysadm-metrics.h"
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSaveFile>
+
+using namespace sysadm;
+
+//Registry of the histograms: "<type>/<name>" -> histogram
+static QHash<QString, MetricHistogram*> HISTOGRAMS;
+static QReadWriteLock histLock;
+
+//=================
+// MetricHistogram
+//=================
+void MetricHistogram::record(qint64 usecs){
+  if(usecs<0){ usecs = 0; }
+  buckets[ bucketForValue(usecs) ].fetchAndAddRelaxed(1);
+  count.fetchAndAddRelaxed(1);
+  sum.fetchAndAddRelaxed(usecs);
+  qint64 cmax = max.loadAcquire();
+  while(usecs > cmax && !max.testAndSetOrdered(cmax, usecs)){ cmax = max.loadAcquire(); }
+}
+
+QJsonObject MetricHistogram::summary(){
+  QJsonObject out;
+  qint64 total = 0;
+  QList<double> pcts; pcts << 0.5 << 0.9 << 0.99 << 0.999;
+  QList<qint64> vals = percentiles(pcts, &total);
+  out.insert("count", (double) total);
+  out.insert("mean_us", total>0 ? (double) sum.loadAcquire()/total : 0);
+  out.insert("p50_us", (double) vals[0]);
+  out.insert("p90_us", (double) vals[1]);
+  out.insert("p99_us", (double) vals[2]);
+  out.insert("p999_us", (double) vals[3]);
+  out.insert("max_us", (double) max.loadAcquire());
+  return out;
+}
+
+QString MetricHistogram::prometheusText(QString metric, QString name){
+  qint64 total = 0;
+  QList<double> pcts; pcts << 0.5 << 0.9 << 0.99 << 0.999;
+  QList<qint64> vals = percentiles(pcts, &total);
+  //Label values need \ " and newlines escaped
+  name.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+  QString label = "name=\""+name+"\"";
+  QStringList lines;
+  for(int i=0; i<pcts.length(); i++){
+    lines << QString("%1{%2,quantile=\"%3\"} %4").arg(metric, label, QString::number(pcts[i]), QString::number(vals[i]/1000000.0, 'f', 6));
+  }
+  lines << QString("%1_sum{%2} %3").arg(metric, label, QString::number(sum.loadAcquire()/1000000.0, 'f', 6));
+  lines << QString("%1_count{%2} %3").arg(metric, label, QString::number(total));
+  return lines.join("\n");
+}
+
+int MetricHistogram::bucketForValue(qint64 usecs){
+  if(usecs < METRIC_SUB_BUCKETS){ return usecs; } //exact values for the first few
+  int exp = 63 - __builtin_clzll(usecs); //highest bit set (>=3)
+  int sub = (usecs >> (exp-3)) & (METRIC_SUB_BUCKETS-1);
+  int bucket = (exp-2)*METRIC_SUB_BUCKETS + sub;
+  return (bucket < METRIC_BUCKETS) ? bucket : METRIC_BUCKETS-1;
+}
+
+qint64 MetricHistogram::valueForBucket(int bucket){
+  if(bucket < METRIC_SUB_BUCKETS){ return bucket; }
+  int exp = bucket/METRIC_SUB_BUCKETS + 2;
+  int sub = bucket%METRIC_SUB_BUCKETS;
+  return ((qint64) (METRIC_SUB_BUCKETS+sub)) << (exp-3);
+}
+
+QList<qint64> MetricHistogram::percentiles(QList<double> pcts, qint64 *total){
+  //Take a snapshot of the buckets first (writers keep going while we read)
+  int snap[METRIC_BUCKETS];
+  qint64 tot = 0;
+  for(int i=0; i<METRIC_BUCKETS; i++){ snap[i] = buckets[i].loadAcquire(); tot += snap[i]; }
+  *total = tot;
+  QList<qint64> out;
+  int bucket = 0;
+  qint64 seen = 0;
+  for(int p=0; p<pcts.length(); p++){
+    if(tot==0){ out << 0; continue; }
+    qint64 want = qMax((qint64) 1, (qint64) (pcts[p]*tot + 0.5) );
+    while(bucket < METRIC_BUCKETS-1 && seen + snap[bucket] < want){ seen += snap[bucket]; bucket++; }
+    //Report the middle of the bucket
+    qint64 low = valueForBucket(bucket);
+    qint64 high = (bucket < METRIC_BUCKETS-1) ? valueForBucket(bucket+1) : low;
+    out << (low + (high-low)/2);
+  }
+  return out;
+}
+
+//=================
+// Metrics (registry)
+//=================
+void Metrics::record(QString type, QString name, qint64 usecs){
+  histogram(type, name)->record(usecs);
+}
+
+MetricHistogram* Metrics::histogram(QString type, QString name){
+  QString key = type+"/"+name;
+  histLock.lockForRead();
+  MetricHistogram *H = HISTOGRAMS.value(key, 0);
+  histLock.unlock();
+  if(H!=0){ return H; }
+  //Need to create it
+  QWriteLocker lock(&histLock);
+  H = HISTOGRAMS.value(key, 0);
+  if(H==0){
+    H = new MetricHistogram();
+    HISTOGRAMS.insert(key, H);
+  }
+  return H;
+}
+
+QJsonObject Metrics::summary(){
+  QReadLocker lock(&histLock);
+  QJsonObject out;
+  QStringList keys = HISTOGRAMS.keys();
+  keys.sort();
+  for(int i=0; i<keys.length(); i++){
+    QString type = keys[i].section("/",0,0);
+    QJsonObject obj = out.value(type).toObject();
+    obj.insert(keys[i].section("/",1,-1), HISTOGRAMS.value(keys[i])->summary() );
+    out.insert(type, obj);
+  }
+  return out;
+}
+
+QString Metrics::prometheusText(){
+  QReadLocker lock(&histLock);
+  QStringList keys = HISTOGRAMS.keys();
+  keys.sort();
+  QStringList out;
+  QString lasttype;
+  for(int i=0; i<keys.length(); i++){
+    QString type = keys[i].section("/",0,0);
+    QString metric = "sysadm_"+type+"_duration_seconds";
+    if(type!=lasttype){ out << "# TYPE "+metric+" summary"; lasttype = type; }
+    out << HISTOGRAMS.value(keys[i])->prometheusText(metric, keys[i].section("/",1,-1));
+  }
+  return out.join("\n")+"\n";
+}
+
+bool Metrics::writePrometheusFile(QString path){
+  //Write the whole file at once so a scraper never sees a partial file
+  QSaveFile file(path);
+  if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)){ return false; }
+  file.write( prometheusText().toUtf8() );
+  return file.commit();
+}
+
+QString Metrics::commandName(QString command){
+  //Single-string commands include the arguments - only keep the executable (without the path)
+  return command.simplified().section(" ",0,0).section("/",-1);
+}
@@ -0,0 +1,59 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+//  Latency histograms (microseconds) for the server and library
+//  Metric types: "stage" (server request stages), "backend" (registered handler: namespace/name[/action]), "command" (executable)
+//===========================================
+#ifndef __PCBSD_LIB_UTILS_METRICS_H
+#define __PCBSD_LIB_UTILS_METRICS_H
+
+#include "sysadm-global.h"
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+
+//Log-linear buckets: 8 sub-buckets per power of 2 (~12% resolution), up to 2^40 usecs
+#define METRIC_SUB_BUCKETS 8
+#define METRIC_BUCKETS (39*METRIC_SUB_BUCKETS)
+
+namespace sysadm{
+
+//Single histogram - recording is lock-free (atomic counters only)
+class MetricHistogram{
+public:
+	MetricHistogram(){}
+	void record(qint64 usecs);
+	QJsonObject summary(); //count, mean/percentiles/max (usecs)
+	QString prometheusText(QString metric, QString name); //summary lines in the Prometheus text format
+
+private:
+	QAtomicInt buckets[METRIC_BUCKETS];
+	QAtomicInteger<qint64> count, sum, max;
+
+	static int bucketForValue(qint64 usecs);
+	static qint64 valueForBucket(int bucket); //lower bound of the bucket
+	QList<qint64> percentiles(QList<double> pcts, qint64 *total); //snapshot + walk the buckets
+};
+
+class Metrics{
+public:
+	//Record a single measurement (usecs)
+	static void record(QString type, QString name, qint64 usecs);
+	//Histogram for the given type/name (created as needed - never deleted, so callers may keep the pointer)
+	static MetricHistogram* histogram(QString type, QString name);
+
+	//Output of all the known histograms
+	static QJsonObject summary(); // <type> : { <name> : {histogram summary} }
+	static QString prometheusText();
+	static bool writePrometheusFile(QString path);
+
+	//Convert a command into the name of the executable (for "command" metrics)
+	static QString commandName(QString command);
+};
+
+} //end of sysadm namespace
+
+#endif
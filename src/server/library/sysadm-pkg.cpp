@@ -9,123 +9,483 @@
 #include "sysadm-global.h"
 #include "globals.h"
 
+#include <QAtomicInt>
+#include <QFileSystemWatcher>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThreadStorage>
+#include <QTimer>
+#include <sys/stat.h>
+
+//Max number of prepared statements kept for each open database
+#define PKG_MAX_PREPARED 64
+//Max number of assembled pkg_info replies kept for each repo catalog
+#define PKG_MAX_REPLIES 64
+
 using namespace sysadm;
 
 // ==================
 //  INLINE FUNCTIONS
 // ==================
-inline QStringList ids_from_origins(QStringList origins, QSqlDatabase DB){
-  QSqlQuery q("SELECT id FROM packages WHERE origin IN ('"+origins.join("', '")+"')",DB);
-  QStringList out;
-  while(q.next()){ out << q.value("id").toString(); }
-  return out;
+inline QString getRepoFile(QString repo){
+  if(repo=="local"){  return "/var/db/pkg/local.sqlite"; }
+  else{ return ("/var/db/pkg/repo-"+repo+".sqlite"); }
 }
+// ==================
+//  DATABASE CONNECTION POOL
+// ==================
+//Identity of a database file (changes whenever pkg updates or replaces the file)
+struct pkg_db_stamp{
+  qint64 mtime, size;
+  quint64 inode;
+  bool operator==(const pkg_db_stamp &other) const{ return (mtime==other.mtime && size==other.size && inode==other.inode); }
+};
 
-inline QStringList ids_from_names(QStringList names, QSqlDatabase DB){
-  QSqlQuery q("SELECT id FROM packages WHERE name IN ('"+names.join("', '")+"')",DB);
-  QStringList out;
-  while(q.next()){ out << q.value("id").toString(); }
-  return out;
+inline pkg_db_stamp stampForFile(QString path){
+  pkg_db_stamp stamp;
+  struct stat info;
+  if( 0 != ::stat(path.toLocal8Bit().data(), &info) ){ stamp.mtime = stamp.size = 0; stamp.inode = 0; }
+  else{
+    stamp.mtime = ((qint64) info.st_mtime)*1000000000 + info.st_mtim.tv_nsec;
+    stamp.size = info.st_size;
+    stamp.inode = info.st_ino;
+  }
+  return stamp;
 }
 
-//Get annotation variable/values
-inline void annotations_from_ids(QStringList var_ids, QStringList val_ids, QJsonObject *out, QSqlDatabase DB){
-  //Note: Both input lists *must* be the same length (one variable for one value)
-  QStringList tot; tot << var_ids << val_ids;
-  tot.removeDuplicates();
-  int index = -1;
-  QSqlQuery q("SELECT annotation, annotation_id FROM annotation WHERE annotation_id IN ('"+tot.join("', '")+"')",DB);
-    while(q.next()){
-	//qDebug() << "Got query result:" << q.value("annotation_id").toString() << q.value("annotation").toString();
-	index = var_ids.indexOf(q.value("annotation_id").toString());
-	while(index>=0){
-	  var_ids.replace(index, q.value("annotation").toString());
-	  index = var_ids.indexOf(q.value("annotation_id").toString());
-	}
-	index = val_ids.indexOf(q.value("annotation_id").toString());
-	while(index>=0){
-	  val_ids.replace(index, q.value("annotation").toString());
-	  index = val_ids.indexOf(q.value("annotation_id").toString());
-	}
+//Open (read-only) connection to a single repo database - only used by the thread which opened it
+struct pkg_db_conn{
+  QString name; //QSqlDatabase connection name
+  pkg_db_stamp stamp;
+  int users; //number of PkgDB handles using it right now
+  QHash<QString, QSqlQuery*> queries; //prepared statements (SQL text -> query)
+  QStringList tables; //temporary list tables which were created
+};
+
+//Connections for the current thread (all closed when the thread exits)
+class PkgDBPool{
+public:
+  ~PkgDBPool(){
+    QStringList repos = CONNS.keys();
+    for(int i=0; i<repos.length(); i++){ closeConnection(repos[i]); }
+  }
+
+  pkg_db_conn* connection(QString repo){
+    QString path = getRepoFile(repo);
+    pkg_db_stamp stamp = stampForFile(path);
+    pkg_db_conn *C = CONNS.value(repo,0);
+    if(C!=0 && C->users==0 && !(C->stamp==stamp) ){ closeConnection(repo); C = 0; } //file changed - start over
+    if(C==0){
+      if(stamp.inode==0){ return 0; } //file missing
+      C = new pkg_db_conn;
+        C->name = "sysadm-pkg-"+repo+QUuid::createUuid().toString();
+        C->stamp = stamp;
+        C->users = 0;
+      QSqlDatabase DB = QSqlDatabase::addDatabase("QSQLITE", C->name);
+        DB.setConnectOptions("QSQLITE_OPEN_READONLY=1");
+        DB.setHostName("localhost");
+        DB.setDatabaseName(path); //path to the database file
+      CONNS.insert(repo, C);
+      if(!DB.open()){ closeConnection(repo); return 0; }
     }
-  //Now go through and add them to the JsonObject in pairs
-  for(int i=0; i<var_ids.length(); i++){
-    //qDebug() << "Got Annotation:" << var_ids[i] <<":"<<val_ids[i];
-    out->insert(var_ids[i], val_ids[i]);
+    return C;
+  }
+
+  void closeConnection(QString repo){
+    pkg_db_conn *C = CONNS.take(repo);
+    if(C==0){ return; }
+    qDeleteAll(C->queries); //statements need to go before the database
+    { //force DB out of scope before removing it
+      QSqlDatabase DB = QSqlDatabase::database(C->name, false);
+      DB.close();
+    }
+    QSqlDatabase::removeDatabase(C->name);
+    delete C;
+  }
+
+private:
+  QHash<QString, pkg_db_conn*> CONNS; //repo -> connection
+};
+
+static QThreadStorage<PkgDBPool*> DBPOOL;
+
+//Handle to a pooled repo database for the duration of a single call
+// - any prepared statements used through it get reset (read lock released) when it goes out of scope
+class PkgDB{
+public:
+  QSqlDatabase DB;
+
+  PkgDB(QString repo){
+    if(!DBPOOL.hasLocalData()){ DBPOOL.setLocalData(new PkgDBPool()); }
+    CONN = DBPOOL.localData()->connection(repo);
+    if(CONN!=0){
+      CONN->users++;
+      DB = QSqlDatabase::database(CONN->name, false);
+    }
+  }
+  ~PkgDB(){
+    for(int i=0; i<used.length(); i++){ used[i]->finish(); }
+    if(CONN!=0){ CONN->users--; }
+  }
+
+  bool isOpen(){ return (CONN!=0 && DB.isOpen()); }
+
+  //Prepared statement for the given SQL (kept with the connection for later calls)
+  QSqlQuery* query(QString sql){
+    QSqlQuery *q = CONN->queries.value(sql,0);
+    if(q==0){
+      if(CONN->queries.count() >= PKG_MAX_PREPARED && CONN->users<2){
+        //Too many different statements - start the cache over (none are in use by another handle)
+        QList<QSqlQuery*> old = CONN->queries.values();
+        for(int i=0; i<old.length(); i++){
+          if(!used.contains(old[i])){ delete CONN->queries.take(CONN->queries.key(old[i])); }
+        }
+      }
+      q = new QSqlQuery(DB);
+      q->setForwardOnly(true);
+      q->prepare(sql);
+      CONN->queries.insert(sql, q);
+    }
+    if(!used.contains(q)){ used << q; }
+    return q;
+  }
+
+  //Load a list of values into a temporary table (single "v" column) for use as "IN (SELECT v FROM temp.<table>)"
+  // - this keeps the SQL text the same no matter how many values there are (prepared statements get re-used)
+  void setList(QString table, QStringList values){
+    if(!CONN->tables.contains(table)){
+      QSqlQuery create(DB);
+      create.exec("CREATE TEMP TABLE IF NOT EXISTS "+table+" (v PRIMARY KEY)");
+      CONN->tables << table;
+    }
+    query("DELETE FROM temp."+table)->exec();
+    QSqlQuery *ins = query("INSERT OR IGNORE INTO temp."+table+" (v) VALUES (?)");
+    for(int i=0; i<values.length(); i++){
+      ins->bindValue(0, values[i]);
+      ins->exec();
+    }
+  }
+
+  //Run a prepared statement and return the first column of every row
+  QStringList column(QString sql, QVariant bind = QVariant()){
+    QSqlQuery *q = query(sql);
+    if(!bind.isNull()){ q->bindValue(0, bind); }
+    q->exec();
+    QStringList out;
+    while(q->next()){ out << q->value(0).toString(); }
+    return out;
   }
+
+private:
+  pkg_db_conn *CONN;
+  QList<QSqlQuery*> used;
+};
+
+// ==================
+//  QUERY FUNCTIONS
+// ==================
+inline QStringList ids_from_origins(QStringList origins, PkgDB *pdb){
+  pdb->setList("origins", origins);
+  return pdb->column("SELECT id FROM packages WHERE origin IN (SELECT v FROM temp.origins)");
 }
-//Get origin from package_id (for reverse lookups)
-inline QStringList origins_from_package_ids(QStringList ids, QSqlDatabase DB){
-  QSqlQuery q("SELECT origin FROM packages WHERE id IN ('"+ids.join("', '")+"')",DB);
-  QStringList out;
-  while(q.next()){ out << q.value("origin").toString(); }
-  return out;
+
+inline QStringList ids_from_names(QStringList names, PkgDB *pdb){
+  pdb->setList("names", names);
+  return pdb->column("SELECT id FROM packages WHERE name IN (SELECT v FROM temp.names)");
 }
+
 //Generic ID's -> Names function (known databases: users, groups, licenses, shlibs, categories, packages )
-inline QStringList names_from_ids(QStringList ids, QString db, QSqlDatabase DB){
-  QSqlQuery q("SELECT name FROM "+db+" WHERE id IN ('"+ids.join("', '")+"')",DB);
-  QStringList out;
-  while(q.next()){ out << q.value("name").toString(); }
-  return out;
-}
-//provide values from ID's
-inline QStringList provides_from_ids(QStringList ids, QSqlDatabase DB){
-  QSqlQuery q("SELECT provide FROM provides WHERE id IN ('"+ids.join("', '")+"')",DB);
-  QStringList out;
-  while(q.next()){ out << q.value("provide").toString(); }
-  return out;
-}
-//require values from ID's
-inline QStringList requires_from_ids(QStringList ids, QSqlDatabase DB){
-  QSqlQuery q("SELECT require FROM requires WHERE id IN ('"+ids.join("', '")+"')", DB);
-  QStringList out;
-  while(q.next()){ out << q.value("require").toString(); }
-  return out;
+inline QStringList names_from_ids(QStringList ids, QString db, PkgDB *pdb){
+  pdb->setList("ids", ids);
+  return pdb->column("SELECT name FROM \""+db+"\" WHERE id IN (SELECT v FROM temp.ids)");
 }
 
 //conflict ID's from package ID's
-inline QStringList conflicts_from_ids(QStringList ids, QSqlDatabase DB){
-  QSqlQuery q("SELECT conflict_id FROM pkg_conflicts WHERE package_id IN ('"+ids.join("', '")+"')", DB);
-  QStringList out;
-  while(q.next()){ out << q.value("conflict_id").toString(); }
-  qDebug() << "Last Conflict detection Error:" << q.lastError().text();
-  return out;
+inline QStringList conflicts_from_ids(QStringList ids, PkgDB *pdb){
+  pdb->setList("ids", ids);
+  return pdb->column("SELECT conflict_id FROM pkg_conflicts WHERE package_id IN (SELECT v FROM temp.ids)");
 }
 
 //dependencies from package ID's
-inline QStringList depends_from_ids(QStringList ids, QSqlDatabase DB){
+inline QStringList depends_from_ids(QStringList ids, PkgDB *pdb){
   //Note: This returns package names, not ID's
-  QSqlQuery q("SELECT name FROM deps WHERE package_id IN ('"+ids.join("', '")+"')", DB);
-  QStringList out;
-  while(q.next()){ out << q.value("name").toString(); }
-  return out;
+  pdb->setList("ids", ids);
+  return pdb->column("SELECT name FROM deps WHERE package_id IN (SELECT v FROM temp.ids)");
 }
 
+//Run a "SELECT package_id, value" query and add the values as a list field of each package info
+inline void lists_to_infos(QString q_string, QString field, QHash<QString, QJsonObject> *infos, PkgDB *pdb){
+  QSqlQuery *q = pdb->query(q_string);
+  q->exec();
+  QHash<QString, QStringList> lists;
+  while(q->next()){ lists[q->value(0).toString()] << q->value(1).toString(); }
+  for(QHash<QString, QStringList>::const_iterator it = lists.constBegin(); it!=lists.constEnd(); ++it){
+    if(infos->contains(it.key())){ (*infos)[it.key()].insert(field, QJsonArray::fromStringList(it.value()) ); }
+  }
+}
 
-inline QString getRepoFile(QString repo){
-  if(repo=="local"){  return "/var/db/pkg/local.sqlite"; }
-  else{ return ("/var/db/pkg/repo-"+repo+".sqlite"); }
+// ==================
+//  SEARCH INDEX
+// ==================
+//In-memory index of the searchable package fields for a repo (read-only once built - shared by all threads)
+// - names/origins/comments: trigram -> sorted list of package numbers
+// - descriptions are only kept as lower-case text (a trigram index for them costs far too much memory)
+struct pkg_search_index{
+  pkg_db_stamp stamp;
+  QStringList pkgnames; //original case (returned by searches)
+  QVector<QString> names, origins, comments, descs; //lower case
+  QHash<QString, QVector<int> > exact; //lower case name and last section of the origin -> packages
+  QHash<quint64, QVector<int> > nameGrams, commentGrams;
+};
+
+static QHash<QString, QSharedPointer<pkg_search_index> > SEARCHINDEX; //repo -> index
+static QMutex searchMutex;
+
+inline bool containsAny(const QString &text, const QStringList &terms){
+  for(int i=0; i<terms.length(); i++){ if(text.contains(terms[i])){ return true; } }
+  return false;
 }
-inline QString openDB(QString repo){
-  //This ensures that each request for a database gets its own unique connection
-  //  (preventing conflict between concurrent calls)
-    QSqlDatabase DB = QSqlDatabase::addDatabase("QSQLITE", repo+QUuid::createUuid().toString());
-    DB.setConnectOptions("QSQLITE_OPEN_READONLY=1");
-    DB.setHostName("localhost");
-    QString path = getRepoFile(repo);
-    DB.setDatabaseName(path); //path to the database file
-    //qDebug() << "New DB:" << repo << DB.connectionName();
-  return DB.connectionName();
+
+inline bool containsAll(const QString &text, const QStringList &terms){
+  for(int i=0; i<terms.length(); i++){ if(!text.contains(terms[i])){ return false; } }
+  return true;
 }
 
-/*inline QSqlDatabase closeDB(QSqlDatabase *DB){
-  qDebug() << " - Close DB:" << DB->connectionName();
-  //completely close/remove the database connection
-  QString conn = DB->connectionName();
-  DB->close();
-  QSqlDatabase::removeDatabase(conn);
-  qDebug() << " - done closing";
-}*/
+inline quint64 trigram(const QString &text, int pos){
+  return ( ((quint64) text[pos].unicode())<<32 ) | ( ((quint64) text[pos+1].unicode())<<16 ) | text[pos+2].unicode();
+}
+
+inline void addTrigrams(QHash<quint64, QVector<int> > *grams, const QString &text, int num){
+  for(int i=0; i+2<text.length(); i++){
+    QVector<int> &list = (*grams)[trigram(text,i)];
+    if(list.isEmpty() || list.last()!=num){ list << num; } //packages get added in order - list stays sorted
+  }
+}
+
+//Packages which might contain the term (needs to be verified) - returns false if the index cannot narrow it down
+inline bool trigramCandidates(const QHash<quint64, QVector<int> > &grams, const QString &term, QVector<int> *out){
+  if(term.length()<3){ return false; }
+  out->clear();
+  for(int i=0; i+2<term.length(); i++){
+    QVector<int> list = grams.value(trigram(term,i));
+    if(i==0){ *out = list; }
+    else{
+      //Intersect the two sorted lists
+      QVector<int> tmp;
+      int a=0, b=0;
+      while(a<out->length() && b<list.length()){
+        if((*out)[a] < list[b]){ a++; }
+        else if((*out)[a] > list[b]){ b++; }
+        else{ tmp << list[b]; a++; b++; }
+      }
+      *out = tmp;
+    }
+    if(out->isEmpty()){ break; }
+  }
+  return true;
+}
+
+static QSharedPointer<pkg_search_index> searchIndex(QString repo, PkgDB *pdb){
+  pkg_db_stamp stamp = stampForFile(getRepoFile(repo));
+  QMutexLocker lock(&searchMutex);
+  QSharedPointer<pkg_search_index> index = SEARCHINDEX.value(repo);
+  if(!index.isNull() && index->stamp==stamp){ return index; }
+  //(Re)build the index for this repo
+  index = QSharedPointer<pkg_search_index>(new pkg_search_index);
+  index->stamp = stamp;
+  QSqlQuery *q = pdb->query("SELECT name, origin, comment, desc FROM packages ORDER BY id");
+  q->exec();
+  while(q->next()){
+    int num = index->pkgnames.length();
+    QString name = q->value(0).toString();
+    index->pkgnames << name;
+    index->names << name.toLower();
+    index->origins << q->value(1).toString().toLower();
+    index->comments << q->value(2).toString().toLower();
+    index->descs << q->value(3).toString().toLower();
+    index->exact[index->names[num]] << num;
+    QString base = index->origins[num].section("/",-1);
+    if(base!=index->names[num]){ index->exact[base] << num; }
+    addTrigrams(&index->nameGrams, index->names[num], num);
+    addTrigrams(&index->commentGrams, index->comments[num], num);
+  }
+  q->finish();
+  SEARCHINDEX.insert(repo, index);
+  return index;
+}
+
+// ==================
+//  CATEGORY CACHE
+// ==================
+struct pkg_category_cache{
+  pkg_db_stamp stamp;
+  QStringList names; //categories which contain packages
+  QJsonObject counts; //category -> number of packages
+  pkg_category_cache(){ stamp.mtime = stamp.size = 0; stamp.inode = 0; }
+};
+
+static QHash<QString, pkg_category_cache> CATEGORIES; //repo -> categories
+static QMutex categoryMutex;
+
+// ==================
+//  PACKAGE CATALOG
+// ==================
+//Strings stored once no matter how many packages use them (versions, maintainers, prefixes, ...)
+class pkg_string_pool{
+public:
+  int intern(const QString &str){
+    int num = index.value(str, -1);
+    if(num<0){ num = strings.length(); strings << str; index.insert(str, num); }
+    return num;
+  }
+  const QString& at(int num) const{ return strings[num]; }
+private:
+  QVector<QString> strings;
+  QHash<QString, int> index;
+};
+
+//In-memory copy of the basic package records for a repo (the "simple" pkg_info results)
+// - read-only once built (shared by all threads), except for the cache of assembled replies
+struct pkg_catalog{
+  pkg_db_stamp stamp;
+  QStringList fields; //columns of the packages table
+  int nameCol;
+  pkg_string_pool strings;
+  QVector< QVector<int> > columns; //[field][package] -> string
+  QVector<int> annStart, annTags, annVals; //annotations of package N: annStart[N] to annStart[N+1]
+  QHash<QString, int> byName; //package name -> package
+  QHash<QString, QVector<int> > byCategory; //category (lower case - the SQL used LIKE) -> packages
+  QMutex replyMutex;
+  QHash<QString, QJsonObject> replies; //category ("" for everything) -> assembled reply
+
+  QJsonObject record(int num) const{
+    QJsonObject info;
+    for(int i=0; i<fields.length(); i++){ info.insert(fields[i], strings.at(columns[i][num])); }
+    for(int i=annStart[num]; i<annStart[num+1]; i++){ info.insert(strings.at(annTags[i]), strings.at(annVals[i])); }
+    return info;
+  }
+};
+
+static QHash<QString, QSharedPointer<pkg_catalog> > CATALOGS; //repo -> catalog
+static QMutex catalogMutex;
+
+//Drop all the cached repo data as soon as pkg touches the databases (the file stamps are still checked on each use)
+static void addRepoWatches(QFileSystemWatcher *watcher){
+  //Replaced files are no longer watched - add them again
+  QDir dir("/var/db/pkg");
+  QStringList files = dir.entryList(QStringList() << "*.sqlite", QDir::Files);
+  for(int i=0; i<files.length(); i++){
+    QString path = dir.absoluteFilePath(files[i]);
+    if(!watcher->files().contains(path)){ watcher->addPath(path); }
+  }
+}
+
+static void watchRepoFiles(){
+  static QAtomicInt started(0);
+  if(!started.testAndSetOrdered(0,1) || QCoreApplication::instance()==0){ return; }
+  //The watcher lives in the main thread (notifications come through the main event loop)
+  QTimer::singleShot(0, QCoreApplication::instance(), [](){
+    QFileSystemWatcher *watcher = new QFileSystemWatcher(QCoreApplication::instance());
+    watcher->addPath("/var/db/pkg");
+    addRepoWatches(watcher);
+    auto changed = [watcher](const QString&){
+      { QMutexLocker lock(&catalogMutex); CATALOGS.clear(); }
+      { QMutexLocker lock(&searchMutex); SEARCHINDEX.clear(); }
+      { QMutexLocker lock(&categoryMutex); CATEGORIES.clear(); }
+      addRepoWatches(watcher);
+    };
+    QObject::connect(watcher, &QFileSystemWatcher::directoryChanged, watcher, changed);
+    QObject::connect(watcher, &QFileSystemWatcher::fileChanged, watcher, changed);
+  });
+}
+
+static QSharedPointer<pkg_catalog> catalog(QString repo, PkgDB *pdb){
+  watchRepoFiles();
+  pkg_db_stamp stamp = stampForFile(getRepoFile(repo));
+  QMutexLocker lock(&catalogMutex);
+  QSharedPointer<pkg_catalog> cat = CATALOGS.value(repo);
+  if(!cat.isNull() && cat->stamp==stamp){ return cat; }
+  //(Re)build the catalog for this repo
+  cat = QSharedPointer<pkg_catalog>(new pkg_catalog);
+  cat->stamp = stamp;
+  cat->nameCol = -1;
+  QHash<QString, int> byID; //package id -> package
+  QSqlQuery *q = pdb->query("SELECT * FROM packages ORDER BY id");
+  q->exec();
+  int idcol = -1, namecol = -1, origincol = -1;
+  while(q->next()){
+    if(cat->fields.isEmpty()){
+      QSqlRecord rec = q->record();
+      for(int i=0; i<rec.count(); i++){ cat->fields << rec.fieldName(i); }
+      cat->columns.resize(cat->fields.length());
+      idcol = cat->fields.indexOf("id");
+      namecol = cat->nameCol = cat->fields.indexOf("name");
+      origincol = cat->fields.indexOf("origin");
+    }
+    if(idcol<0 || namecol<0 || origincol<0){ break; } //unknown schema
+    QString id = q->value(idcol).toString();
+    QString name = q->value(namecol).toString();
+    if(id.isEmpty() || name.isEmpty()){ continue; }
+    int num = byID.count();
+    for(int i=0; i<cat->fields.length(); i++){ cat->columns[i] << cat->strings.intern(q->value(i).toString()); }
+    byID.insert(id, num);
+    cat->byName.insert(name, num);
+    cat->byCategory[ q->value(origincol).toString().section("/",0,0).toLower() ] << num;
+  }
+  q->finish();
+  //Annotations (flattened - in package order)
+  QVector< QVector<int> > ann(byID.count());
+  q = pdb->query("SELECT pkg_annotation.package_id, tag.annotation, val.annotation FROM pkg_annotation"
+	" INNER JOIN annotation AS tag ON pkg_annotation.tag_id = tag.annotation_id"
+	" INNER JOIN annotation AS val ON pkg_annotation.value_id = val.annotation_id");
+  q->exec();
+  while(q->next()){
+    int num = byID.value(q->value(0).toString(), -1);
+    if(num<0){ continue; }
+    ann[num] << cat->strings.intern(q->value(1).toString()) << cat->strings.intern(q->value(2).toString());
+  }
+  q->finish();
+  cat->annStart.reserve(ann.length()+1);
+  for(int i=0; i<ann.length(); i++){
+    cat->annStart << cat->annTags.length();
+    for(int j=0; j+1<ann[i].length(); j+=2){ cat->annTags << ann[i][j]; cat->annVals << ann[i][j+1]; }
+  }
+  cat->annStart << cat->annTags.length();
+  CATALOGS.insert(repo, cat);
+  return cat;
+}
+
+// ==================
+//  REPO CONFIG CACHE
+// ==================
+//Enabled repos from the pkg config files (reparsed only when a file in the config dir changes)
+struct pkg_repo_conf{
+  QStringList stamps; //"<file>:<modification time>" of each config file
+  QStringList enabled;
+};
+static pkg_repo_conf REPOCONF;
+static QString REPOUPDATE; //ID of the "pkg update" started by list_repos() (empty: none in flight)
+static QMutex repoMutex;
+
+static QStringList enabledRepos(){
+  QDir confdir("/usr/local/etc/pkg/repos");
+  QFileInfoList confs = confdir.entryInfoList(QStringList() << "*.conf", QDir::Files, QDir::Name);
+  QStringList stamps;
+  for(int i=0; i<confs.length(); i++){ stamps << confs[i].fileName()+":"+QString::number(confs[i].lastModified().toMSecsSinceEpoch()); }
+  QMutexLocker lock(&repoMutex);
+  if(stamps.isEmpty() || stamps!=REPOCONF.stamps){
+    REPOCONF.stamps = stamps;
+    REPOCONF.enabled.clear();
+    for(int i=0; i<confs.length(); i++){
+      QStringList repoinfo = General::readTextFile(confs[i].absoluteFilePath()).join("\n").split("}");
+      for(int j=0; j<repoinfo.length(); j++){
+        QString repo = repoinfo[j].section(":",0,0).simplified();
+        if(!repo.isEmpty() && repoinfo[j].section("enabled:",1,-1).section(":",0,0).contains("true")){ REPOCONF.enabled << repo; }
+      }
+    }
+  }
+  return REPOCONF.enabled;
+}
 
 // =================
 //  MAIN FUNCTIONS
@@ -133,260 +493,266 @@ inline QString openDB(QString repo){
 QJsonObject PKG::pkg_info(QStringList origins, QString repo, QString category, bool fullresults){
   QJsonObject retObj;
   //if(origins.contains("math/R")){ qDebug() << "pkg_info:" << repo << category; }
-  QString dbconn = openDB(repo);
-  if(!dbconn.isEmpty()){
-  QSqlDatabase DB = QSqlDatabase::database(dbconn);
-  if(!DB.isOpen()){ return retObj; } //could not open DB (file missing?)
-  //Now do all the pkg info, one pkg origin at a time
+  PkgDB pdb(repo);
+  if(!pdb.isOpen()){ return retObj; } //could not open DB (file missing?)
+  //Now do all the pkg info, one table at a time (for all the packages at once)
   origins.removeAll("");
   origins.removeDuplicates();
-    QString q_string = "SELECT * FROM packages";
+  if(!fullresults){
+    //Basic info/annotations only: answer from the in-memory catalog
+    QSharedPointer<pkg_catalog> cat = catalog(repo, &pdb);
     if(!origins.isEmpty()){
-      q_string.append(" WHERE name IN ('"+origins.join("', '")+"')");
-      //Also keep the ordering of the origins preserved
-      /*q_string.append(" ORDER BY CASE origins ");
-      for(int i=0; i<origins.length(); i++){ q_string.append("WHEN '"+origins[i]+"' THEN '"+QString::number(i+1)+"' "); }
-      q_string.append("END");*/
+      for(int i=0; i<origins.length(); i++){
+        int num = cat->byName.value(origins[i], -1);
+        if(num>=0){ retObj.insert(origins[i], cat->record(num)); }
+      }
+      return retObj;
     }
-    else if(!category.isEmpty()){ q_string.append(" WHERE origin LIKE '"+category+"/%'"); }
-    //if(origins.contains("math/R")){ qDebug() << "Query:" << q_string; }
-  QSqlQuery query(q_string, DB);
-    while(query.next()){
-	QString id = query.value("id").toString(); //need this pkg id for later
-	QString name = query.value("name").toString(); //need the origin for later
-	//if(origins.contains("math/R")){ qDebug() << "Found origin:" << origin << id; }
+    QString catkey = category.toLower(); //case-insensitive, like the "origin LIKE" query
+    QMutexLocker lock(&cat->replyMutex);
+    if(cat->replies.contains(catkey)){ return cat->replies.value(catkey); }
+    QVector<int> rows;
+    if(!catkey.isEmpty()){ rows = cat->byCategory.value(catkey); }
+    else{ rows.reserve(cat->byName.count()); for(int i=0; i+1<cat->annStart.length(); i++){ rows << i; } }
+    for(int i=0; i<rows.length(); i++){
+      retObj.insert(cat->strings.at(cat->columns[cat->nameCol][rows[i]]), cat->record(rows[i]));
+    }
+    if(cat->replies.count() >= PKG_MAX_REPLIES){ cat->replies.clear(); }
+    cat->replies.insert(catkey, retObj);
+    return retObj;
+  }
+  QSqlQuery *query = 0;
+    if(!origins.isEmpty()){
+      pdb.setList("names", origins);
+      query = pdb.query("SELECT * FROM packages WHERE name IN (SELECT v FROM temp.names)");
+    }else if(!category.isEmpty()){
+      query = pdb.query("SELECT * FROM packages WHERE origin LIKE ?");
+      query->bindValue(0, category+"/%");
+    }else{
+      query = pdb.query("SELECT * FROM packages");
+    }
+  //General info
+  QHash<QString, QJsonObject> infos; //package id -> info
+  QHash<QString, QString> names; //package id -> name
+  query->exec();
+    while(query->next()){
+	QString id = query->value("id").toString(); //need this pkg id for later
+	QString name = query->value("name").toString(); //need the origin for later
       if(id.isEmpty() || name.isEmpty()){ continue; }
       QJsonObject info;
-      //General info
-      for(int i=0; i<query.record().count(); i++){
-        info.insert(query.record().fieldName(i), query.value(i).toString() );
-      }
-      //ANNOTATIONS
-      QSqlQuery q2("SELECT tag_id, value_id FROM pkg_annotation WHERE package_id = '"+id+"'", DB);
-      QStringList tags, vals; //both the value and the variable are id tags to entries in the annotations table.
-      while(q2.next()){
-	  tags << q2.value("tag_id").toString(); vals << q2.value("value_id").toString();
+      QSqlRecord rec = query->record();
+      for(int i=0; i<rec.count(); i++){
+        info.insert(rec.fieldName(i), query->value(i).toString() );
       }
-      if(!tags.isEmpty()){ annotations_from_ids(tags, vals, &info, DB); }
-      if(!fullresults){ retObj.insert(name,info); continue; } //skip the rest of the info queries
+      infos.insert(id, info);
+      names.insert(id, name);
+  }
+  if(!infos.isEmpty()){
+    //All the other tables are matched against the same set of packages (temp.pkg_ids)
+    pdb.setList("pkg_ids", infos.keys());
+    //ANNOTATIONS (both the value and the variable are id tags to entries in the annotations table)
+    QSqlQuery *q2 = pdb.query("SELECT pkg_annotation.package_id, tag.annotation AS tag, val.annotation AS val FROM pkg_annotation"
+	" INNER JOIN annotation AS tag ON pkg_annotation.tag_id = tag.annotation_id"
+	" INNER JOIN annotation AS val ON pkg_annotation.value_id = val.annotation_id"
+	" WHERE pkg_annotation.package_id IN (SELECT v FROM temp.pkg_ids)");
+    q2->exec();
+    while(q2->next()){
+      QString id = q2->value(0).toString();
+      if(infos.contains(id)){ infos[id].insert(q2->value(1).toString(), q2->value(2).toString()); }
+    }
+    if(fullresults){
       //OPTIONS
-      QSqlQuery q3("SELECT value, option FROM pkg_option INNER JOIN option ON pkg_option.option_id = option.option_id WHERE pkg_option.package_id = '"+id+"'", DB);
-      QJsonObject options;
-      while(q3.next()){
-	//for(int r=0; r<q3.record().count(); r++){ qDebug() << "Field:" << q3.record().fieldName(r); qDebug() << "Value:" << q3.record().value(r).toString(); }
-	options.insert(q3.value("option").toString(), q3.value("value").toString());
+      QSqlQuery *q3 = pdb.query("SELECT pkg_option.package_id, option, value FROM pkg_option INNER JOIN option ON pkg_option.option_id = option.option_id WHERE pkg_option.package_id IN (SELECT v FROM temp.pkg_ids)");
+      q3->exec();
+      QHash<QString, QJsonObject> options;
+      while(q3->next()){
+        options[q3->value(0).toString()].insert(q3->value(1).toString(), q3->value(2).toString());
       }
-      if(!options.isEmpty()){ info.insert("options",options); }
-      //DEPENDENCIES
-      QSqlQuery q4("SELECT origin, name FROM deps WHERE package_id = '"+id+"'", DB);
-      QStringList tmpList, tmpListN;
-       while(q4.next()){
-	  tmpList << q4.value("origin").toString();
-           tmpListN << q4.value("name").toString();
-      } //end deps query
-      if(!tmpList.isEmpty()){
-        //info.insert("dependencies_origins", QJsonArray::fromStringList(tmpList) );
-        info.insert("dependencies", QJsonArray::fromStringList(tmpListN) );
+      for(QHash<QString, QJsonObject>::const_iterator it = options.constBegin(); it!=options.constEnd(); ++it){
+        if(infos.contains(it.key())){ infos[it.key()].insert("options", it.value()); }
       }
+      //DEPENDENCIES
+      lists_to_infos("SELECT package_id, name FROM deps WHERE package_id IN (SELECT v FROM temp.pkg_ids)", "dependencies", &infos, &pdb);
       //FILES
-      QSqlQuery q5("SELECT path FROM files WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q5.next()){  tmpList << q5.value("path").toString(); }
-      if(!tmpList.isEmpty()){ info.insert("files", QJsonArray::fromStringList(tmpList) ); }
-      //REVERSE DEPENDENCIES
-      QSqlQuery q6("SELECT package_id FROM deps WHERE name = '"+name+"'", DB);
-      tmpList.clear();
-       while(q6.next()){ tmpList << q6.value("package_id").toString(); }
-       if(!tmpList.isEmpty()){
-         //info.insert("reverse_dependencies_origins", QJsonArray::fromStringList(origins_from_package_ids(tmpList, DB)) );
-         info.insert("reverse_dependencies", QJsonArray::fromStringList(names_from_ids(tmpList, "packages", DB)) );
-       }
-       //USERS
-      QSqlQuery q7("SELECT user_id FROM pkg_users WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q7.next()){ tmpList << q7.value("user_id").toString(); }
-       if(!tmpList.isEmpty()){ info.insert("users", QJsonArray::fromStringList(names_from_ids(tmpList, "users", DB)) ); }
-       //GROUPS
-      QSqlQuery q8("SELECT group_id FROM pkg_groups WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q8.next()){ tmpList << q8.value("group_id").toString(); }
-       if(!tmpList.isEmpty()){ info.insert("groups", QJsonArray::fromStringList(names_from_ids(tmpList, "users", DB)) ); }
-       //LICENSES
-      QSqlQuery q9("SELECT license_id FROM pkg_licenses WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q9.next()){ tmpList << q9.value("license_id").toString(); }
-       if(!tmpList.isEmpty()){ info.insert("licenses", QJsonArray::fromStringList(names_from_ids(tmpList, "licenses", DB)) ); }
-       //SHARED LIBS (REQUIRED)
-      QSqlQuery q10("SELECT shlib_id FROM pkg_shlibs_required WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q10.next()){ tmpList << q10.value("shlib_id").toString(); }
-       if(!tmpList.isEmpty()){ info.insert("shlibs_required", QJsonArray::fromStringList(names_from_ids(tmpList, "shlibs", DB)) ); }
-       //SHARED LIBS (PROVIDED)
-      QSqlQuery q11("SELECT shlib_id FROM pkg_shlibs_provided WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q11.next()){ tmpList << q11.value("shlib_id").toString(); }
-       if(!tmpList.isEmpty()){ info.insert("shlibs_provided", QJsonArray::fromStringList(names_from_ids(tmpList, "shlibs", DB)) ); }
-       //CONFLICTS
-      QSqlQuery q12("SELECT conflict_id FROM pkg_conflicts WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q12.next()){ tmpList << q12.value("conflict_id").toString(); }
-       if(!tmpList.isEmpty()){ info.insert("conflicts", QJsonArray::fromStringList(origins_from_package_ids(tmpList, DB)) ); }
+      lists_to_infos("SELECT package_id, path FROM files WHERE package_id IN (SELECT v FROM temp.pkg_ids)", "files", &infos, &pdb);
+      //REVERSE DEPENDENCIES (matched by the name of the dependency)
+      QSqlQuery *q6 = pdb.query("SELECT deps.name, packages.name FROM deps INNER JOIN packages ON deps.package_id = packages.id WHERE deps.name IN (SELECT name FROM packages WHERE id IN (SELECT v FROM temp.pkg_ids))");
+      q6->exec();
+      QHash<QString, QStringList> rdeps; //name -> reverse dependency names
+      while(q6->next()){ rdeps[q6->value(0).toString()] << q6->value(1).toString(); }
+      for(QHash<QString, QString>::const_iterator it = names.constBegin(); it!=names.constEnd(); ++it){
+        if(rdeps.contains(it.value())){ infos[it.key()].insert("reverse_dependencies", QJsonArray::fromStringList(rdeps.value(it.value())) ); }
+      }
+      //USERS
+      lists_to_infos("SELECT pkg_users.package_id, users.name FROM pkg_users INNER JOIN users ON pkg_users.user_id = users.id WHERE pkg_users.package_id IN (SELECT v FROM temp.pkg_ids)", "users", &infos, &pdb);
+      //GROUPS
+      lists_to_infos("SELECT pkg_groups.package_id, \"groups\".name FROM pkg_groups INNER JOIN \"groups\" ON pkg_groups.group_id = \"groups\".id WHERE pkg_groups.package_id IN (SELECT v FROM temp.pkg_ids)", "groups", &infos, &pdb);
+      //LICENSES
+      lists_to_infos("SELECT pkg_licenses.package_id, licenses.name FROM pkg_licenses INNER JOIN licenses ON pkg_licenses.license_id = licenses.id WHERE pkg_licenses.package_id IN (SELECT v FROM temp.pkg_ids)", "licenses", &infos, &pdb);
+      //SHARED LIBS (REQUIRED)
+      lists_to_infos("SELECT pkg_shlibs_required.package_id, shlibs.name FROM pkg_shlibs_required INNER JOIN shlibs ON pkg_shlibs_required.shlib_id = shlibs.id WHERE pkg_shlibs_required.package_id IN (SELECT v FROM temp.pkg_ids)", "shlibs_required", &infos, &pdb);
+      //SHARED LIBS (PROVIDED)
+      lists_to_infos("SELECT pkg_shlibs_provided.package_id, shlibs.name FROM pkg_shlibs_provided INNER JOIN shlibs ON pkg_shlibs_provided.shlib_id = shlibs.id WHERE pkg_shlibs_provided.package_id IN (SELECT v FROM temp.pkg_ids)", "shlibs_provided", &infos, &pdb);
+      //CONFLICTS
+      lists_to_infos("SELECT pkg_conflicts.package_id, packages.origin FROM pkg_conflicts INNER JOIN packages ON pkg_conflicts.conflict_id = packages.id WHERE pkg_conflicts.package_id IN (SELECT v FROM temp.pkg_ids)", "conflicts", &infos, &pdb);
       //CONFIG FILES
-      QSqlQuery q13("SELECT path FROM config_files WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q13.next()){  tmpList << q13.value("path").toString(); }
-      if(!tmpList.isEmpty()){ info.insert("config_files", QJsonArray::fromStringList(tmpList) ); }
+      lists_to_infos("SELECT package_id, path FROM config_files WHERE package_id IN (SELECT v FROM temp.pkg_ids)", "config_files", &infos, &pdb);
       //PROVIDES
-      QSqlQuery q14("SELECT provide_id FROM pkg_provides WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q14.next()){ tmpList << q14.value("provide_id").toString(); }
-       if(!tmpList.isEmpty()){ info.insert("provides", QJsonArray::fromStringList(provides_from_ids(tmpList, DB)) ); }
+      lists_to_infos("SELECT pkg_provides.package_id, provides.provide FROM pkg_provides INNER JOIN provides ON pkg_provides.provide_id = provides.id WHERE pkg_provides.package_id IN (SELECT v FROM temp.pkg_ids)", "provides", &infos, &pdb);
       //REQUIRES
-      QSqlQuery q15("SELECT require_id FROM pkg_requires WHERE package_id = '"+id+"'", DB);
-      tmpList.clear();
-       while(q15.next()){ tmpList << q15.value("require_id").toString(); }
-       if(!tmpList.isEmpty()){ info.insert("requires", QJsonArray::fromStringList(requires_from_ids(tmpList, DB)) ); }\
-       //Now insert this information into the main object
-       retObj.insert(name,info);
-  } //end loop over pkg matches
-  DB.close();
-  }//end if dbconn exists (force DB out of scope now)
-  //closeDB(&DB);
-  QSqlDatabase::removeDatabase(dbconn);
+      lists_to_infos("SELECT pkg_requires.package_id, requires.require FROM pkg_requires INNER JOIN requires ON pkg_requires.require_id = requires.id WHERE pkg_requires.package_id IN (SELECT v FROM temp.pkg_ids)", "requires", &infos, &pdb);
+    }
+    //Now insert all the information into the main object
+    for(QHash<QString, QJsonObject>::const_iterator it = infos.constBegin(); it!=infos.constEnd(); ++it){
+      retObj.insert(names.value(it.key()), it.value());
+    }
+  }
   return retObj;
 }
 
 QStringList PKG::pkg_search(QString repo, QString searchterm, QStringList searchexcludes, QString category){
-  QString dbconn = openDB(repo);
-  QStringList found;
-  if(!dbconn.isEmpty()){
-  QSqlDatabase DB = QSqlDatabase::database(dbconn);
-  if(!DB.isOpen()){ return QStringList(); } //could not open DB (file missing?)
-
+  PkgDB pdb(repo);
+  if(!pdb.isOpen()){ return QStringList(); } //could not open DB (file missing?)
+  QSharedPointer<pkg_search_index> index = searchIndex(repo, &pdb);
+  //Everything is matched case-insensitive
+  searchterm = searchterm.toLower().simplified();
   QStringList terms = searchterm.split(" ",QString::SkipEmptyParts);
+  if(terms.isEmpty()){ return QStringList(); }
   searchexcludes.removeAll("");
-  QString q_string;
-int numtry = 0;
-while(found.isEmpty() && numtry<2){
-  if(numtry<1 && !searchterm.contains(" ")){ //single-word-search (exact names never have multiple words)
-    q_string = "SELECT name FROM packages WHERE name = '"+searchterm+"' OR origin LIKE '%/"+searchterm+"'";
-    if(!category.isEmpty()){ q_string.append(" AND origin LIKE '"+category+"/%'"); }
-    if(!searchexcludes.isEmpty()){ q_string.append(" AND name NOT LIKE '%"+searchexcludes.join("%' AND name NOT LIKE '%")+"%'"); }
-    q_string.append(" COLLATE NOCASE"); // Case insensitive
-    QSqlQuery query(q_string, DB);
-    while(query.next()){
-	found << query.value("name").toString(); //need the origin for later
-    }
-  }
-  if(found.length()<60 && numtry<1){
-    //Expand the search to names containing the term
-    q_string = "SELECT name FROM packages WHERE name LIKE '"+searchterm+"%'";
-    if(!category.isEmpty()){ q_string.append(" AND origin LIKE '"+category+"/%'"); }
-    if(!searchexcludes.isEmpty()){ q_string.append(" AND name NOT LIKE '%"+searchexcludes.join("%' AND name NOT LIKE '%")+"%'"); }
-    QSqlQuery q2(q_string, DB);
-    while(q2.next()){
-	found << q2.value("name").toString(); //need the origin for later
-    }
-  }
-  if(found.length()<60 && numtry<1){
-    //Expand the search to names containing the term
-    q_string = "SELECT name FROM packages WHERE name LIKE '%"+searchterm+"%'";
-    if(!category.isEmpty()){ q_string.append(" AND origin LIKE '"+category+"/%'"); }
-    if(!searchexcludes.isEmpty()){ q_string.append(" AND name NOT LIKE '%"+searchexcludes.join("%' AND name NOT LIKE '%")+"%'"); }
-    QSqlQuery q2(q_string, DB);
-    while(q2.next()){
-	found << q2.value("name").toString(); //need the origin for later
+  for(int i=0; i<searchexcludes.length(); i++){ searchexcludes[i] = searchexcludes[i].toLower(); }
+  QString catprefix = category.toLower()+"/";
+  const int total = index->names.length();
+
+  //Rank every candidate package in a single pass over the index:
+  // 0: exact name (or origin), 1: name prefix, 2: name contains, 3: comment, 4: description
+  QVector<int> ranks(total, -1);
+  QVector<int> counts(5, 0);
+  QVector<int> cand;
+  for(int numtry=0; numtry<2 && counts[0]+counts[1]+counts[2]+counts[3]+counts[4]==0; numtry++){
+    //Names (first try only)
+    if(numtry==0){
+      if(!searchterm.contains(" ")){ //single-word-search (exact names never have multiple words)
+        QVector<int> exact = index->exact.value(searchterm);
+        for(int i=0; i<exact.length(); i++){
+          int num = exact[i];
+          if(ranks[num]>=0 || (!category.isEmpty() && !index->origins[num].startsWith(catprefix)) ){ continue; }
+          if(containsAny(index->names[num], searchexcludes)){ continue; }
+          ranks[num] = 0; counts[0]++;
+        }
+      }
+      bool useIndex = trigramCandidates(index->nameGrams, searchterm, &cand);
+      int max = useIndex ? cand.length() : total;
+      for(int i=0; i<max; i++){
+        int num = useIndex ? cand[i] : i;
+        if(ranks[num]>=0 || !index->names[num].contains(searchterm)){ continue; }
+        if(!category.isEmpty() && !index->origins[num].startsWith(catprefix)){ continue; }
+        if(containsAny(index->names[num], searchexcludes)){ continue; }
+        int rank = index->names[num].startsWith(searchterm) ? 1 : 2;
+        ranks[num] = rank; counts[rank]++;
+      }
+      //Same limits as the staged searches: only expand to the next stage while few results are found
+      for(int rank=1; rank<3; rank++){
+        int found = (rank==1) ? counts[0] : counts[0]+counts[1];
+        if(found < 60 || counts[rank]==0){ continue; }
+        counts[rank] = 0;
+        for(int i=0; i<total; i++){ if(ranks[i]==rank){ ranks[i] = -1; } }
+      }
     }
-  }
-  if(found.length()<60){
-    //Expand the search to comments
-    if(terms.length()<2){ q_string = "SELECT nameFROM packages WHERE comment LIKE '%"+searchterm+"%'"; }
-    else if(numtry==0){ q_string = "SELECT name FROM packages WHERE comment LIKE '%"+terms.join("%' AND comment LIKE '%")+"%'"; }
-    else if(numtry==1){ q_string = "SELECT name FROM packages WHERE comment LIKE '%"+terms.join("%' OR comment LIKE '%")+"%'"; }
-    if(!category.isEmpty()){ q_string.append(" AND origin LIKE '"+category+"/%'"); }
-    if(!searchexcludes.isEmpty()){ q_string.append(" AND comment NOT LIKE '%"+searchexcludes.join("%' AND comment NOT LIKE '%")+"%'"); }
-    QSqlQuery q2(q_string, DB);
-    while(q2.next()){
-	found << q2.value("name").toString(); //need the origin for later
+    //Comments, then descriptions (all terms on the first try, any term on the second)
+    for(int stage=3; stage<5; stage++){
+      int found = counts[0]+counts[1]+counts[2]+counts[3];
+      if(found >= (stage==3 ? 60 : 100)){ break; }
+      const QVector<QString> &field = (stage==3) ? index->comments : index->descs;
+      bool useIndex = false;
+      if(stage==3 && (terms.length()<2 || numtry==0) ){
+        //All terms need to match - the index of the longest term narrows it down the most
+        QString longest = (terms.length()<2) ? searchterm : terms.first();
+        for(int i=1; i<terms.length(); i++){ if(terms[i].length() > longest.length()){ longest = terms[i]; } }
+        useIndex = trigramCandidates(index->commentGrams, longest, &cand);
+      }
+      int max = useIndex ? cand.length() : total;
+      for(int i=0; i<max; i++){
+        int num = useIndex ? cand[i] : i;
+        if(ranks[num]>=0){ continue; }
+        bool match = false;
+        if(terms.length()<2){ match = field[num].contains(searchterm); }
+        else if(numtry==0){ match = containsAll(field[num], terms); }
+        else{ match = containsAny(field[num], terms); }
+        if(!match){ continue; }
+        if(!category.isEmpty() && !index->origins[num].startsWith(catprefix)){ continue; }
+        if(containsAny(field[num], searchexcludes)){ continue; }
+        ranks[num] = stage; counts[stage]++;
+      }
     }
   }
-  if(found.length()<100){
-    //Expand the search to full descriptions
-    if(terms.length()<2){ q_string = "SELECT name FROM packages WHERE desc LIKE '%"+searchterm+"%'"; }
-    else if(numtry==0){ q_string = "SELECT name FROM packages WHERE desc LIKE '%"+terms.join("%' AND desc LIKE '%")+"%'"; }
-    else if(numtry==1){ q_string = "SELECT name FROM packages WHERE desc LIKE '%"+terms.join("%' OR desc LIKE '%")+"%'"; }
-    if(!category.isEmpty()){ q_string.append(" AND origin LIKE '"+category+"/%'"); }
-    if(!searchexcludes.isEmpty()){ q_string.append(" AND desc NOT LIKE '%"+searchexcludes.join("%' AND desc NOT LIKE '%")+"%'"); }
-    QSqlQuery q2(q_string, DB);
-    while(q2.next()){
-	found << q2.value("name").toString(); //need the origin for later
+  //Now assemble the results in rank order
+  QStringList found;
+  for(int rank=0; rank<5; rank++){
+    if(counts[rank]==0){ continue; }
+    for(int i=0; i<total; i++){
+      if(ranks[i]==rank){ found << index->pkgnames[i]; }
     }
   }
-  //Now bump the try count
-  numtry++;
-} //end while loop  for number of tries
   //if(searchterm=="R"){ qDebug()<< "Search:" << searchterm << category << found; }
-  //disable open queries before closing DB
-  DB.close();
-  //closeDB(&DB);
- }//end if dbconn exists (force DB out of scope now)
-  QSqlDatabase::removeDatabase(dbconn);
   found.removeDuplicates();
   return found;
 }
 
-QJsonArray PKG::list_categories(QString repo){
-  QString dbconn = openDB(repo);
-  QStringList found;
-  if(!dbconn.isEmpty()){
-  QSqlDatabase DB = QSqlDatabase::database(dbconn);
-  if(!DB.isOpen()){ return QJsonArray(); } //could not open DB (file missing?)
-
-  //Get all the pkg origins for this repo
-  QStringList origins;
-    QSqlQuery q_o("SELECT origin FROM packages", DB);
-    while(q_o.next()){
-	origins << q_o.value("origin").toString(); //need the origin for later
+QJsonArray PKG::list_categories(QString repo, QJsonObject *counts){
+  pkg_db_stamp stamp = stampForFile(getRepoFile(repo));
+  QMutexLocker lock(&categoryMutex);
+  pkg_category_cache cache = CATEGORIES.value(repo);
+  if(stamp.inode==0 || !(cache.stamp==stamp) ){
+    //Not cached yet (or the database changed) - count the packages in each category
+    PkgDB pdb(repo);
+    if(!pdb.isOpen()){ return QJsonArray(); } //could not open DB (file missing?)
+    cache.stamp = stamp;
+    cache.names.clear();
+    cache.counts = QJsonObject();
+    QHash<QString, int> found;
+    QSqlQuery *q = pdb.query("SELECT substr(origin, 1, instr(origin, '/')-1) AS category, count(*) FROM packages GROUP BY category");
+    q->exec();
+    while(q->next()){ found.insert(q->value(0).toString(), q->value(1).toInt()); }
+    //Only list the known categories (in the same order as the database) which contain packages
+    QStringList cats = pdb.column("SELECT name FROM categories");
+    for(int i=0; i<cats.length(); i++){
+      if(found.value(cats[i],0)<1){ continue; }
+      cache.names << cats[i];
+      cache.counts.insert(cats[i], found.value(cats[i]));
     }
-  //Now get all the categories
-  QString q_string = "SELECT name FROM categories";
-  QSqlQuery query(q_string, DB);
-  while(query.next()){
-    found << query.value("name").toString(); //need the origin for later
+    CATEGORIES.insert(repo, cache);
   }
-
-  //Now check all the categories to ensure that pkgs exist within it
-    for(int i=0; i<found.length(); i++){
-      if(origins.filter(found[i]+"/").isEmpty()){ found.removeAt(i); i--; }
-    }
-  //Cleanup and return
-  //q_o.clear(); query.clear(); //disable open queries before closing DB
-  DB.close();
-  } //force DB out of scope
-  //closeDB(&DB);
-  QSqlDatabase::removeDatabase(dbconn);
-  if(!found.isEmpty()){ return QJsonArray::fromStringList(found); }
-  else{ return QJsonArray(); }
+  if(counts!=0){ *counts = cache.counts; }
+  return QJsonArray::fromStringList(cache.names);
 }
 
-QJsonArray PKG::list_repos(bool updated){
+QJsonArray PKG::list_repos(bool updated, QString *jobID){
   QString dbdir = "/var/db/pkg/repo-%1.sqlite";
-  QDir confdir("/usr/local/etc/pkg/repos");
-  QStringList confs = confdir.entryList(QStringList() << "*.conf", QDir::Files);
   QStringList found;
   found << "local"; //There is always a local database (for installed pkgs)
-  for(int i=0; i<confs.length(); i++){
-    QStringList repoinfo = General::readTextFile(confdir.absoluteFilePath(confs[i])).join("\n").split("}");
-    for(int j=0; j<repoinfo.length(); j++){
-      QString repo = repoinfo[j].section(":",0,0).simplified();
-      if(QFile::exists(dbdir.arg(repo)) && repoinfo[j].section("enabled:",1,-1).section(":",0,0).contains("true")){ found << repo; }
-    }
+  QStringList enabled = enabledRepos();
+  for(int i=0; i<enabled.length(); i++){
+    if(QFile::exists(dbdir.arg(enabled[i]))){ found << enabled[i]; }
   }
   if(found.length()<2 && !updated){
-    //Only the local repo could be found - update the package repos and try again
-    DProcess* proc = DISPATCHER->queueProcess(Dispatcher::PKG_QUEUE, "internal_sysadm_pkg_repo_update_sync", "pkg update");
-    proc->waitForFinished();
-    return list_repos(true); //try again recursively (will not try to update again)
+    //Only the local repo could be found - update the package repos in the background (never wait for it here)
+    // - the dispatcher announces when the update finishes, and the next call picks up the new databases
+    // - the ID is recorded before the job is queued (the dispatcher only lists it a bit later), so
+    //   concurrent calls never queue a second update - it gets cleared once the dispatcher is done with it
+    static bool watching = false;
+    QMutexLocker lock(&repoMutex);
+    if(!watching){
+      QObject::connect(DISPATCHER, &Dispatcher::DispatchFinished, [](QString ID){
+        QMutexLocker lock(&repoMutex);
+        if(ID==REPOUPDATE){ REPOUPDATE.clear(); }
+      });
+      watching = true;
+    }
+    if(REPOUPDATE.isEmpty()){
+      REPOUPDATE = "sysadm_pkg_repo_update-"+QUuid::createUuid().toString(); //create a random tag for the process
+      DISPATCHER->queueProcess(Dispatcher::PKG_QUEUE, REPOUPDATE, "pkg update");
+    }
+    if(jobID!=0){ *jobID = REPOUPDATE; }
   }
   return QJsonArray::fromStringList(found);
 }
@@ -397,70 +763,63 @@ QJsonObject PKG::evaluateInstall(QStringList origins, QString repo){
     out.insert("install_origins", QJsonArray::fromStringList(origins) );
     out.insert("repo", repo);
   if(repo=="local" || origins.isEmpty()){ return out; } //nothing to do
-  QString dbconn = openDB(repo);
-  QString ldbconn = openDB("local");
-  if(!dbconn.isEmpty()){
-    QSqlDatabase DB = QSqlDatabase::database(dbconn);
-    QSqlDatabase LDB = QSqlDatabase::database(ldbconn);
-    if(!DB.isOpen() || !LDB.isOpen()){ return out; } //could not open DB (file missing?)
+  PkgDB pdb(repo), lpdb("local");
+  if(!pdb.isOpen() || !lpdb.isOpen()){ return out; } //could not open DB (file missing?)
 
     //First get the list of all packages which need to be installed (ID's) from the remote database
     QStringList toInstall_id;
     QStringList tmp;
-    if(origins.first().contains("/")){ tmp = names_from_ids( ids_from_origins(origins, DB), "packages", DB); }
+    if(origins.first().contains("/")){ tmp = names_from_ids( ids_from_origins(origins, &pdb), "packages", &pdb); }
     else{ tmp = origins; } //already given names
     //qDebug() << " - Initial names:" << tmp;
     while(!tmp.isEmpty()){
-      QStringList ids = ids_from_names(tmp, DB);
+      QStringList ids = ids_from_names(tmp, &pdb);
       for(int i=0; i<ids.length(); i++){
         if(toInstall_id.contains(ids[i])){ ids.removeAt(i); i--; } //remove any duplicate/evaluated ID's
       }
       if(ids.isEmpty()){ break; } //stop the loop - found the last round of dependencies
       toInstall_id << ids; //add these to the list which are going to get installed
-      tmp = depends_from_ids(ids, DB); //now get the depdendencies of these packages
+      tmp = depends_from_ids(ids, &pdb); //now get the depdendencies of these packages
       //qDebug() << " - Iteration names:" << tmp;
     }
 
     //Now go through and remove any packages from the list which are already installed locally
-    QStringList names = names_from_ids(toInstall_id, "packages", DB); //same order
+    QStringList names = names_from_ids(toInstall_id, "packages", &pdb); //same order
     //qDebug() << " - Total Names:" << names;
-    QStringList local_names = names_from_ids( ids_from_names(names, LDB), "packages", LDB);
+    QStringList local_names = names_from_ids( ids_from_names(names, &lpdb), "packages", &lpdb);
     //qDebug() << " - Local Names:" << local_names;
     for(int i=0; i<local_names.length(); i++){
       names.removeAll(local_names[i]);
     }
     //qDebug() << " - Filtered Names:" << names;
-    toInstall_id = ids_from_names(names, DB); //now get the shorter/filtered list of ID's (remote)
+    toInstall_id = ids_from_names(names, &pdb); //now get the shorter/filtered list of ID's (remote)
     //qDebug() << " - Filtered ID's:" << toInstall_id;
     //Get the list of conflicting packages which are already installed
-    QStringList conflict_ids = conflicts_from_ids(toInstall_id, DB); //also get the list of any conflicts for these packages
+    QStringList conflict_ids = conflicts_from_ids(toInstall_id, &pdb); //also get the list of any conflicts for these packages
       conflict_ids.removeDuplicates();
-    QStringList conflict_names = names_from_ids(conflict_ids, "packages", DB);
+    QStringList conflict_names = names_from_ids(conflict_ids, "packages", &pdb);
     //qDebug() << " - Conflicts (remote):" << conflict_ids << conflict_names;
-    out.insert("conflicts", QJsonArray::fromStringList(names_from_ids( ids_from_names(conflict_names, LDB), "packages", LDB) ) );
+    out.insert("conflicts", QJsonArray::fromStringList(names_from_ids( ids_from_names(conflict_names, &lpdb), "packages", &lpdb) ) );
     //Now assemble all the information about the packages (remote database)
     QJsonObject install;
     //qDebug() << "Perform Query";
-    QSqlQuery qi("SELECT * FROM packages WHERE id IN ('"+toInstall_id.join("', '")+"')", DB);
-    while(qi.next()){
+    pdb.setList("ids", toInstall_id);
+    QSqlQuery *q = pdb.query("SELECT * FROM packages WHERE id IN (SELECT v FROM temp.ids)");
+    q->exec();
+    while(q->next()){
       QJsonObject obj;
-      obj.insert( "name", qi.value("name").toString());
-      obj.insert( "origin", qi.value("origin").toString());
-      obj.insert( "pkgsize", qi.value("pkgsize").toString());
-      obj.insert( "flatsize", qi.value("flatsize").toString());
-      obj.insert( "version", qi.value("version").toString());
-      obj.insert( "comment", qi.value("comment").toString());
-      install.insert(qi.value("name").toString(), obj);
+      obj.insert( "name", q->value("name").toString());
+      obj.insert( "origin", q->value("origin").toString());
+      obj.insert( "pkgsize", q->value("pkgsize").toString());
+      obj.insert( "flatsize", q->value("flatsize").toString());
+      obj.insert( "version", q->value("version").toString());
+      obj.insert( "comment", q->value("comment").toString());
+      install.insert(q->value("name").toString(), obj);
     }
     //qDebug() << "Final Install Object:" << install;
-    //qDebug() << "Last Query Error:" << qi.lastError().text();
+    //qDebug() << "Last Query Error:" << q->lastError().text();
     //Add the info to the output object and close the databases
     out.insert("install", install);
-    DB.close();
-    LDB.close();
-  } //force DB out of scope
-  QSqlDatabase::removeDatabase(dbconn);
-  QSqlDatabase::removeDatabase(ldbconn);
   return out;
 }
 
@@ -22,8 +22,8 @@ public:
 	//Information fetch routines
 	static QJsonObject pkg_info(QStringList origins, QString repo, QString category = "", bool fullresults = true);
 	static QStringList pkg_search(QString repo, QString searchterm, QStringList searchexcludes, QString category = "");
-	static QJsonArray list_categories(QString repo);
-	static QJsonArray list_repos(bool updated = false);
+	static QJsonArray list_categories(QString repo, QJsonObject *counts = 0); //counts: category -> number of pkgs
+	static QJsonArray list_repos(bool updated = false, QString *jobID = 0); //jobID: set if a background repo update was started (never waits on it)
 	static QJsonObject evaluateInstall(QStringList origins, QString repo); //evaluate what will be done if these packages are installed
 
 
@@ -0,0 +1,189 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+#include "sysadm-sampler.h"
+#include "sysadm-sysctl.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+
+#include <atomic>
+
+using namespace sysadm;
+
+//Longest averaging window (the ring buffer needs to cover this)
+#define SAMPLER_WINDOW_MS 60000
+
+//Current sampler (the lock only protects starting/stopping - the sampler thread never uses it)
+static SystemSampler *SAMPLER = 0;
+static QReadWriteLock samplerLock;
+
+//Extra metrics: name -> sampling function / last value
+static QHash<QString, std::function<double()> > METRICFUNCS;
+static QHash<QString, double> METRICVALS;
+static QMutex metricMutex;
+
+//=================
+// Static functions
+//=================
+bool SystemSampler::start(int interval){
+  QWriteLocker lock(&samplerLock);
+  if(SAMPLER!=0){ return true; } //already running
+  if(interval<10){ interval = 10; }
+  int ncpu = Sysctl::numbers("kern.cp_times").length() / 5; //5 values per CPU
+  if(ncpu<1){ return false; }
+  SAMPLER = new SystemSampler(interval, ncpu);
+  SAMPLER->QThread::start(QThread::LowPriority);
+  return true;
+}
+
+void SystemSampler::stop(){
+  QWriteLocker lock(&samplerLock);
+  if(SAMPLER==0){ return; }
+  SAMPLER->requestInterruption();
+  SAMPLER->wait();
+  delete SAMPLER;
+  SAMPLER = 0;
+}
+
+bool SystemSampler::isRunning(){
+  QReadLocker lock(&samplerLock);
+  return (SAMPLER!=0);
+}
+
+bool SystemSampler::cpuBusy(int msecs, QVector<double> *percpu, double *total){
+  QReadLocker lock(&samplerLock);
+  if(SAMPLER==0){ return false; }
+  return SAMPLER->busy(msecs, percpu, total);
+}
+
+void SystemSampler::addMetric(QString name, std::function<double()> fn){
+  QMutexLocker lock(&metricMutex);
+  METRICFUNCS.insert(name, fn);
+}
+
+QJsonObject SystemSampler::summary(){
+  QJsonObject out;
+  QReadLocker lock(&samplerLock);
+  if(SAMPLER==0){ return out; }
+  QJsonObject cpu;
+  QVector<double> percpu;
+  double total = 0;
+  QList<int> windows; windows << 1 << 10 << 60;
+  for(int i=0; i<windows.length(); i++){
+    if(!SAMPLER->busy(windows[i]*1000, &percpu, &total)){ continue; }
+    cpu.insert("busy_"+QString::number(windows[i])+"s", qRound(total));
+    if(windows[i]==1){
+      QJsonArray cpus;
+      for(int j=0; j<percpu.length(); j++){ cpus << qRound(percpu[j]); }
+      cpu.insert("cpus", cpus);
+    }
+  }
+  out.insert("cpu", cpu);
+  out.insert("interval_ms", SAMPLER->INTERVAL);
+  QMutexLocker mlock(&metricMutex);
+  for(QHash<QString, double>::const_iterator it = METRICVALS.constBegin(); it!=METRICVALS.constEnd(); ++it){
+    out.insert(it.key(), it.value());
+  }
+  return out;
+}
+
+//=================
+// SystemSampler
+//=================
+SystemSampler::SystemSampler(int interval, int ncpu) : QThread(){
+  INTERVAL = interval;
+  NCPU = ncpu;
+  SLOTS = SAMPLER_WINDOW_MS/interval + 3; //full window + the sample being written + spare
+  ticks.resize(SLOTS*NCPU*2);
+  stamps.resize(SLOTS);
+  seq = new QAtomicInteger<qint64>[SLOTS];
+  for(int i=0; i<SLOTS; i++){ seq[i].store(0); }
+  count.store(0);
+}
+
+SystemSampler::~SystemSampler(){
+  delete[] seq;
+}
+
+void SystemSampler::run(){
+  QElapsedTimer timer;
+  timer.start();
+  while(!isInterruptionRequested()){
+    takeSample(timer.elapsed());
+    //Extra metrics (copy the list so registrations never wait on a slow metric)
+    metricMutex.lock();
+    QHash<QString, std::function<double()> > funcs = METRICFUNCS;
+    metricMutex.unlock();
+    for(QHash<QString, std::function<double()> >::const_iterator it = funcs.constBegin(); it!=funcs.constEnd(); ++it){
+      double val = it.value()();
+      QMutexLocker lock(&metricMutex);
+      METRICVALS.insert(it.key(), val);
+    }
+    //Sleep in short steps so stop() does not need to wait a full interval
+    qint64 next = timer.elapsed() + INTERVAL;
+    while(!isInterruptionRequested() && timer.elapsed() < next){ msleep( qMin((qint64) 100, next-timer.elapsed()) ); }
+  }
+}
+
+void SystemSampler::takeSample(qint64 msecs){
+  QList<qint64> vals = Sysctl::numbers("kern.cp_times");
+  if(vals.length() < NCPU*5){ return; } //CPU went away? - skip this sample
+  qint64 num = count.load();
+  int slot = num % SLOTS;
+  //Seqlock write: mark the slot as busy before any of the data changes
+  seq[slot].store(2*num+1);
+  std::atomic_thread_fence(std::memory_order_release);
+  qint64 *data = ticks.data() + slot*NCPU*2;
+  for(int i=0; i<NCPU; i++){
+    //[user,nice,system,interrupt,idle] for each CPU
+    qint64 tot = 0;
+    for(int j=0; j<5; j++){ tot += vals[i*5+j]; }
+    data[2*i] = tot - vals[i*5+4];
+    data[2*i+1] = tot;
+  }
+  stamps[slot] = msecs;
+  seq[slot].storeRelease(2*num+2);
+  count.storeRelease(num+1);
+}
+
+bool SystemSampler::readSample(qint64 num, QVector<qint64> *out, qint64 *msecs){
+  int slot = num % SLOTS;
+  if(seq[slot].loadAcquire() != 2*num+2){ return false; }
+  const qint64 *data = ticks.constData() + slot*NCPU*2;
+  out->resize(NCPU*2);
+  for(int i=0; i<NCPU*2; i++){ (*out)[i] = data[i]; }
+  *msecs = stamps[slot];
+  //Make sure the writer did not start reusing the slot while it was copied (the fence keeps the reads above before the check)
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return (seq[slot].load() == 2*num+2);
+}
+
+bool SystemSampler::busy(int msecs, QVector<double> *percpu, double *total){
+  for(int tries=0; tries<3; tries++){
+    qint64 last = count.loadAcquire() - 1;
+    if(last<1){ return false; } //need two samples
+    //Oldest sample which is still inside the window (at least one sample back)
+    qint64 back = qBound((qint64) 1, (qint64) (msecs/INTERVAL), qMin(last, (qint64) SLOTS-2));
+    QVector<qint64> now, then;
+    qint64 tnow, tthen;
+    if(!readSample(last, &now, &tnow) || !readSample(last-back, &then, &tthen)){ continue; }
+    percpu->resize(NCPU);
+    qint64 allbusy = 0, alltot = 0;
+    for(int i=0; i<NCPU; i++){
+      qint64 b = now[2*i]-then[2*i];
+      qint64 t = now[2*i+1]-then[2*i+1];
+      (*percpu)[i] = (t>0) ? (100.0*b)/t : 0;
+      allbusy += b;
+      alltot += t;
+    }
+    *total = (alltot>0) ? (100.0*allbusy)/alltot : 0;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,62 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+//  Background sampler for system metrics (CPU ticks from kern.cp_times + any registered metric)
+//  - one thread takes a sample every interval, readers never block it (ring buffer + sequence numbers)
+//  - averages over the last 1/10/60 seconds are available immediately
+//===========================================
+#ifndef __PCBSD_LIB_UTILS_SAMPLER_H
+#define __PCBSD_LIB_UTILS_SAMPLER_H
+
+#include "sysadm-global.h"
+
+#include <QAtomicInteger>
+#include <QThread>
+#include <QVector>
+
+#include <functional>
+
+namespace sysadm{
+
+class SystemSampler : public QThread{
+public:
+	//Start/stop the global sampler (msecs between samples)
+	static bool start(int interval = 1000);
+	static void stop();
+	static bool isRunning();
+
+	//Average busy percentage of each CPU (and all of them together) over the last "msecs"
+	// - returns false if there are not enough samples yet
+	static bool cpuBusy(int msecs, QVector<double> *percpu, double *total);
+
+	//Extra metrics: "fn" is called from the sampler thread with every sample (latest value is kept)
+	static void addMetric(QString name, std::function<double()> fn);
+
+	//Current state for the system-state event: {"cpu": {"busy_1s","busy_10s","busy_60s","cpus"}, "interval_ms", <metric>: <value>}
+	static QJsonObject summary();
+
+protected:
+	void run();
+
+private:
+	SystemSampler(int interval, int ncpu);
+	~SystemSampler();
+
+	int INTERVAL, NCPU, SLOTS;
+	//Ring buffer: sample N lives in slot N%SLOTS
+	QVector<qint64> ticks; //[slot][cpu][busy,total] - cumulative ticks
+	QVector<qint64> stamps; //[slot] - msecs since the sampler started
+	QAtomicInteger<qint64> *seq; //[slot] - 2*N+1 while sample N is written, 2*N+2 once done
+	QAtomicInteger<qint64> count; //number of samples written
+
+	void takeSample(qint64 msecs);
+	bool readSample(qint64 num, QVector<qint64> *out, qint64 *msecs);
+	bool busy(int msecs, QVector<double> *percpu, double *total);
+};
+
+} //end of sysadm namespace
+
+#endif
@@ -3,8 +3,43 @@
 
 #include <QFile>
 #include <QDir>
+#include <QMutex>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+//How long rc-status output and service states are re-used (msecs)
+#define SERVICE_STATUS_TTL 5000
+//Max number of "service <name> status" probes run at the same time
+#define SERVICE_STATUS_WORKERS 8
 
 using namespace sysadm;
+
+//Shared by all ServiceManager instances (every request creates a new one)
+struct service_status_cache{
+  qint64 stamp; //msecs since epoch when the rc-status output was loaded (0: invalid)
+  QHash<QString, QString> rcdata, unuseddata;
+  QHash<QString, bool> running; //service -> probed state
+  quint64 generation; //bumped on every invalidation (results from before that are not published)
+};
+static service_status_cache STATUS = {0, QHash<QString, QString>(), QHash<QString, QString>(), QHash<QString, bool>(), 0};
+//Only held to read/publish STATUS - never while commands run
+static QMutex statusMutex;
+
+static void invalidateStatus(){
+  QMutexLocker lock(&statusMutex);
+  STATUS.stamp = 0;
+  STATUS.running.clear();
+  STATUS.generation++;
+}
+
+static bool statusCacheValid(){
+  return (STATUS.stamp > 0) && (QDateTime::currentMSecsSinceEpoch() - STATUS.stamp < SERVICE_STATUS_TTL);
+}
+
+static bool probeRunning(QString dir){
+  return sysadm::General::RunQuickCommand("service",QStringList() << dir << "status");
+}
+
 ServiceManager::ServiceManager(QString chroot, QString ip)
 {
     this->chroot = chroot;
@@ -32,13 +67,40 @@ QList<Service> ServiceManager::GetServices()
     return services;
 }
 
-// look at rcdata now
+// look at rcdata now (the state reported by rc-status, only unclear ones get probed)
 QList<bool> ServiceManager::isRunning(QList<Service> services){
    //return list in the same order as the input list
   QList<bool> out;
+  QHash<int, QString> probes; //index -> service directory
+  statusMutex.lock();
+  bool valid = statusCacheValid();
+  quint64 gen = STATUS.generation;
   for(int i=0; i<services.length(); i++){
-    if(!rcdata.contains(services[i].Name)){ out << false; }
-    else{ out << sysadm::General::RunQuickCommand("service",QStringList() << services[i].Directory << "status"); }
+    out << false;
+    if(!rcdata.contains(services[i].Name)){ continue; }
+    QString status = rcdata.value(services[i].Name);
+    if(valid && STATUS.running.contains(services[i].Name)){ out[i] = STATUS.running.value(services[i].Name); }
+    else if(status=="started"){ out[i] = true; }
+    else if(status=="stopped"){ out[i] = false; }
+    else{ probes.insert(i, services[i].Directory); }
+  }
+  statusMutex.unlock();
+  if(probes.isEmpty()){ return out; }
+  //Run the probes in parallel (bounded)
+  static QThreadPool *pool = [](){ QThreadPool *P = new QThreadPool(); P->setMaxThreadCount(SERVICE_STATUS_WORKERS); return P; }();
+  QHash<int, QFuture<bool> > futures;
+  for(QHash<int, QString>::const_iterator it = probes.constBegin(); it!=probes.constEnd(); ++it){
+    futures.insert(it.key(), QtConcurrent::run(pool, probeRunning, it.value()) );
+  }
+  for(QHash<int, QFuture<bool> >::iterator it = futures.begin(); it!=futures.end(); ++it){
+    out[it.key()] = it.value().result();
+  }
+  //Publish the results (unless a start/stop changed things in the meantime)
+  QMutexLocker lock(&statusMutex);
+  if(statusCacheValid() && STATUS.generation==gen){
+    for(QHash<int, QFuture<bool> >::const_iterator it = futures.constBegin(); it!=futures.constEnd(); ++it){
+      STATUS.running.insert(services[it.key()].Name, out[it.key()]);
+    }
   }
   return out;
 }
@@ -84,7 +146,9 @@ bool ServiceManager::Start(Service service)
       prog = "warden";
       args << "chroot" << ip << "service" << service.Directory << (once ? "one" : "" )+QString("start");
     }
-    return General::RunQuickCommand(prog,args);
+    bool ret = General::RunQuickCommand(prog,args);
+    invalidateStatus();
+    return ret;
 }
 
 // onestop doesn't matter anymore
@@ -103,7 +167,9 @@ bool ServiceManager::Stop(Service service)
       prog = "warden";
       args << "chroot" << ip << "service" << service.Directory << (once ? "one" : "" )+QString("stop");
     }
-    return General::RunQuickCommand(prog,args);
+    bool ret = General::RunQuickCommand(prog,args);
+    invalidateStatus();
+    return ret;
 }
 
 bool ServiceManager::Restart(Service service)
@@ -120,7 +186,9 @@ bool ServiceManager::Restart(Service service)
       prog = "warden";
       args << "chroot" << ip << "service" << service.Directory << (once ? "one" : "" )+QString("restart");
     }
-    return General::RunQuickCommand(prog,args);
+    bool ret = General::RunQuickCommand(prog,args);
+    invalidateStatus();
+    return ret;
 }
 
 // Enable is rc-update add name runlevel
@@ -212,6 +280,16 @@ Service ServiceManager::loadServices(QString name)
 
 // rc-status --nocolor --servicelist to get all services
 void ServiceManager::loadRCdata(){
+  statusMutex.lock();
+  if(statusCacheValid()){
+    rcdata = STATUS.rcdata;
+    unuseddata = STATUS.unuseddata;
+    statusMutex.unlock();
+    return;
+  }
+  quint64 gen = STATUS.generation;
+  statusMutex.unlock();
+  //Run the commands without the lock (concurrent callers might both do this - the last one to finish gets published)
   rcdata.clear();
   // output is spNAMEsp...[spSTATUSsp]\n
   QStringList info = sysadm::General::RunCommand("rc-status --nocolor --servicelist").split("\n");
@@ -224,6 +302,12 @@ void ServiceManager::loadRCdata(){
     }
   }
   loadUnusedData();
+  QMutexLocker lock(&statusMutex);
+  if(STATUS.generation!=gen){ return; } //a start/stop happened while these ran - do not cache old data
+  STATUS.rcdata = rcdata;
+  STATUS.unuseddata = unuseddata;
+  STATUS.running.clear();
+  STATUS.stamp = QDateTime::currentMSecsSinceEpoch();
 }
 
 // rc-status --nocolor --unused to find services not in any runlevel
@@ -278,6 +362,7 @@ bool ServiceManager::enableDisableService(QString name, bool enable) {
   args << runlevel;
   qDebug() << prog << " " << args;
   bool ret = sysadm::General::RunQuickCommand(prog,args);
-  loadUnusedData();
+  invalidateStatus();
+  loadRCdata();
   return ret;
 }
@@ -47,7 +47,7 @@ public:
      */
     QList<Service> GetServices();
 
-    QList<bool> isRunning(QList<Service> services); //return list in the same order as the input list
+    QList<bool> isRunning(QList<Service> services); //return list in the same order as the input list (batched - use this for many services)
     bool isRunning(Service service); //single-item overload
 
     QList<bool> isEnabled(QList<Service> services); //return list in the same order as the input list
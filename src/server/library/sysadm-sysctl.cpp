@@ -0,0 +1,225 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+#include "sysadm-sysctl.h"
+
+#include <QFile>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QStringList>
+#include <QVector>
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef __FreeBSD__
+#include <sys/sysctl.h>
+#include <errno.h>
+#else
+#include <sys/utsname.h>
+#endif
+
+using namespace sysadm;
+
+#ifdef __FreeBSD__
+//=================
+// Native backend
+//=================
+//Name -> MIB (empty: no such sysctl) - resolved the first time each name is used
+static QHash<QString, QVector<int> > MIBS;
+static QReadWriteLock mibLock;
+
+static QVector<int> mibForName(QString name){
+  {
+    QReadLocker lock(&mibLock);
+    if(MIBS.contains(name)){ return MIBS.value(name); }
+  }
+  QVector<int> mib(CTL_MAXNAME);
+  size_t len = CTL_MAXNAME;
+  if( 0 == sysctlnametomib(name.toLocal8Bit().constData(), mib.data(), &len) ){ mib.resize(len); }
+  else{ mib.clear(); }
+  QWriteLocker lock(&mibLock);
+  MIBS.insert(name, mib);
+  return mib;
+}
+
+static bool readNative(QString name, QByteArray *data){
+  QVector<int> mib = mibForName(name);
+  if(mib.isEmpty()){ return false; }
+  for(int tries=0; tries<3; tries++){
+    size_t size = 0;
+    if( 0 != sysctl(mib.data(), mib.size(), NULL, &size, NULL, 0) ){ return false; }
+    data->resize(size + size/8 + 16); //leave room for values which grow between the two calls
+    size = data->size();
+    if( 0 == sysctl(mib.data(), mib.size(), data->data(), &size, NULL, 0) ){ data->resize(size); return true; }
+    if(errno!=ENOMEM){ return false; }
+  }
+  return false;
+}
+
+#else
+//=================
+// /proc backend (Linux)
+//=================
+//Values are packed the same way the kernel hands them out on FreeBSD (strings: NUL-terminated, counts: 64-bit)
+static QString readProcFile(QString path){
+  QFile file(path);
+  if(!file.open(QIODevice::ReadOnly)){ return ""; }
+  return QString::fromLocal8Bit(file.readAll());
+}
+
+static QByteArray packText(QString text){
+  QByteArray data = text.trimmed().toLocal8Bit();
+  data.append('\0');
+  return data;
+}
+
+static QByteArray packNumber(qint64 num){
+  return QByteArray( (const char*) &num, sizeof(num) );
+}
+
+//Field from /proc/meminfo (bytes)
+static qint64 meminfo(QString field, bool *ok){
+  QStringList lines = readProcFile("/proc/meminfo").split("\n").filter(field+":");
+  for(int i=0; i<lines.length(); i++){
+    if(lines[i].section(":",0,0)==field){ return lines[i].section(":",1,1).simplified().section(" ",0,0).toLongLong(ok)*1024; }
+  }
+  *ok = false;
+  return 0;
+}
+
+static bool readProc(QString name, QByteArray *data){
+  bool ok = true;
+  qint64 pagesize = sysconf(_SC_PAGESIZE);
+  if(name.startsWith("vm.stats.vm.")){
+    static QHash<QString, QString> fields;
+    if(fields.isEmpty()){
+      fields.insert("v_free_count", "MemFree");
+      fields.insert("v_inactive_count", "Inactive");
+      fields.insert("v_active_count", "Active");
+      fields.insert("v_cache_count", "Cached");
+      fields.insert("v_wire_count", "Unevictable");
+      fields.insert("v_page_count", "MemTotal");
+    }
+    QString var = name.section(".",-1);
+    if(var=="v_page_size"){ *data = packNumber(pagesize); return true; }
+    if(!fields.contains(var)){ return false; }
+    qint64 bytes = meminfo(fields.value(var), &ok);
+    if(ok){ *data = packNumber(bytes/pagesize); }
+    return ok;
+  }else if(name=="hw.realmem" || name=="hw.physmem"){
+    qint64 bytes = meminfo("MemTotal", &ok);
+    if(ok){ *data = packNumber(bytes); }
+    return ok;
+  }else if(name=="kern.cp_times" || name=="kern.cp_time" || name=="kern.smp.cpus" || name=="hw.ncpu" || name=="kern.boottime"){
+    QStringList lines = readProcFile("/proc/stat").split("\n");
+    QByteArray out;
+    int cpus = 0;
+    for(int i=0; i<lines.length(); i++){
+      QStringList vals = lines[i].simplified().split(" ");
+      if(name=="kern.boottime" && vals.first()=="btime"){
+        struct timeval tv;
+          tv.tv_sec = vals.value(1).toLongLong();
+          tv.tv_usec = 0;
+        *data = QByteArray( (const char*) &tv, sizeof(tv) );
+        return true;
+      }
+      if(name=="kern.boottime" || !vals.first().startsWith("cpu") || vals.length()<5){ continue; }
+      //Linux: user nice system idle iowait irq softirq ... -> FreeBSD: user nice system interrupt idle
+      if( (vals.first()=="cpu") != (name=="kern.cp_time") ){ continue; }
+      cpus++;
+      long ticks[5];
+        ticks[0] = vals[1].toLong();
+        ticks[1] = vals[2].toLong();
+        ticks[2] = vals[3].toLong();
+        ticks[3] = vals.value(6).toLong() + vals.value(7).toLong();
+        ticks[4] = vals[4].toLong() + vals.value(5).toLong();
+      out.append( (const char*) ticks, sizeof(ticks) );
+    }
+    if(name=="kern.smp.cpus" || name=="hw.ncpu"){ out = packNumber(cpus); }
+    if(out.isEmpty()){ return false; }
+    *data = out;
+    return true;
+  }else if(name=="hw.model"){
+    QStringList lines = readProcFile("/proc/cpuinfo").split("\n").filter("model name");
+    if(lines.isEmpty()){ return false; }
+    *data = packText( lines.first().section(":",1,-1) );
+    return true;
+  }else if(name=="hw.machine"){
+    struct utsname info;
+    if(0 != uname(&info)){ return false; }
+    *data = packText(info.machine);
+    return true;
+  }
+  //Simple text values
+  QHash<QString, QString> files;
+    files.insert("kern.hostname", "/proc/sys/kernel/hostname");
+    files.insert("kern.osrelease", "/proc/sys/kernel/osrelease");
+    files.insert("kern.ostype", "/proc/sys/kernel/ostype");
+    files.insert("kern.ident", "/proc/sys/kernel/version");
+  if(!files.contains(name) || !QFile::exists(files.value(name)) ){ return false; }
+  *data = packText( readProcFile(files.value(name)) );
+  return true;
+}
+#endif
+
+//=================
+// Sysctl
+//=================
+bool Sysctl::read(QString name, QByteArray *data){
+  data->clear();
+#ifdef __FreeBSD__
+  return readNative(name, data);
+#else
+  return readProc(name, data);
+#endif
+}
+
+bool Sysctl::exists(QString name){
+  QByteArray data;
+  return read(name, &data);
+}
+
+QString Sysctl::text(QString name){
+  QByteArray data;
+  if(!read(name, &data)){ return ""; }
+  int end = data.indexOf('\0');
+  if(end>=0){ data.truncate(end); }
+  return QString::fromLocal8Bit(data).trimmed();
+}
+
+qint64 Sysctl::number(QString name, bool *ok){
+  QByteArray data;
+  bool good = read(name, &data);
+  qint64 num = 0;
+  if(good){
+    //The type comes from the size of the value
+    switch(data.size()){
+      case sizeof(qint64): num = *( (const qint64*) data.constData() ); break;
+      case sizeof(qint32): num = *( (const qint32*) data.constData() ); break;
+      case sizeof(qint16): num = *( (const qint16*) data.constData() ); break;
+      default: good = false;
+    }
+  }
+  if(ok!=0){ *ok = good; }
+  return num;
+}
+
+QList<qint64> Sysctl::numbers(QString name){
+  QList<qint64> out;
+  QByteArray data;
+  if(!read(name, &data)){ return out; }
+  const long *vals = (const long*) data.constData();
+  int num = data.size() / sizeof(long);
+  for(int i=0; i<num; i++){ out << vals[i]; }
+  return out;
+}
+
+qint64 Sysctl::bootTime(){
+  QByteArray data;
+  if(!read("kern.boottime", &data) || data.size() < (int) sizeof(struct timeval) ){ return 0; }
+  return ( (const struct timeval*) data.constData() )->tv_sec;
+}
@@ -0,0 +1,36 @@
+//===========================================
+//  PC-BSD source code
+//  Copyright (c) 2015, PC-BSD Software/iXsystems
+//  Available under the 3-clause BSD license
+//  See the LICENSE file for full details
+//===========================================
+//  Direct sysctl(3) reads (no sysctl(8) processes)
+//  - FreeBSD: name -> MIB lookups are only done once per name
+//  - Other systems (Linux): the same names are emulated from /proc (only the ones used by sysadm)
+//  NOTE: this file only depends on Qt Core so it can be built/tested anywhere
+//===========================================
+#ifndef __PCBSD_LIB_UTILS_SYSCTL_H
+#define __PCBSD_LIB_UTILS_SYSCTL_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+namespace sysadm{
+
+class Sysctl{
+public:
+	static bool exists(QString name);
+	//Typed reads (integers of any size are returned as 64-bit values)
+	static QString text(QString name); //empty if the sysctl does not exist
+	static qint64 number(QString name, bool *ok = 0);
+	static QList<qint64> numbers(QString name); //arrays of "long" (kern.cp_times)
+	static qint64 bootTime(); //seconds since the epoch (kern.boottime), 0 if unknown
+
+private:
+	static bool read(QString name, QByteArray *data); //raw value
+};
+
+} //end of namespace
+
+#endif
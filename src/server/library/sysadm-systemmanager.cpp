@@ -5,13 +5,49 @@
 //  See the LICENSE file for full details
 //===========================================
 #include "sysadm-general.h"
+#include "sysadm-command.h"
 #include "sysadm-systemmanager.h"
+#include "sysadm-sampler.h"
+#include "sysadm-sysctl.h"
 #include "sysadm-global.h"
 //need access to the global DISPATCHER object
 #include "globals.h"
 
+#include <QMutex>
+
 using namespace sysadm;
 
+//CPU ticks (kern.cp_times) from the last cpuPercentage() call - used when the background sampler is not running
+static QList<qint64> LASTTICKS;
+static QMutex ticksMutex;
+
+//Busy % since the last call (or since boot on the first call) - never waits for a second sample
+static bool tickBusy(QVector<double> *percpu, double *total){
+  QList<qint64> now = Sysctl::numbers("kern.cp_times");
+  if(now.length()<5){ return false; }
+  QMutexLocker lock(&ticksMutex);
+  QList<qint64> then = LASTTICKS;
+  if(then.length()!=now.length()){ then.clear(); } //first call (or CPUs changed): counters start at 0 on boot
+  LASTTICKS = now;
+  int ncpu = now.length()/5;
+  percpu->resize(ncpu);
+  qint64 allbusy = 0, alltot = 0;
+  for(int i=0; i<ncpu; i++){
+    //[user,nice,system,interrupt,idle] for each CPU
+    qint64 busy = 0, idle = 0;
+    for(int j=0; j<5; j++){
+      qint64 delta = now[i*5+j] - then.value(i*5+j, 0);
+      if(j==4){ idle = delta; }
+      else{ busy += delta; }
+    }
+    (*percpu)[i] = (busy+idle>0) ? (100.0*busy)/(busy+idle) : 0;
+    allbusy += busy;
+    alltot += busy+idle;
+  }
+  *total = (alltot>0) ? (100.0*allbusy)/alltot : 0;
+  return true;
+}
+
 
 //Battery Availability
 QJsonObject SysMgmt::batteryInfo(){
@@ -69,44 +105,32 @@ QJsonObject SysMgmt::cpuPercentage() {
   QJsonObject retObject;
   QString tmp;
 
-  //Calculate the percentage based on the kernel information directly - no extra utilities
-  QStringList result = General::RunCommand("sysctl -n kern.cp_times").split(" ");
-  static QStringList last = QStringList();
-  if(last.isEmpty()){
-    //need two ticks before it works properly
-    sleep(1);
-    last = result;
-    result = General::RunCommand("sysctl -n kern.cp_times").split(" ");
-  }
-  double tot = 0;
-  double roundtot;
-  int cpnum = 0;
-  for(int i=4; i<result.length(); i+=5){
-     //The values come in blocks of 5 per CPU: [user,nice,system,interrupt,idle]
-     cpnum++; //the number of CPU's accounted for (to average out at the end)
-     //qDebug() <<"CPU:" << cpnum;
-     long sum = 0;
-     //Adjust/all the data to correspond to diffs from the previous check
-     for(int j=0; j<5; j++){
-       QString tmp = result[i-j];
-       result[i-j] = QString::number(result[i-j].toLong()-last[i-j].toLong());
-       //need the difference between last run and this one
-       sum += result[i-j].toLong();
-       last[i-j] = tmp; //make sure to keep the original value around for the next run
-     }
+  //The background sampler keeps track of the kernel CPU ticks (kern.cp_times) - just read the averages
+  // (sampler disabled or just started: use the ticks since the last call instead - never sleep here)
+  QVector<double> percpu;
+  double total = 0;
+  if(!SystemSampler::cpuBusy(1000, &percpu, &total) && !tickBusy(&percpu, &total)){ return retObject; }
+  if(percpu.isEmpty()){ return retObject; }
+  for(int i=0; i<percpu.length(); i++){
      QJsonObject vals;
-     roundtot = 100.0L - ( (100.0L*result[i].toLong())/sum );
-     tmp.setNum(qRound(roundtot));
+     tmp.setNum(qRound(percpu[i]));
      vals.insert("busy", tmp );
-     tmp.setNum(cpnum);
+     tmp.setNum(i+1);
      retObject.insert("cpu" + tmp, vals);
-     //Calculate the percentage used for this CPU (100% - IDLE%)
-     tot += 100.0L - ( (100.0L*result[i].toLong())/sum ); //remember IDLE is the last of the five values per CPU
-   }
+  }
 
   // Add the total busy %
-  tmp.setNum(qRound(tot/cpnum));
+  tmp.setNum(qRound(total));
   retObject.insert("busytotal", tmp);
+  // Add the averages over longer periods
+  QJsonObject avg;
+  QList<int> windows; windows << 1 << 10 << 60;
+  for(int i=0; i<windows.length(); i++){
+    QVector<double> cpus;
+    double busy = 0;
+    if(SystemSampler::cpuBusy(windows[i]*1000, &cpus, &busy)){ avg.insert(QString::number(windows[i])+"s", tmp.setNum(qRound(busy)) ); }
+  }
+  retObject.insert("busyaverage", avg);
   return retObject;
 }
 
@@ -217,46 +241,22 @@ QJsonObject SysMgmt::memoryStats() {
   QJsonObject retObject;
 
   QString tmp;
-  long pageSize;
   bool ok;
 
   // Get the page size
-  tmp = General::RunCommand("sysctl -n vm.stats.vm.v_page_size").simplified();
-  tmp.toLong(&ok);
-  if ( ok )
-    pageSize = tmp.toLong();
-  else
+  qint64 pageSize = Sysctl::number("vm.stats.vm.v_page_size", &ok);
+  if ( !ok || pageSize<=0 )
     return retObject;
 
-  // Get the free size
-  tmp = General::RunCommand("sysctl -n vm.stats.vm.v_free_count").simplified();
-  tmp.toLong(&ok);
-  if ( ok )
-    retObject.insert("free", tmp.setNum((tmp.toLong() * pageSize) / 1024 / 1024));
-
-  // Get the inactive size
-  tmp = General::RunCommand("sysctl -n vm.stats.vm.v_inactive_count").simplified();
-  tmp.toLong(&ok);
-  if ( ok )
-    retObject.insert("inactive", tmp.setNum((tmp.toLong() * pageSize) / 1024 / 1024));
-
-  // Get the cache size
-  tmp = General::RunCommand("sysctl -n vm.stats.vm.v_cache_count").simplified();
-  tmp.toLong(&ok);
-  if ( ok )
-    retObject.insert("cache", tmp.setNum((tmp.toLong() * pageSize) / 1024 / 1024));
-
-  // Get the wired size
-  tmp = General::RunCommand("sysctl -n vm.stats.vm.v_wire_count").simplified();
-  tmp.toLong(&ok);
-  if ( ok )
-    retObject.insert("wired", tmp.setNum((tmp.toLong() * pageSize) / 1024 / 1024));
-
-  // Get the active size
-  tmp = General::RunCommand("sysctl -n vm.stats.vm.v_active_count").simplified();
-  tmp.toLong(&ok);
-  if ( ok )
-    retObject.insert("active", tmp.setNum((tmp.toLong() * pageSize) / 1024 / 1024));
+  // Get the page counts for each type of memory
+  QStringList types, sysctls;
+  types << "free" << "inactive" << "cache" << "wired" << "active";
+  sysctls << "v_free_count" << "v_inactive_count" << "v_cache_count" << "v_wire_count" << "v_active_count";
+  for(int i=0; i<types.length(); i++){
+    qint64 pages = Sysctl::number("vm.stats.vm."+sysctls[i], &ok);
+    if ( ok )
+      retObject.insert(types[i], tmp.setNum((pages * pageSize) / 1024 / 1024));
+  }
 
   return retObject;
 }
@@ -345,8 +345,12 @@ QJsonObject SysMgmt::sysctlList() {
   QJsonObject retObject;
 
   // This can be cleaned up and not use CLI
-  QStringList output = General::RunCommand("sysctl -aW").split("\n");
-  QStringList details = General::RunCommand("sysctl -aWdt").split("\n");
+  // (both listings are independent - run them at the same time)
+  QList< QFuture<CommandResult> > procs;
+  procs << Command::start("sysctl -aW") << Command::start("sysctl -aWdt");
+  QList<CommandResult> results = Command::waitForAll(procs);
+  QStringList output = results[0].output.split("\n");
+  QStringList details = results[1].output.split("\n");
 
   QString sysctl, type, description;
   for(int i=0; i<output.length(); i++){
@@ -371,40 +375,67 @@ QJsonObject SysMgmt::sysctlList() {
   return retObject;
 }
 
+// Userland version (what "freebsd-version" reports - it is just a script with the version embedded)
+static QString userlandVersion(){
+  QStringList lines = General::readTextFile("/bin/freebsd-version").filter("USERLAND_VERSION=");
+  if(!lines.isEmpty()){ return lines.first().section("=",1,-1).remove("\"").simplified(); }
+  //Not FreeBSD: use the OS release info instead
+  lines = General::readTextFile("/etc/os-release").filter("PRETTY_NAME=");
+  if(!lines.isEmpty()){ return lines.first().section("=",1,-1).remove("\"").simplified(); }
+  return "";
+}
+
+// Uptime in the same format as the "uptime" utility ("up 3 days 4:05", "up 12 mins", ...)
+static QString uptimeText(qint64 secs){
+  qint64 days = secs/86400;
+  int hrs = (secs%86400)/3600;
+  int mins = (secs%3600)/60;
+  QStringList out;
+  out << "up";
+  if(days>0){ out << QString::number(days) << (days==1 ? "day" : "days"); }
+  if(hrs>0 && mins>0){ out << QString::number(hrs)+":"+QString::number(mins).rightJustified(2,'0'); }
+  else if(hrs>0){ out << QString::number(hrs) << (hrs==1 ? "hr" : "hrs"); }
+  else if(mins>0){ out << QString::number(mins) << (mins==1 ? "min" : "mins"); }
+  else if(days==0){ out << QString::number(secs) << "secs"; }
+  return out.join(" ");
+}
+
 // Return a bunch of various system information
 QJsonObject SysMgmt::systemInfo() {
   QJsonObject retObject;
 
-  QString arch = General::RunCommand("uname -m").simplified();
+  //Everything comes straight from the kernel (no extra utilities)
+  QString arch = Sysctl::text("hw.machine");
   retObject.insert("arch", arch);
 
-  QString sysver = General::RunCommand("freebsd-version").simplified();
+  QString sysver = userlandVersion();
   retObject.insert("systemversion", sysver);
 
-  QString kernver = General::RunCommand("uname -r").simplified();
+  QString kernver = Sysctl::text("kern.osrelease");
   retObject.insert("kernelversion", kernver);
 
-  QString kernident = General::RunCommand("uname -i").simplified();
+  QString kernident = Sysctl::text("kern.ident");
   retObject.insert("kernelident", kernident);
 
-  QString host = General::RunCommand("hostname").simplified();
+  QString host = Sysctl::text("kern.hostname");
   retObject.insert("hostname", host);
 
-  QString uptime = General::RunCommand("uptime").simplified().section(" ", 1, 4).simplified().replace(",", "");
-  retObject.insert("uptime", uptime);
+  qint64 boot = Sysctl::bootTime();
+  if(boot>0){
+    retObject.insert("uptime", uptimeText(QDateTime::currentDateTime().toTime_t() - boot) );
+  }
 
-  QString cputype = General::RunCommand("sysctl -n hw.model").simplified();
+  QString cputype = Sysctl::text("hw.model");
   retObject.insert("cputype", cputype);
 
-  QString cpucores = General::RunCommand("sysctl -n kern.smp.cpus").simplified();
+  QString cpucores = QString::number( Sysctl::number("kern.smp.cpus") );
   retObject.insert("cpucores", cpucores);
 
   bool ok;
   QString tmp;
-  QString totalmem = General::RunCommand("sysctl -n hw.realmem").simplified();
-  totalmem.toLong(&ok);
+  qint64 totalmem = Sysctl::number("hw.realmem", &ok);
   if ( ok ) {
-    retObject.insert("totalmem", tmp.setNum(totalmem.toLong() / 1024 / 1024));
+    retObject.insert("totalmem", tmp.setNum(totalmem / 1024 / 1024));
   }
 
   return retObject;
@@ -263,8 +263,7 @@ QJsonObject Update::startUpdate(QJsonObject jsin) {
 QJsonObject Update::stopUpdate() {
   //See if the update is running in the dispatcher
   QJsonObject ret;
-  QJsonObject cup = DISPATCHER->listJobs();
-  QStringList ids = cup.keys().filter("sysadm_update_runupdates::");
+  QStringList ids = DISPATCHER->jobIDs("sysadm_update_runupdates::");
   if(!ids.isEmpty()){
     //Found a dispatcher process - go ahead and request that it stop
     DISPATCHER->killJobs(ids);
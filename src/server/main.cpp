@@ -9,6 +9,9 @@
 #include <sys/types.h>
 
 #include "WebServer.h"
+#include "library/sysadm-metrics.h"
+#include "library/sysadm-executor.h"
+#include "library/sysadm-sampler.h"
 
 #define CONFFILE "/usr/local/etc/sysadm.conf"
 #define SETTINGSFILE "/var/db/sysadm.ini"
@@ -19,6 +22,7 @@
 QSettings *CONFIG = new QSettings(SETTINGSFILE, QSettings::IniFormat);
 EventWatcher *EVENTS = new EventWatcher();
 Dispatcher *DISPATCHER = new Dispatcher();
+RequestScheduler *SCHEDULER = new RequestScheduler();
 bool WS_MODE = false;
 
 //Set the defail values for the global config variables
@@ -239,6 +243,71 @@ int main( int argc, char ** argv )
     if(!conf.filter(rg).isEmpty()){
       BRIDGE_ONLY = conf.filter(rg).first().section("=",1,1).simplified().toLower()=="true";
     }    
+    // - Request scheduler limits (-1: keep the default)
+    int sched[4] = {-1, -1, -1, -1};
+    QStringList schedkeys; schedkeys << "REQUEST_FAST_THREADS=*" << "REQUEST_BLOCKING_THREADS=*" << "REQUEST_MAX_QUEUED=*" << "REQUEST_MAX_PER_CONNECTION=*";
+    for(int i=0; i<schedkeys.length(); i++){
+      rg = QRegExp(schedkeys[i],Qt::CaseSensitive,QRegExp::Wildcard);
+      if(conf.filter(rg).isEmpty()){ continue; }
+      bool ok = false;
+      int tmp = conf.filter(rg).first().section("=",1,1).simplified().toInt(&ok);
+      if(ok){ sched[i] = tmp; }
+    }
+    SCHEDULER->setLimits(sched[0], sched[1], sched[2], sched[3]);
+    // - Metrics file (Prometheus text format) - disabled by default
+    QString metricsFile;
+    rg = QRegExp("METRICS_PROMETHEUS_FILE=*",Qt::CaseSensitive,QRegExp::Wildcard);
+    if(!conf.filter(rg).isEmpty()){
+      metricsFile = conf.filter(rg).first().section("=",1,-1).simplified();
+    }
+    // - Dispatcher queues: "DISPATCHER_QUEUE_<name>=<max running>[,<priority>[,<queue it waits on> ...]]"
+    QStringList queues = conf.filter(QRegExp("DISPATCHER_QUEUE_*=*",Qt::CaseSensitive,QRegExp::Wildcard));
+    for(int i=0; i<queues.length(); i++){
+      QString name = queues[i].section("=",0,0).section("DISPATCHER_QUEUE_",1,-1).simplified();
+      QStringList vals = queues[i].section("=",1,-1).split(",");
+      bool ok = false;
+      int max = vals[0].simplified().toInt(&ok);
+      if(name.isEmpty() || !ok){ continue; }
+      DISPATCHER->defineQueue(name, max, vals.value(1).simplified().toInt(), vals.value(2).split(" ",QString::SkipEmptyParts) );
+    }
+    rg = QRegExp("DISPATCHER_MAX_RUNNING=*",Qt::CaseSensitive,QRegExp::Wildcard);
+    if(!conf.filter(rg).isEmpty()){
+      DISPATCHER->setMaxRunning( conf.filter(rg).first().section("=",1,1).simplified().toInt() );
+    }
+    // - Dispatcher job output: bytes kept in memory per job + directory for the full output of each job
+    int outputBytes = DISPATCHER_OUTPUT_BYTES;
+    QString outputDir;
+    rg = QRegExp("DISPATCHER_OUTPUT_BYTES=*",Qt::CaseSensitive,QRegExp::Wildcard);
+    if(!conf.filter(rg).isEmpty()){
+      bool ok = false;
+      int tmp = conf.filter(rg).first().section("=",1,1).simplified().toInt(&ok);
+      if(ok && tmp>0){ outputBytes = tmp; }
+    }
+    rg = QRegExp("DISPATCHER_OUTPUT_DIR=*",Qt::CaseSensitive,QRegExp::Wildcard);
+    if(!conf.filter(rg).isEmpty()){
+      outputDir = conf.filter(rg).first().section("=",1,-1).simplified();
+    }
+    DISPATCHER->setOutputLimits(outputBytes, outputDir);
+    // - Background system sampler interval (msecs, 0 to disable)
+    int sampleInterval = 1000;
+    rg = QRegExp("SAMPLER_INTERVAL_MS=*",Qt::CaseSensitive,QRegExp::Wildcard);
+    if(!conf.filter(rg).isEmpty()){
+      bool ok = false;
+      int tmp = conf.filter(rg).first().section("=",1,1).simplified().toInt(&ok);
+      if(ok && tmp>=0){ sampleInterval = tmp; }
+    }
+    // - Command executor (process/record/replay) - environment variables override the config file
+    QString execMode, execDir;
+    int execLatency = 0;
+    rg = QRegExp("COMMAND_EXECUTOR=*",Qt::CaseSensitive,QRegExp::Wildcard);
+    if(!conf.filter(rg).isEmpty()){ execMode = conf.filter(rg).first().section("=",1,1).simplified(); }
+    rg = QRegExp("COMMAND_FIXTURE_DIR=*",Qt::CaseSensitive,QRegExp::Wildcard);
+    if(!conf.filter(rg).isEmpty()){ execDir = conf.filter(rg).first().section("=",1,-1).simplified(); }
+    rg = QRegExp("COMMAND_FIXTURE_LATENCY=*",Qt::CaseSensitive,QRegExp::Wildcard);
+    if(!conf.filter(rg).isEmpty()){ execLatency = conf.filter(rg).first().section("=",1,1).simplified().toInt(); }
+    if(!qgetenv("SYSADM_COMMAND_EXECUTOR").isEmpty()){ execMode = QString(qgetenv("SYSADM_COMMAND_EXECUTOR")); }
+    if(!qgetenv("SYSADM_FIXTURE_DIR").isEmpty()){ execDir = QString(qgetenv("SYSADM_FIXTURE_DIR")); }
+    if(!qgetenv("SYSADM_FIXTURE_LATENCY").isEmpty()){ execLatency = QString(qgetenv("SYSADM_FIXTURE_LATENCY")).toInt(); }
 
     //Setup the log file
     LogManager::checkLogDir(); //ensure the logging directory exists
@@ -259,6 +328,13 @@ int main( int argc, char ** argv )
     QObject::connect(DISPATCHER, SIGNAL(DispatchEvent(QJsonObject)), EVENTS, SLOT(DispatchEvent(QJsonObject)) );
     QObject::connect(DISPATCHER, SIGNAL(DispatchStarting(QString)), EVENTS, SLOT(DispatchStarting(QString)) );
       
+    if(!execMode.isEmpty()){
+      if(sysadm::CommandExecutor::install(execMode, execDir, execLatency)){ qDebug() << "Command executor:" << execMode << execDir; }
+      else{ qDebug() << "Invalid command executor settings:" << execMode << execDir; }
+    }
+    if(sampleInterval>0 && !sysadm::SystemSampler::start(sampleInterval)){ qDebug() << "Could not start the system sampler"; }
+    //Probe the available subsystems before any connections come in
+    WebSocket::ProbeSubsystems();
     //Create the daemon
     qDebug() << "Starting the PC-BSD sysadm server...." << (websocket ? "(WebSocket)" : "(TCP)");
     WebServer *w = new WebServer(); 
@@ -272,15 +348,25 @@ int main( int argc, char ** argv )
       TBACK.start();
       TBACK2.start();
       QTimer::singleShot(0,EVENTS, SLOT(start()) );
+      //Restore any jobs which were still queued when the server stopped (separate journal for each server type)
+      QMetaObject::invokeMethod(DISPATCHER, "start", Qt::QueuedConnection, Q_ARG(QString, QString(DISPATCH_QUEUE)+(websocket ? "-ws" : "-tcp")) );
+      //Periodically dump the latency metrics if requested
+      QTimer metricsTimer;
+      if(!metricsFile.isEmpty()){
+        QObject::connect(&metricsTimer, &QTimer::timeout, [metricsFile](){ sysadm::Metrics::writePrometheusFile(metricsFile); });
+        metricsTimer.start(30000); //30 seconds
+      }
       //Now start the main event loop
       ret = a.exec();
       qDebug() << "Server Stopped:" << QDateTime::currentDateTime().toString(Qt::ISODate);
+      QMetaObject::invokeMethod(DISPATCHER, "stop", Qt::BlockingQueuedConnection);
       //TBACK.stop();
     }else{
       qDebug() << "[FATAL] Server could not be started:" << QDateTime::currentDateTime().toString(Qt::ISODate);
       qDebug() << " - Tried port:" << port;
     }
     //Cleanup any globals
+    sysadm::SystemSampler::stop();
     delete CONFIG;
     logfile.close();
     
@@ -12,7 +12,8 @@ HEADERS	+= globals.h globals-qt.h \
 		SslServer.h \
 		EventWatcher.h \
 		LogManager.h \
-		Dispatcher.h
+		Dispatcher.h \
+		RequestScheduler.h
 		
 SOURCES	+= main.cpp \
 		WebServer.cpp \
@@ -23,7 +24,10 @@ SOURCES	+= main.cpp \
 		EventWatcher.cpp \
 		LogManager.cpp \
 		Dispatcher.cpp \
-		DispatcherParsing.cpp
+		DispatcherParsing.cpp \
+		DispatcherJournal.cpp \
+		DispatcherOutput.cpp \
+		RequestScheduler.cpp
 
 #Now pull in the the subsystem library classes and such
 include("library/library.pri");
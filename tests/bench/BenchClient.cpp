@@ -0,0 +1,200 @@
+// ===============================
+//  PC-BSD REST API Server - load generator
+// Available under the 3-clause BSD License
+// =================================
+#include "BenchClient.h"
+
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QUrl>
+
+BenchClient::BenchClient(MODE mode, int num, const bench_options *opts) : QObject(){
+  MODE_ = mode;
+  NUM = num;
+  OPTS = opts;
+  WSOCKET = 0;
+  TSOCKET = 0;
+  authed = done = false;
+  sent = errors = 0;
+  randState = 2463534242u + 7919u*num; //fixed seed per client - runs are repeatable
+}
+
+BenchClient::~BenchClient(){
+  if(WSOCKET!=0){ WSOCKET->deleteLater(); }
+  if(TSOCKET!=0){ TSOCKET->deleteLater(); }
+}
+
+void BenchClient::start(){
+  if(OPTS->requests>0){ latencies.reserve(OPTS->requests); }
+  if(MODE_==WEBSOCKET){
+    WSOCKET = new QWebSocket("sysadm-bench", QWebSocketProtocol::VersionLatest, this);
+    connect(WSOCKET, SIGNAL(connected()), this, SLOT(connected()) );
+    connect(WSOCKET, SIGNAL(disconnected()), this, SLOT(disconnected()) );
+    connect(WSOCKET, SIGNAL(textMessageReceived(const QString&)), this, SLOT(wsMessage(const QString&)) );
+    connect(WSOCKET, SIGNAL(sslErrors(const QList<QSslError>&)), this, SLOT(sslErrors(const QList<QSslError>&)) );
+    connect(WSOCKET, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketError()) );
+    WSOCKET->open(QUrl("wss://"+OPTS->host+":"+QString::number(OPTS->wsport)));
+  }else{
+    sendAuth();
+  }
+}
+
+// === PRIVATE ===
+const bench_request& BenchClient::pickRequest(){
+  //xorshift32 - cheap and independent of the Qt version
+  randState ^= randState << 13;
+  randState ^= randState >> 17;
+  randState ^= randState << 5;
+  int total = 0;
+  for(int i=0; i<OPTS->mix.length(); i++){ total += OPTS->mix[i].weight; }
+  int pick = randState % total;
+  for(int i=0; i<OPTS->mix.length(); i++){
+    if(pick < OPTS->mix[i].weight){ return OPTS->mix[i]; }
+    pick -= OPTS->mix[i].weight;
+  }
+  return OPTS->mix.last();
+}
+
+QByteArray BenchClient::restMessage(const bench_request &req){
+  QJsonObject obj;
+    obj.insert("id", curID);
+    obj.insert("args", req.args);
+  QByteArray body = QJsonDocument(obj).toJson(QJsonDocument::Compact);
+  QStringList headers;
+  headers << "POST /"+req.namesp+"/"+req.name+" HTTP/1.1";
+  headers << "Host: "+OPTS->host;
+  //Every REST request is on a new connection - the credentials need to go with each one
+  headers << "Authorization: Basic "+QString( (OPTS->user+":"+OPTS->pass).toUtf8().toBase64() );
+  headers << "Content-Type: application/json";
+  headers << "Content-Length: "+QString::number(body.size());
+  headers << "" << "";
+  return headers.join("\r\n").toUtf8() + body;
+}
+
+void BenchClient::sendAuth(){
+  curID = "auth";
+  if(MODE_==WEBSOCKET){
+    QJsonObject args;
+      args.insert("username", OPTS->user);
+      args.insert("password", OPTS->pass);
+    QJsonObject obj;
+      obj.insert("namespace", "rpc");
+      obj.insert("name", "auth");
+      obj.insert("id", curID);
+      obj.insert("args", args);
+    WSOCKET->sendTextMessage( QJsonDocument(obj).toJson(QJsonDocument::Compact) );
+  }else{
+    //REST logins ride along with each request - the first one just checks the credentials
+    restSend(OPTS->mix.first());
+  }
+}
+
+void BenchClient::restSend(const bench_request &req){
+  //The server closes the connection after each reply (the connect + handshake are part of the latency)
+  if(TSOCKET!=0){
+    TSOCKET->disconnect(this);
+    TSOCKET->abort();
+    TSOCKET->deleteLater();
+  }
+  incoming.clear();
+  outgoing = restMessage(req);
+  TSOCKET = new QSslSocket(this);
+  connect(TSOCKET, SIGNAL(encrypted()), this, SLOT(connected()) );
+  connect(TSOCKET, SIGNAL(disconnected()), this, SLOT(disconnected()) );
+  connect(TSOCKET, SIGNAL(readyRead()), this, SLOT(restReadyRead()) );
+  connect(TSOCKET, SIGNAL(sslErrors(const QList<QSslError>&)), this, SLOT(sslErrors(const QList<QSslError>&)) );
+  connect(TSOCKET, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketError()) );
+  TSOCKET->connectToHostEncrypted(OPTS->host, OPTS->restport);
+}
+
+void BenchClient::sendNext(){
+  if(OPTS->requests>0 && sent >= OPTS->requests){ finish(); return; }
+  if(OPTS->deadline>0 && QDateTime::currentMSecsSinceEpoch() >= OPTS->deadline){ finish(); return; }
+  const bench_request &req = pickRequest();
+  sent++;
+  curID = "bench-"+QString::number(NUM)+"-"+QString::number(sent);
+  timer.start();
+  if(MODE_==WEBSOCKET){
+    QJsonObject obj;
+      obj.insert("namespace", req.namesp);
+      obj.insert("name", req.name);
+      obj.insert("id", curID);
+      obj.insert("args", req.args);
+    WSOCKET->sendTextMessage( QJsonDocument(obj).toJson(QJsonDocument::Compact) );
+  }else{
+    restSend(req);
+  }
+}
+
+void BenchClient::gotReply(bool ok){
+  if(!authed){
+    if(!ok){ finish("Authorization failed"); return; }
+    authed = true;
+  }else{
+    latencies << timer.nsecsElapsed()/1000;
+    if(!ok){ errors++; }
+  }
+  sendNext();
+}
+
+void BenchClient::finish(QString err){
+  if(done){ return; }
+  done = true;
+  failure = err;
+  if(WSOCKET!=0){ WSOCKET->disconnect(this); WSOCKET->close(); }
+  if(TSOCKET!=0){ TSOCKET->disconnect(this); TSOCKET->disconnectFromHost(); }
+  emit finished();
+}
+
+// === PRIVATE SLOTS ===
+void BenchClient::connected(){
+  if(MODE_==WEBSOCKET){ sendAuth(); }
+  else{ TSOCKET->write(outgoing); }
+}
+
+void BenchClient::disconnected(){
+  if(MODE_==REST && authed){
+    //Closed before the full reply came in (complete replies already started the next request)
+    latencies << timer.nsecsElapsed()/1000;
+    errors++;
+    sendNext();
+    return;
+  }
+  finish("Connection closed by the server");
+}
+
+void BenchClient::wsMessage(const QString &msg){
+  QJsonObject obj = QJsonDocument::fromJson(msg.toUtf8()).object();
+  if(obj.value("id").toString() != curID){ return; } //events or stale replies
+  gotReply( obj.value("name").toString()!="error" );
+}
+
+void BenchClient::restReadyRead(){
+  incoming.append( TSOCKET->readAll() );
+  if(done){ return; }
+  //Reply: status line + headers, blank line, then "Content-Length" bytes of body (if any)
+  int hend = incoming.indexOf("\r\n\r\n");
+  if(hend<0){ return; }
+  QList<QByteArray> headers = incoming.left(hend).split('\n');
+  int length = 0;
+  for(int i=1; i<headers.length(); i++){
+    if(headers[i].toLower().startsWith("content-length:")){ length = headers[i].mid(15).trimmed().toInt(); }
+  }
+  if(incoming.size() < hend+4+length){ return; } //body not complete yet
+  int code = headers.first().simplified().split(' ').value(1).toInt();
+  gotReply(code>=200 && code<300); //starts the next request on a new connection
+}
+
+void BenchClient::sslErrors(const QList<QSslError> &errs){
+  Q_UNUSED(errs);
+  //Local servers use self-signed certificates
+  if(WSOCKET!=0){ WSOCKET->ignoreSslErrors(); }
+  if(TSOCKET!=0){ TSOCKET->ignoreSslErrors(); }
+}
+
+void BenchClient::socketError(){
+  //REST: the server closing the connection is normal (handled by disconnected())
+  if(TSOCKET!=0 && TSOCKET->error()==QAbstractSocket::RemoteHostClosedError){ return; }
+  QString err = (WSOCKET!=0) ? WSOCKET->errorString() : TSOCKET->errorString();
+  finish(err);
+}
@@ -0,0 +1,86 @@
+// ===============================
+//  PC-BSD REST API Server - load generator
+// Available under the 3-clause BSD License
+// =================================
+#ifndef _PCBSD_SYSADM_BENCH_CLIENT_H
+#define _PCBSD_SYSADM_BENCH_CLIENT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QList>
+#include <QVector>
+#include <QSslSocket>
+#include <QWebSocket>
+
+//Single entry in a request mix
+struct bench_request{
+  int weight;
+  QString namesp, name;
+  QJsonValue args;
+};
+
+//Settings shared by all the clients
+struct bench_options{
+  QString host;
+  int wsport, restport;
+  QString user, pass;
+  int requests; //per client (0: run until the deadline)
+  qint64 deadline; //msecs since epoch (0: no deadline)
+  QList<bench_request> mix;
+};
+
+//Single client which sends requests one at a time (closed loop) and records the latency of each
+// - websocket: one connection for the whole run (login once)
+// - REST: the server closes the connection after every reply - each request gets a new connection + the credentials
+class BenchClient : public QObject{
+	Q_OBJECT
+public:
+	enum MODE{ WEBSOCKET, REST };
+	BenchClient(MODE mode, int num, const bench_options *opts);
+	~BenchClient();
+
+	void start();
+
+	MODE mode(){ return MODE_; }
+	QVector<qint64> latencies; //usecs for each completed request
+	int errors;
+	QString failure; //set when the client gave up (connection/auth problem)
+
+private:
+	MODE MODE_;
+	int NUM;
+	const bench_options *OPTS;
+	QWebSocket *WSOCKET;
+	QSslSocket *TSOCKET;
+	QByteArray incoming; //REST reply data not processed yet
+	QByteArray outgoing; //REST request waiting for the connection
+	bool authed, done;
+	int sent;
+	QString curID;
+	QElapsedTimer timer;
+	quint32 randState;
+
+	const bench_request& pickRequest();
+	QByteArray restMessage(const bench_request &req);
+	void sendAuth();
+	void restSend(const bench_request &req); //new connection for this request
+	void sendNext();
+	void gotReply(bool ok);
+	void finish(QString err = "");
+
+private slots:
+	void connected();
+	void disconnected();
+	void wsMessage(const QString &msg);
+	void restReadyRead();
+	void sslErrors(const QList<QSslError> &errs);
+	void socketError();
+
+signals:
+	void finished();
+};
+
+#endif
@@ -0,0 +1,85 @@
+#!/bin/sh
+# Generate a pkg repository database with fake packages (for the pkg benchmarks)
+# Usage: gen-pkg-repo.sh <output.sqlite> [packages] [categories]
+#  Install it as /var/db/pkg/repo-<name>.sqlite (and use "repo":"<name>" in the request mix)
+
+OUT="$1"
+NUM="${2:-5000}"
+NCAT="${3:-40}"
+if [ -z "$OUT" ] ; then
+  echo "Usage: $0 <output.sqlite> [packages] [categories]"
+  exit 1
+fi
+rm -f "$OUT"
+
+sqlite3 "$OUT" <<SQL
+CREATE TABLE packages (id INTEGER PRIMARY KEY, origin TEXT NOT NULL, name TEXT NOT NULL, version TEXT NOT NULL,
+  comment TEXT NOT NULL, desc TEXT NOT NULL, arch TEXT NOT NULL, maintainer TEXT NOT NULL, www TEXT, prefix TEXT NOT NULL,
+  pkgsize INTEGER NOT NULL, flatsize INTEGER NOT NULL, licenselogic INTEGER NOT NULL, cksum TEXT NOT NULL, path TEXT NOT NULL,
+  pkg_format_version INTEGER, manifestdigest TEXT NULL, olddigest TEXT NULL, dep_formula TEXT NULL, vital INTEGER NOT NULL DEFAULT 0);
+CREATE TABLE deps (origin TEXT, name TEXT, version TEXT, package_id INTEGER);
+CREATE TABLE categories (id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);
+CREATE TABLE pkg_categories (package_id INTEGER, category_id INTEGER);
+CREATE TABLE licenses (id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);
+CREATE TABLE pkg_licenses (package_id INTEGER, license_id INTEGER);
+CREATE TABLE option (option_id INTEGER PRIMARY KEY, option TEXT NOT NULL UNIQUE);
+CREATE TABLE option_desc (option_desc_id INTEGER PRIMARY KEY, option_desc TEXT NOT NULL UNIQUE);
+CREATE TABLE pkg_option (package_id INTEGER NOT NULL, option_id INTEGER NOT NULL, value TEXT NOT NULL);
+CREATE TABLE shlibs (id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);
+CREATE TABLE pkg_shlibs_required (package_id INTEGER NOT NULL, shlib_id INTEGER NOT NULL);
+CREATE TABLE pkg_shlibs_provided (package_id INTEGER NOT NULL, shlib_id INTEGER NOT NULL);
+CREATE TABLE annotation (annotation_id INTEGER PRIMARY KEY, annotation TEXT NOT NULL UNIQUE);
+CREATE TABLE pkg_annotation (package_id INTEGER, tag_id INTEGER NOT NULL, value_id INTEGER NOT NULL);
+CREATE TABLE pkg_conflicts (package_id INTEGER NOT NULL, conflict_id INTEGER NOT NULL);
+CREATE TABLE provides (id INTEGER PRIMARY KEY, provide TEXT NOT NULL);
+CREATE TABLE pkg_provides (package_id INTEGER NOT NULL, provide_id INTEGER NOT NULL);
+CREATE TABLE requires (id INTEGER PRIMARY KEY, require TEXT NOT NULL);
+CREATE TABLE pkg_requires (package_id INTEGER NOT NULL, require_id INTEGER NOT NULL);
+CREATE TABLE files (package_id INTEGER, path TEXT);
+CREATE TABLE config_files (package_id INTEGER, path TEXT);
+CREATE TABLE users (id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);
+CREATE TABLE pkg_users (package_id INTEGER, user_id INTEGER);
+CREATE TABLE "groups" (id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);
+CREATE TABLE pkg_groups (package_id INTEGER, group_id INTEGER);
+CREATE INDEX packages_origin ON packages(origin);
+CREATE INDEX packages_name ON packages(name);
+CREATE INDEX deps_package ON deps (package_id);
+CREATE INDEX deps_name ON deps (name);
+
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM n WHERE i<$NCAT)
+  INSERT INTO categories (id, name) SELECT i, 'cat' || i FROM n;
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM n WHERE i<$NUM)
+  INSERT INTO packages (id, origin, name, version, comment, desc, arch, maintainer, www, prefix, pkgsize, flatsize, licenselogic, cksum, path)
+  SELECT i, 'cat' || (i % $NCAT + 1) || '/pkg' || i, 'pkg' || i, '1.' || (i % 10) || '.0',
+    'Fake package number ' || i || ' for testing', 'Long description of fake package ' || i || '. It does nothing useful at all.',
+    'FreeBSD:11:amd64', 'ports@FreeBSD.org', 'http://www.example.org/', '/usr/local', 1000 + i, 5000 + i, 1, 'abc' || i, 'All/pkg' || i || '.txz'
+  FROM n;
+INSERT INTO pkg_categories SELECT id, id % $NCAT + 1 FROM packages;
+INSERT INTO licenses (id, name) VALUES (1, 'BSD2CLAUSE'), (2, 'GPLv2'), (3, 'MIT');
+INSERT INTO pkg_licenses SELECT id, id % 3 + 1 FROM packages;
+INSERT INTO option (option_id, option) VALUES (1, 'DOCS'), (2, 'NLS'), (3, 'EXAMPLES');
+INSERT INTO pkg_option SELECT id, 1, 'on' FROM packages;
+INSERT INTO pkg_option SELECT id, 2, 'off' FROM packages;
+INSERT INTO shlibs (id, name) SELECT id, 'libpkg' || id || '.so.1' FROM packages;
+INSERT INTO pkg_shlibs_provided SELECT id, id FROM packages;
+INSERT INTO pkg_shlibs_required SELECT id, (id * 7) % $NUM + 1 FROM packages;
+INSERT INTO annotation (annotation_id, annotation) VALUES (1, 'repo_type'), (2, 'binary'), (3, 'repository'), (4, 'FreeBSD');
+INSERT INTO pkg_annotation SELECT id, 1, 2 FROM packages;
+INSERT INTO pkg_annotation SELECT id, 3, 4 FROM packages;
+INSERT INTO deps SELECT p.origin, p.name, p.version, d.id FROM packages AS d INNER JOIN packages AS p ON p.id = (d.id * 13) % $NUM + 1;
+INSERT INTO deps SELECT p.origin, p.name, p.version, d.id FROM packages AS d INNER JOIN packages AS p ON p.id = (d.id * 31) % $NUM + 1;
+INSERT INTO files SELECT id, '/usr/local/bin/pkg' || id FROM packages;
+INSERT INTO files SELECT id, '/usr/local/share/doc/pkg' || id || '/README' FROM packages;
+INSERT INTO files SELECT id, '/usr/local/lib/libpkg' || id || '.so.1' FROM packages;
+INSERT INTO config_files SELECT id, '/usr/local/etc/pkg' || id || '.conf.sample' FROM packages WHERE id % 5 = 0;
+INSERT INTO users (id, name) VALUES (1, 'www');
+INSERT INTO "groups" (id, name) VALUES (1, 'www');
+INSERT INTO pkg_users SELECT id, 1 FROM packages WHERE id % 50 = 0;
+INSERT INTO pkg_groups SELECT id, 1 FROM packages WHERE id % 50 = 0;
+INSERT INTO provides (id, provide) SELECT id, 'pkg' || id || '-provide' FROM packages WHERE id % 10 = 0;
+INSERT INTO pkg_provides SELECT id, id FROM provides;
+INSERT INTO requires (id, require) SELECT id, 'pkg' || id || '-provide' FROM packages WHERE id % 10 = 0;
+INSERT INTO pkg_requires SELECT id % $NUM + 1, id FROM requires;
+INSERT INTO pkg_conflicts SELECT id, id + 1 FROM packages WHERE id % 100 = 0 AND id < $NUM;
+SQL
+echo "Created $OUT with $NUM packages in $NCAT categories"
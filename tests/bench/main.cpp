@@ -0,0 +1,141 @@
+// ===============================
+//  PC-BSD REST API Server - load generator
+// Available under the 3-clause BSD License
+// =================================
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QTimer>
+
+#include <algorithm>
+
+#include "BenchClient.h"
+
+void showUsage(){
+qDebug() << "sysadm-bench usage:";
+qDebug() << "    \"sysadm-bench [options]\"";
+qDebug() << "Options:";
+qDebug() << "  \"-host <address>\": Server to connect to (default: 127.0.0.1)";
+qDebug() << "  \"-wsport <port>\" / \"-restport <port>\": Server ports (default: 12150 / 12151)";
+qDebug() << "  \"-ws <num>\": Number of concurrent websocket clients (default: 10)";
+qDebug() << "  \"-rest <num>\": Number of concurrent REST clients (default: 0)";
+qDebug() << "  \"-requests <num>\": Requests sent by each client (default: 1000)";
+qDebug() << "  \"-duration <seconds>\": Run for a fixed time instead of a fixed number of requests";
+qDebug() << "  \"-mix <file>\": JSON request mix (default: mixes/default.json)";
+qDebug() << "  \"-user <name>\" / \"-pass <password>\": Login (default: root / $SYSADM_BENCH_PASS)";
+}
+
+//Read the request mix: [ {"weight":<num>, "namespace":<text>, "name":<text>, "args":<value>}, ... ]
+QList<bench_request> loadMix(QString path){
+  QList<bench_request> out;
+  QFile file(path);
+  if(!file.open(QIODevice::ReadOnly)){ return out; }
+  QJsonArray arr = QJsonDocument::fromJson(file.readAll()).array();
+  file.close();
+  for(int i=0; i<arr.count(); i++){
+    QJsonObject obj = arr[i].toObject();
+    bench_request req;
+      req.weight = obj.value("weight").toInt(1);
+      req.namesp = obj.value("namespace").toString();
+      req.name = obj.value("name").toString();
+      req.args = obj.value("args");
+    if(req.weight<1 || req.namesp.isEmpty() || req.name.isEmpty()){ continue; }
+    out << req;
+  }
+  return out;
+}
+
+//Exact percentile from a sorted list (nearest rank)
+inline double percentileMs(const QVector<qint64> &sorted, double pct){
+  if(sorted.isEmpty()){ return 0; }
+  int index = qBound(0, (int) (pct*sorted.size() + 0.5) - 1, sorted.size()-1);
+  return sorted[index]/1000.0;
+}
+
+void showResults(QTextStream &out, QString label, QList<BenchClient*> clients, double secs){
+  QVector<qint64> lat;
+  int errors = 0, failed = 0;
+  for(int i=0; i<clients.length(); i++){
+    lat << clients[i]->latencies;
+    errors += clients[i]->errors;
+    if(!clients[i]->failure.isEmpty()){ failed++; }
+  }
+  if(clients.isEmpty()){ return; }
+  std::sort(lat.begin(), lat.end());
+  out << QString("%1: %2 clients (%3 failed), %4 requests, %5 errors\n").arg(label, QString::number(clients.length()), QString::number(failed), QString::number(lat.size()), QString::number(errors));
+  out << QString("  throughput: %1 req/s\n").arg(QString::number(secs>0 ? lat.size()/secs : 0, 'f', 1));
+  out << QString("  latency (ms): p50 %1  p99 %2  p999 %3  max %4\n").arg( QString::number(percentileMs(lat,0.5),'f',3), QString::number(percentileMs(lat,0.99),'f',3),
+		QString::number(percentileMs(lat,0.999),'f',3), QString::number(lat.isEmpty() ? 0 : lat.last()/1000.0,'f',3) );
+}
+
+int main( int argc, char ** argv )
+{
+  QCoreApplication A(argc, argv);
+  QTextStream out(stdout);
+  bench_options opts;
+    opts.host = "127.0.0.1";
+    opts.wsport = 12150;
+    opts.restport = 12151;
+    opts.user = "root";
+    opts.pass = QString(qgetenv("SYSADM_BENCH_PASS"));
+    opts.requests = 1000;
+    opts.deadline = 0;
+  int numWS = 10, numREST = 0, duration = 0;
+  QString mixfile = "mixes/default.json";
+  for(int i=1; i<argc; i++){
+    QString arg(argv[i]);
+    bool hasval = (i+1 < argc);
+    if(arg=="-h" || arg=="help" || arg=="--help"){ showUsage(); return 0; }
+    else if(arg=="-host" && hasval){ i++; opts.host = argv[i]; }
+    else if(arg=="-wsport" && hasval){ i++; opts.wsport = QString(argv[i]).toInt(); }
+    else if(arg=="-restport" && hasval){ i++; opts.restport = QString(argv[i]).toInt(); }
+    else if(arg=="-ws" && hasval){ i++; numWS = QString(argv[i]).toInt(); }
+    else if(arg=="-rest" && hasval){ i++; numREST = QString(argv[i]).toInt(); }
+    else if(arg=="-requests" && hasval){ i++; opts.requests = QString(argv[i]).toInt(); }
+    else if(arg=="-duration" && hasval){ i++; duration = QString(argv[i]).toInt(); }
+    else if(arg=="-mix" && hasval){ i++; mixfile = argv[i]; }
+    else if(arg=="-user" && hasval){ i++; opts.user = argv[i]; }
+    else if(arg=="-pass" && hasval){ i++; opts.pass = argv[i]; }
+    else{ qDebug() << "Unknown option:" << arg; showUsage(); return 1; }
+  }
+  opts.mix = loadMix(mixfile);
+  if(opts.mix.isEmpty()){ qDebug() << "No requests found in mix file:" << mixfile; return 1; }
+  if(numWS + numREST < 1){ qDebug() << "No clients requested"; return 1; }
+
+  //Start all the clients
+  QList<BenchClient*> wsclients, restclients;
+  int running = numWS + numREST;
+  for(int i=0; i<running; i++){
+    BenchClient *C = new BenchClient( (i<numWS ? BenchClient::WEBSOCKET : BenchClient::REST), i, &opts);
+    if(i<numWS){ wsclients << C; }
+    else{ restclients << C; }
+    QObject::connect(C, &BenchClient::finished, [&](){ running--; if(running==0){ A.quit(); } });
+  }
+  QElapsedTimer timer;
+  timer.start();
+  if(duration>0){
+    opts.requests = 0;
+    opts.deadline = QDateTime::currentMSecsSinceEpoch() + duration*1000;
+  }
+  for(int i=0; i<wsclients.length(); i++){ wsclients[i]->start(); }
+  for(int i=0; i<restclients.length(); i++){ restclients[i]->start(); }
+  A.exec();
+  double secs = timer.elapsed()/1000.0;
+
+  //Now report the results
+  QStringList failures;
+  for(int i=0; i<wsclients.length(); i++){ if(!wsclients[i]->failure.isEmpty()){ failures << wsclients[i]->failure; } }
+  for(int i=0; i<restclients.length(); i++){ if(!restclients[i]->failure.isEmpty()){ failures << restclients[i]->failure; } }
+  failures.removeDuplicates();
+  out << QString("Ran for %1 seconds against %2 (mix: %3)\n").arg(QString::number(secs,'f',2), opts.host, mixfile);
+  if(!failures.isEmpty()){ out << "Client failures: " << failures.join(", ") << "\n"; }
+  showResults(out, "WebSocket", wsclients, secs);
+  showResults(out, "REST", restclients, secs);
+  if(!wsclients.isEmpty() && !restclients.isEmpty()){ showResults(out, "Total", wsclients+restclients, secs); }
+  out.flush();
+  return failures.isEmpty() ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+// ===============================
+//  PC-BSD REST API Server - micro benchmarks
+// Available under the 3-clause BSD License
+// =================================
+// AuthorizationManager: token -> session lookups with lots of live sessions
+//  - plus a stress run where sessions are created/used/closed from many threads at once
+//  - sessions are created with service logins (no PAM), the "auth/allowServiceAuth" setting is turned on in main.cpp
+//=================================
+#include "microbench.h"
+#include "globals.h"
+#include "AuthorizationManager.h"
+
+#include <QSet>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#define AUTH_SESSIONS 10000 //live sessions during the lookups
+#define AUTH_LOOKUPS 200000 //lookups per run (split across the workers)
+#define AUTH_STRESS_OPS 20000 //session operations per stress worker
+
+//Work for a single lookup worker
+struct lookup_job{
+  AuthorizationManager *auth;
+  const QStringList *tokens;
+  int start, count;
+  bool valid; //tokens are live sessions (otherwise they should all be rejected)
+  bool full; //also look up the user/access level (like every request does)
+};
+
+struct lookup_result{
+  QVector<qint64> lat; //nsecs
+  int wrong;
+};
+
+static lookup_result lookupWorker(lookup_job job){
+  lookup_result R;
+  R.wrong = 0;
+  R.lat.reserve(job.count);
+  QElapsedTimer timer;
+  for(int i=0; i<job.count; i++){
+    //Stride through the list so the workers do not walk the sessions in the same order
+    const QString &tok = job.tokens->at( (job.start + i*7919) % job.tokens->length() );
+    timer.start();
+    bool ok = job.auth->checkAuth(tok);
+    if(ok && job.full){ ok = (job.auth->userForToken(tok)=="root" && !job.auth->hasFullAccess(tok)); }
+    R.lat << timer.nsecsElapsed();
+    if(ok!=job.valid){ R.wrong++; }
+  }
+  return R;
+}
+
+//Run the lookups "rounds" times on "threads" workers: show the best run and check every answer
+static int runLookups(QTextStream &out, QString label, AuthorizationManager *auth, const QStringList &tokens, bool valid, bool full, int threads, int rounds){
+  QThreadPool pool;
+  pool.setMaxThreadCount(threads);
+  qint64 best = -1;
+  QVector<qint64> lat;
+  int wrong = 0;
+  for(int r=0; r<rounds; r++){
+    QList< QFuture<lookup_result> > futures;
+    QElapsedTimer timer;
+    timer.start();
+    for(int t=0; t<threads; t++){
+      lookup_job job;
+        job.auth = auth;
+        job.tokens = &tokens;
+        job.start = t*(tokens.length()/threads);
+        job.count = AUTH_LOOKUPS/threads;
+        job.valid = valid;
+        job.full = full;
+      futures << QtConcurrent::run(&pool, lookupWorker, job);
+    }
+    QVector<qint64> rlat;
+    for(int t=0; t<futures.length(); t++){
+      lookup_result R = futures[t].result();
+      rlat << R.lat;
+      wrong += R.wrong;
+    }
+    qint64 nsecs = timer.nsecsElapsed();
+    if(best<0 || nsecs<best){ best = nsecs; lat = rlat; }
+  }
+  std::sort(lat.begin(), lat.end());
+  double secs = best/1e9;
+  out << QString("  %1: %2 lookups on %3 threads: %4 lookups/s, latency (ns): p50 %5  p99 %6  max %7 %8\n").arg(label,
+		QString::number(lat.size()), QString::number(threads), QString::number(secs>0 ? lat.size()/secs : 0, 'f', 0),
+		QString::number(percentile(lat,0.5)), QString::number(percentile(lat,0.99)), QString::number(lat.isEmpty() ? 0 : lat.last()),
+		(wrong==0 ? QString("OK") : "FAILED: "+QString::number(wrong)+" wrong answers") );
+  return (wrong>0 ? 1 : 0);
+}
+
+//Stress worker: its own sessions come and go while the shared ones are looked up
+struct stress_result{
+  int ops, wrong;
+  QStringList cleared; //own sessions which were closed again
+};
+
+static stress_result stressWorker(AuthorizationManager *auth, const QStringList *shared, int num){
+  stress_result R;
+  R.ops = R.wrong = 0;
+  quint32 rand = 2463534242u + 7919u*num; //xorshift32, fixed seed per worker
+  for(int i=0; i<AUTH_STRESS_OPS; i++){
+    rand ^= rand << 13;
+    rand ^= rand >> 17;
+    rand ^= rand << 5;
+    if(i%4==0){
+      //Full session lifetime: login, use it, logout, make sure it is gone
+      QString tok = auth->LoginService(QHostAddress::LocalHost, "root");
+      bool ok = !tok.isEmpty() && auth->checkAuth(tok) && auth->userForToken(tok)=="root";
+      auth->clearAuth(tok);
+      ok = ok && !auth->checkAuth(tok) && auth->userForToken(tok).isEmpty();
+      if(!ok){ R.wrong++; }
+      if(R.cleared.length()<100){ R.cleared << tok; }
+      R.ops += 5;
+    }else{
+      //Shared sessions have to stay valid the whole time
+      const QString &tok = shared->at(rand % shared->length());
+      bool ok = auth->checkAuth(tok) && auth->userForToken(tok)=="root" && !auth->hasFullAccess(tok);
+      if(!ok){ R.wrong++; }
+      R.ops += 3;
+    }
+  }
+  return R;
+}
+
+//Create the live sessions - returns their tokens
+static QStringList createSessions(QTextStream &out, AuthorizationManager *auth, int num, int *failed){
+  QStringList tokens;
+  QElapsedTimer timer;
+  timer.start();
+  for(int i=0; i<num; i++){ tokens << auth->LoginService(QHostAddress::LocalHost, "root"); }
+  qint64 nsecs = timer.nsecsElapsed();
+  QSet<QString> unique = tokens.toSet();
+  bool ok = (unique.size()==num && !unique.contains(""));
+  if(!ok){ (*failed)++; }
+  out << QString("  %1 sessions created in %2 ms %3\n").arg(QString::number(num), QString::number(nsecs/1e6, 'f', 3),
+		(ok ? QString("OK") : "FAILED: "+QString::number(num-unique.size())+" duplicate or empty tokens") );
+  return tokens;
+}
+
+int benchTokens(QTextStream &out, const microbench_options &opts){
+  out << "tokens:\n";
+  int failed = 0;
+  AuthorizationManager auth;
+  QStringList tokens = createSessions(out, &auth, AUTH_SESSIONS, &failed);
+  //Unknown tokens (same length and characters as real ones)
+  QStringList unknown;
+  for(int i=0; i<1000; i++){ unknown << QString("%1").arg(i, 20, 10, QChar('Z')); }
+  failed += runLookups(out, "valid", &auth, tokens, true, false, 1, opts.rounds);
+  failed += runLookups(out, "unknown", &auth, unknown, false, false, 1, opts.rounds);
+  failed += runLookups(out, "valid+user", &auth, tokens, true, true, 1, opts.rounds);
+  failed += runLookups(out, "valid+user", &auth, tokens, true, true, opts.threads, opts.rounds);
+  return failed;
+}
+
+int benchAuthStress(QTextStream &out, const microbench_options &opts){
+  out << "auth-stress:\n";
+  int failed = 0;
+  AuthorizationManager auth;
+  QStringList shared = createSessions(out, &auth, AUTH_SESSIONS/10, &failed);
+  QThreadPool pool;
+  pool.setMaxThreadCount(opts.threads);
+  for(int r=0; r<opts.rounds; r++){
+    QList< QFuture<stress_result> > futures;
+    QElapsedTimer timer;
+    timer.start();
+    for(int t=0; t<opts.threads; t++){
+      futures << QtConcurrent::run(&pool, stressWorker, &auth, &shared, r*opts.threads+t);
+    }
+    int ops = 0, wrong = 0;
+    QStringList cleared;
+    for(int t=0; t<futures.length(); t++){
+      stress_result R = futures[t].result();
+      ops += R.ops;
+      wrong += R.wrong;
+      cleared << R.cleared;
+    }
+    qint64 nsecs = timer.nsecsElapsed();
+    //Afterwards: every shared session is still there, none of the closed ones came back
+    int lost = 0, revived = 0;
+    for(int i=0; i<shared.length(); i++){
+      if(auth.userForToken(shared[i])!="root"){ lost++; }
+    }
+    for(int i=0; i<cleared.length(); i++){
+      if(auth.checkAuth(cleared[i])){ revived++; }
+    }
+    bool ok = (wrong==0 && lost==0 && revived==0);
+    if(!ok){ failed++; }
+    out << QString("  round %1: %2 session operations on %3 threads: %4 ms (%5 ops/s) %6\n").arg(QString::number(r+1), QString::number(ops),
+		QString::number(opts.threads), QString::number(nsecs/1e6, 'f', 3), QString::number(nsecs>0 ? ops/(nsecs/1e9) : 0, 'f', 0),
+		(ok ? QString("OK") : QString("FAILED: %1 wrong answers, %2 shared sessions lost, %3 closed sessions still valid").arg(QString::number(wrong), QString::number(lost), QString::number(revived))) );
+  }
+  return failed;
+}
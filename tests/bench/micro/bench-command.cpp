@@ -0,0 +1,134 @@
+// ===============================
+//  PC-BSD REST API Server - micro benchmarks
+// Available under the 3-clause BSD License
+// =================================
+// Running external commands: the old polling loop vs the asynchronous sysadm::Command API
+//  - the command is /bin/true, so the numbers are (almost) all overhead
+//  - request handlers run commands on pool threads, so that is where they are started from here too
+//=================================
+#include "microbench.h"
+#include "library/sysadm-general.h"
+#include "library/sysadm-command.h"
+
+#include <QMutex>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#define COMMAND_PATH "/bin/true"
+#define COMMAND_RUNS 200 //commands per run
+
+using namespace sysadm;
+
+//What General::RunCommand() used to do on every thread (poll every 500ms, run the event loop in between)
+static bool legacyRunCommand(QString command){
+  QProcess proc;
+    proc.setProcessChannelMode(QProcess::MergedChannels);
+  proc.start(command);
+  while( !proc.waitForFinished(500) ){ QCoreApplication::processEvents(); }
+  proc.readAllStandardOutput();
+  return (proc.exitCode()==0);
+}
+
+enum command_method{ LEGACY, GENERAL, COMMAND_RUN };
+
+//Run "count" commands one after another - returns the latency of each one (negative: command failed)
+static QVector<qint64> sequentialWorker(command_method method, int count){
+  QVector<qint64> lat;
+  QElapsedTimer timer;
+  for(int i=0; i<count; i++){
+    timer.start();
+    bool ok = false;
+    if(method==LEGACY){ ok = legacyRunCommand(COMMAND_PATH); }
+    else if(method==GENERAL){ ok = General::RunQuickCommand(COMMAND_PATH); }
+    else{ ok = Command::run(COMMAND_PATH).success; }
+    qint64 nsecs = timer.nsecsElapsed();
+    lat << (ok ? nsecs : -1);
+  }
+  return lat;
+}
+
+//Show the latencies (nsecs) of one method - returns the number of failed commands
+static int showRun(QTextStream &out, QString label, QVector<qint64> lat, int threads, qint64 wall){
+  std::sort(lat.begin(), lat.end());
+  int fails = 0;
+  while(!lat.isEmpty() && lat.first()<0){ lat.removeFirst(); fails++; }
+  out << QString("  %1: %2 commands on %3 threads in %4 ms (%5/s), latency (ms): p50 %6  p99 %7  max %8 %9\n").arg(label,
+		QString::number(lat.size()+fails), QString::number(threads), QString::number(wall/1e6, 'f', 1),
+		QString::number(wall>0 ? (lat.size()+fails)/(wall/1e9) : 0, 'f', 0),
+		QString::number(percentile(lat,0.5)/1e6, 'f', 3), QString::number(percentile(lat,0.99)/1e6, 'f', 3),
+		QString::number(lat.isEmpty() ? 0 : lat.last()/1e6, 'f', 3), (fails==0 ? QString("OK") : "FAILED: "+QString::number(fails)+" commands failed") );
+  return fails;
+}
+
+//Blocking calls spread across pool threads (every running command holds a pool thread)
+static int runBlocking(QTextStream &out, QString label, command_method method, int threads){
+  QThreadPool pool;
+  pool.setMaxThreadCount(threads);
+  QList< QFuture< QVector<qint64> > > futures;
+  QElapsedTimer timer;
+  timer.start();
+  for(int t=0; t<threads; t++){
+    futures << QtConcurrent::run(&pool, sequentialWorker, method, qMax(1, COMMAND_RUNS/threads));
+  }
+  QVector<qint64> lat;
+  for(int t=0; t<futures.length(); t++){ lat << futures[t].result(); }
+  return showRun(out, label, lat, threads, timer.nsecsElapsed());
+}
+
+//All commands started at once from a single pool thread, which then waits for all of them
+// - latency is from the start of the batch until the command finished
+static QVector<qint64> asyncWorker(int count){
+  QVector<qint64> lat;
+  QMutex mutex;
+  QSemaphore done;
+  QElapsedTimer timer;
+  timer.start();
+  for(int i=0; i<count; i++){
+    Command::start([&](CommandResult res){
+      qint64 nsecs = timer.nsecsElapsed();
+      mutex.lock();
+      lat << (res.success ? nsecs : -1);
+      mutex.unlock();
+      done.release();
+    }, COMMAND_PATH);
+  }
+  done.acquire(count);
+  return lat;
+}
+
+//Same batch as asyncWorker() with futures (what a request handler awaiting several commands would do)
+static QVector<qint64> futureWorker(int count){
+  QVector<qint64> lat;
+  QList< QFuture<CommandResult> > futures;
+  QElapsedTimer timer;
+  timer.start();
+  for(int i=0; i<count; i++){ futures << Command::start(COMMAND_PATH); }
+  QList<CommandResult> results = Command::waitForAll(futures);
+  qint64 nsecs = timer.nsecsElapsed(); //only known for the whole batch
+  for(int i=0; i<results.length(); i++){ lat << (results[i].success ? nsecs : -1); }
+  return lat;
+}
+
+int benchCommands(QTextStream &out, const microbench_options &opts){
+  out << "commands ("+QString(COMMAND_PATH)+"):\n";
+  int failed = 0;
+  for(int r=0; r<opts.rounds; r++){
+    if(opts.rounds>1){ out << QString(" round %1:\n").arg(QString::number(r+1)); }
+    //One command at a time
+    failed += runBlocking(out, "old polling loop", LEGACY, 1);
+    failed += runBlocking(out, "General::RunCommand", GENERAL, 1);
+    failed += runBlocking(out, "Command::run", COMMAND_RUN, 1);
+    //Many commands at the same time
+    failed += runBlocking(out, "old polling loop", LEGACY, opts.threads);
+    failed += runBlocking(out, "Command::run", COMMAND_RUN, opts.threads);
+    QElapsedTimer timer;
+    timer.start();
+    QVector<qint64> lat = QtConcurrent::run(asyncWorker, (int) COMMAND_RUNS).result();
+    failed += showRun(out, "Command::start (callbacks)", lat, 1, timer.nsecsElapsed());
+    timer.start();
+    lat = QtConcurrent::run(futureWorker, (int) COMMAND_RUNS).result();
+    failed += showRun(out, "Command::start + waitForAll", lat, 1, timer.nsecsElapsed());
+  }
+  return (failed>0 ? 1 : 0);
+}
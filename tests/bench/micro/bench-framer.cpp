@@ -0,0 +1,111 @@
+// ===============================
+//  PC-BSD REST API Server - micro benchmarks
+// Available under the 3-clause BSD License
+// =================================
+// RestInputFramer: raw TCP/REST input -> complete messages
+//  - every message has to come out exactly once, intact and in order (however the input was split up)
+//=================================
+#include "microbench.h"
+#include "RestStructs.h"
+
+#include <QStringList>
+
+//Default framer limit (RestInputFramer constructor)
+#define FRAMER_MAX 128000
+
+//Small request (rpc/query)
+static QByteArray smallMessage(int num){
+  return QString("POST /rpc/query HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Type: application/json\r\n\r\n{\"id\":\"q-%1\",\"args\":\"\"}").arg(num).toUtf8();
+}
+
+//Large request (pkg install) - "tricky" also puts braces and escaped quotes inside the strings
+static QByteArray largeMessage(int num, int pkgs, bool tricky){
+  QStringList origins;
+  for(int i=0; i<pkgs; i++){
+    origins << "\"ports-mgmt/pkg-"+QString::number(i) + (tricky ? " {\\\"x\\\"}\"" : "\"");
+  }
+  QString body = "{\"id\":\"install-"+QString::number(num)+"\",\"args\":{\"action\":\"pkg_install\",\"pkg_origins\":["+origins.join(",")+"]}}";
+  return QString("POST /sysadm/pkg HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: %1\r\n\r\n").arg(body.length()).toUtf8() + body.toUtf8();
+}
+
+//Feed the stream to a new framer "chunk" bytes at a time, return everything framed (in order)
+static QList<QByteArray> feed(const QByteArray &stream, int chunk, qint64 *nsecs){
+  QList<QByteArray> out;
+  RestInputFramer F(FRAMER_MAX);
+  QElapsedTimer timer;
+  timer.start();
+  for(int i=0; i<stream.size(); i+=chunk){
+    F.append( QByteArray::fromRawData(stream.constData()+i, qMin(chunk, stream.size()-i)) );
+    while(F.hasMessage()){ out << F.takeMessage(); }
+  }
+  *nsecs = timer.nsecsElapsed();
+  return out;
+}
+
+//Run one input pattern "rounds" times: show the best time and check the framed messages against "expected"
+// - message "prefixed" may also carry leftover bytes in front of it (the rest of a dropped oversized request)
+static int runCase(QTextStream &out, QString label, const QByteArray &stream, int chunk, const QList<QByteArray> &expected, int rounds, int prefixed = -1){
+  qint64 best = -1;
+  int failed = 0;
+  QString problem;
+  for(int r=0; r<rounds; r++){
+    qint64 nsecs = 0;
+    QList<QByteArray> got = feed(stream, chunk, &nsecs);
+    if(best<0 || nsecs<best){ best = nsecs; }
+    if(!problem.isEmpty()){ continue; } //already failed - only show the first problem
+    if(got.length()!=expected.length()){
+      problem = QString("%1 messages framed, %2 expected").arg(QString::number(got.length()), QString::number(expected.length()));
+    }else{
+      for(int i=0; i<got.length() && problem.isEmpty(); i++){
+        bool same = (i==prefixed) ? (got[i].endsWith(expected[i]) && got[i].size()<=FRAMER_MAX) : (got[i]==expected[i]);
+        if(!same){ problem = "message "+QString::number(i)+" changed or out of order"; }
+      }
+    }
+    if(!problem.isEmpty()){ failed++; }
+  }
+  double secs = best/1e9;
+  out << QString("  %1: %2 messages, %3 KB in %4 byte reads: %5 ms (%6 MB/s, %7 msgs/s) %8\n").arg(label,
+		QString::number(expected.length()), QString::number(stream.size()/1024), QString::number(chunk),
+		QString::number(best/1e6, 'f', 3), QString::number(secs>0 ? stream.size()/secs/1048576 : 0, 'f', 1),
+		QString::number(secs>0 ? expected.length()/secs : 0, 'f', 0), (problem.isEmpty() ? QString("OK") : "FAILED: "+problem) );
+  return (failed>0 ? 1 : 0);
+}
+
+int benchFramer(QTextStream &out, const microbench_options &opts){
+  out << "framer:\n";
+  int failed = 0;
+  //Many small requests sent back to back (one big read, then typical socket reads)
+  QByteArray pipelined;
+  QList<QByteArray> small;
+  for(int i=0; i<5000; i++){
+    small << smallMessage(i);
+    pipelined.append(small.last());
+  }
+  failed += runCase(out, "pipelined small", pipelined, pipelined.size(), small, opts.rounds);
+  failed += runCase(out, "pipelined small", pipelined, 65536, small, opts.rounds);
+  //Byte-at-a-time delivery (every read ends in the middle of a message)
+  QByteArray fewsmall;
+  for(int i=0; i<500; i++){ fewsmall.append(small[i]); }
+  failed += runCase(out, "fragmented small", fewsmall, 1, small.mid(0,500), opts.rounds);
+  //Large requests split across many reads
+  QByteArray bulk;
+  QList<QByteArray> large;
+  for(int i=0; i<100; i++){
+    large << largeMessage(i, 2000, true);
+    bulk.append(large.last());
+  }
+  failed += runCase(out, "fragmented large", bulk, 1460, large, opts.rounds);
+  failed += runCase(out, "fragmented large", bulk, 7, large, opts.rounds);
+  //A single request just under the limit, one byte at a time (the whole unframed buffer is kept around)
+  QByteArray nearmax = largeMessage(0, 5600, false); //~120KB
+  failed += runCase(out, "near-limit large", nearmax, 1, QList<QByteArray>() << nearmax, opts.rounds);
+  //Oversized request (~220KB) between small ones: it never comes out, everything around it still does
+  // (the bytes after the last buffer reset end up in front of the next request - that one gets the "bad request" reply)
+  QByteArray oversized;
+  QList<QByteArray> around;
+  for(int i=0; i<10; i++){ around << smallMessage(i); oversized.append(around.last()); }
+  oversized.append( largeMessage(1, 10000, false) );
+  for(int i=10; i<110; i++){ around << smallMessage(i); oversized.append(around.last()); }
+  failed += runCase(out, "oversized dropped", oversized, 1460, around, opts.rounds, 10);
+  return failed;
+}
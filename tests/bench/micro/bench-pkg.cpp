@@ -0,0 +1,228 @@
+// ===============================
+//  PC-BSD REST API Server - micro benchmarks
+// Available under the 3-clause BSD License
+// =================================
+// pkg_info() for one category: the string-built SQL it used to run vs the prepared statements + temp.pkg_ids table
+//  - the queries are the same ones sysadm-pkg.cpp runs (before/after), on a database made by gen-pkg-repo.sh
+//  - both ways have to return the same package information
+//=================================
+#include "microbench.h"
+
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QStringList>
+#include <QUuid>
+
+#define PKG_CALLS 20 //pkg_info() calls per timed run
+
+//Per-package list queries: "%1" is the set of package ids
+static const char* PKG_LISTS[][2] = {
+  { "dependencies", "SELECT package_id, name FROM deps WHERE package_id IN (%1)" },
+  { "files", "SELECT package_id, path FROM files WHERE package_id IN (%1)" },
+  { "users", "SELECT pkg_users.package_id, users.name FROM pkg_users INNER JOIN users ON pkg_users.user_id = users.id WHERE pkg_users.package_id IN (%1)" },
+  { "groups", "SELECT pkg_groups.package_id, \"groups\".name FROM pkg_groups INNER JOIN \"groups\" ON pkg_groups.group_id = \"groups\".id WHERE pkg_groups.package_id IN (%1)" },
+  { "licenses", "SELECT pkg_licenses.package_id, licenses.name FROM pkg_licenses INNER JOIN licenses ON pkg_licenses.license_id = licenses.id WHERE pkg_licenses.package_id IN (%1)" },
+  { "shlibs_required", "SELECT pkg_shlibs_required.package_id, shlibs.name FROM pkg_shlibs_required INNER JOIN shlibs ON pkg_shlibs_required.shlib_id = shlibs.id WHERE pkg_shlibs_required.package_id IN (%1)" },
+  { "shlibs_provided", "SELECT pkg_shlibs_provided.package_id, shlibs.name FROM pkg_shlibs_provided INNER JOIN shlibs ON pkg_shlibs_provided.shlib_id = shlibs.id WHERE pkg_shlibs_provided.package_id IN (%1)" },
+  { "conflicts", "SELECT pkg_conflicts.package_id, packages.origin FROM pkg_conflicts INNER JOIN packages ON pkg_conflicts.conflict_id = packages.id WHERE pkg_conflicts.package_id IN (%1)" },
+  { "config_files", "SELECT package_id, path FROM config_files WHERE package_id IN (%1)" },
+  { "provides", "SELECT pkg_provides.package_id, provides.provide FROM pkg_provides INNER JOIN provides ON pkg_provides.provide_id = provides.id WHERE pkg_provides.package_id IN (%1)" },
+  { "requires", "SELECT pkg_requires.package_id, requires.require FROM pkg_requires INNER JOIN requires ON pkg_requires.require_id = requires.id WHERE pkg_requires.package_id IN (%1)" }
+};
+#define PKG_ANNOTATIONS "SELECT pkg_annotation.package_id, tag.annotation AS tag, val.annotation AS val FROM pkg_annotation" \
+	" INNER JOIN annotation AS tag ON pkg_annotation.tag_id = tag.annotation_id" \
+	" INNER JOIN annotation AS val ON pkg_annotation.value_id = val.annotation_id" \
+	" WHERE pkg_annotation.package_id IN (%1)"
+#define PKG_OPTIONS "SELECT pkg_option.package_id, option, value FROM pkg_option INNER JOIN option ON pkg_option.option_id = option.option_id WHERE pkg_option.package_id IN (%1)"
+//"%1" is the set of package names here
+#define PKG_RDEPS "SELECT deps.name, packages.name FROM deps INNER JOIN packages ON deps.package_id = packages.id WHERE deps.name IN (%1)"
+
+//Package info being assembled (same layout as pkg_info())
+struct pkg_infos{
+  QHash<QString, QJsonObject> infos; //package id -> info
+  QHash<QString, QString> names; //package id -> name
+};
+
+//Where the queries come from: new statements every time (before) or prepared once and re-used (now)
+class QuerySource{
+public:
+  QSqlDatabase DB;
+  bool prepared;
+
+  QuerySource(QSqlDatabase db, bool reuse){ DB = db; prepared = reuse; }
+  ~QuerySource(){ qDeleteAll(cache); }
+
+  QSqlQuery* query(QString sql){
+    QSqlQuery *q = cache.value(sql,0);
+    if(q!=0 && !prepared){ delete cache.take(sql); q = 0; }
+    if(q==0){
+      q = new QSqlQuery(DB);
+      q->setForwardOnly(true);
+      q->prepare(sql);
+      cache.insert(sql, q);
+    }
+    return q;
+  }
+
+private:
+  QHash<QString, QSqlQuery*> cache;
+};
+
+static void readPackages(QSqlQuery *q, pkg_infos *P){
+  q->exec();
+  while(q->next()){
+    QString id = q->value("id").toString();
+    QString name = q->value("name").toString();
+    if(id.isEmpty() || name.isEmpty()){ continue; }
+    QJsonObject info;
+    QSqlRecord rec = q->record();
+    for(int i=0; i<rec.count(); i++){ info.insert(rec.fieldName(i), q->value(i).toString()); }
+    P->infos.insert(id, info);
+    P->names.insert(id, name);
+  }
+  q->finish();
+}
+
+//All the other tables (idset: SQL for the package ids, nameset: SQL for the package names)
+static void readDetails(QuerySource *src, pkg_infos *P, QString idset, QString nameset, bool full){
+  QSqlQuery *q = src->query( QString(PKG_ANNOTATIONS).arg(idset) );
+  q->exec();
+  while(q->next()){
+    QString id = q->value(0).toString();
+    if(P->infos.contains(id)){ P->infos[id].insert(q->value(1).toString(), q->value(2).toString()); }
+  }
+  q->finish();
+  if(!full){ return; }
+  q = src->query( QString(PKG_OPTIONS).arg(idset) );
+  q->exec();
+  QHash<QString, QJsonObject> options;
+  while(q->next()){ options[q->value(0).toString()].insert(q->value(1).toString(), q->value(2).toString()); }
+  q->finish();
+  for(QHash<QString, QJsonObject>::const_iterator it = options.constBegin(); it!=options.constEnd(); ++it){
+    if(P->infos.contains(it.key())){ P->infos[it.key()].insert("options", it.value()); }
+  }
+  for(unsigned int t=0; t<sizeof(PKG_LISTS)/sizeof(PKG_LISTS[0]); t++){
+    q = src->query( QString(PKG_LISTS[t][1]).arg(idset) );
+    q->exec();
+    QHash<QString, QStringList> lists;
+    while(q->next()){ lists[q->value(0).toString()] << q->value(1).toString(); }
+    q->finish();
+    for(QHash<QString, QStringList>::const_iterator it = lists.constBegin(); it!=lists.constEnd(); ++it){
+      if(P->infos.contains(it.key())){ P->infos[it.key()].insert(PKG_LISTS[t][0], QJsonArray::fromStringList(it.value()) ); }
+    }
+  }
+  q = src->query( QString(PKG_RDEPS).arg(nameset) );
+  q->exec();
+  QHash<QString, QStringList> rdeps;
+  while(q->next()){ rdeps[q->value(0).toString()] << q->value(1).toString(); }
+  q->finish();
+  for(QHash<QString, QString>::const_iterator it = P->names.constBegin(); it!=P->names.constEnd(); ++it){
+    if(rdeps.contains(it.value())){ P->infos[it.key()].insert("reverse_dependencies", QJsonArray::fromStringList(rdeps.value(it.value())) ); }
+  }
+}
+
+//Before: the category is pasted into every statement, each one is parsed/planned again
+static pkg_infos stringInfo(QuerySource *src, QString category, bool full){
+  pkg_infos P;
+  QString q_where = " WHERE origin LIKE '"+category+"/%'";
+  readPackages(src->query("SELECT * FROM packages"+q_where), &P);
+  if(!P.infos.isEmpty()){ readDetails(src, &P, "SELECT id FROM packages"+q_where, "SELECT name FROM packages"+q_where, full); }
+  return P;
+}
+
+//Now: bound category, ids loaded into temp.pkg_ids once, fixed statements for everything else
+static pkg_infos preparedInfo(QuerySource *src, QString category, bool full){
+  pkg_infos P;
+  QSqlQuery *q = src->query("SELECT * FROM packages WHERE origin LIKE ?");
+  q->bindValue(0, category+"/%");
+  readPackages(q, &P);
+  if(P.infos.isEmpty()){ return P; }
+  src->query("DELETE FROM temp.pkg_ids")->exec();
+  QSqlQuery *ins = src->query("INSERT OR IGNORE INTO temp.pkg_ids (v) VALUES (?)");
+  QStringList ids = P.infos.keys();
+  for(int i=0; i<ids.length(); i++){
+    ins->bindValue(0, ids[i]);
+    ins->exec();
+  }
+  readDetails(src, &P, "SELECT v FROM temp.pkg_ids", "SELECT name FROM packages WHERE id IN (SELECT v FROM temp.pkg_ids)", full);
+  return P;
+}
+
+//Row order within a list can differ between query plans - compare the sorted lists
+static QJsonObject normalized(QJsonObject info){
+  QStringList keys = info.keys();
+  for(int i=0; i<keys.length(); i++){
+    if(!info.value(keys[i]).isArray()){ continue; }
+    QStringList vals;
+    QJsonArray arr = info.value(keys[i]).toArray();
+    for(int j=0; j<arr.count(); j++){ vals << arr[j].toString(); }
+    vals.sort();
+    info.insert(keys[i], QJsonArray::fromStringList(vals));
+  }
+  return info;
+}
+
+static bool sameInfo(const pkg_infos &A, const pkg_infos &B){
+  if(A.infos.count()!=B.infos.count()){ return false; }
+  for(QHash<QString, QJsonObject>::const_iterator it = A.infos.constBegin(); it!=A.infos.constEnd(); ++it){
+    if(!B.infos.contains(it.key())){ return false; }
+    if(normalized(it.value()) != normalized(B.infos.value(it.key()))){ return false; }
+  }
+  return true;
+}
+
+//Time PKG_CALLS calls of one way (best of "rounds") - returns the msecs per call
+static double timeInfo(QuerySource *src, QString category, bool full, bool prepared, int rounds, pkg_infos *result){
+  qint64 best = -1;
+  for(int r=0; r<rounds; r++){
+    QElapsedTimer timer;
+    timer.start();
+    for(int i=0; i<PKG_CALLS; i++){
+      *result = prepared ? preparedInfo(src, category, full) : stringInfo(src, category, full);
+    }
+    qint64 nsecs = timer.nsecsElapsed();
+    if(best<0 || nsecs<best){ best = nsecs; }
+  }
+  return best/1e6/PKG_CALLS;
+}
+
+int benchPkg(QTextStream &out, const microbench_options &opts){
+  out << "pkg ("+opts.pkgdb+"):\n";
+  if(!QFile::exists(opts.pkgdb)){
+    out << "  FAILED: database missing (create it with gen-pkg-repo.sh)\n";
+    return 1;
+  }
+  int failed = 0;
+  QString conn = "microbench-pkg-"+QUuid::createUuid().toString();
+  { //database handles need to be gone before the connection is removed
+    QSqlDatabase DB = QSqlDatabase::addDatabase("QSQLITE", conn);
+      DB.setConnectOptions("QSQLITE_OPEN_READONLY=1");
+      DB.setDatabaseName(opts.pkgdb);
+    if(!DB.open()){
+      out << "  FAILED: could not open the database\n";
+      failed++;
+    }else{
+      QSqlQuery create(DB);
+      create.exec("CREATE TEMP TABLE IF NOT EXISTS pkg_ids (v PRIMARY KEY)");
+      QuerySource before(DB, false), now(DB, true);
+      for(int f=0; f<2; f++){
+        bool full = (f==1);
+        pkg_infos oldres, newres;
+        double oldms = timeInfo(&before, "cat1", full, false, opts.rounds, &oldres);
+        double newms = timeInfo(&now, "cat1", full, true, opts.rounds, &newres);
+        bool ok = (!oldres.infos.isEmpty() && sameInfo(oldres, newres));
+        if(!ok){ failed++; }
+        out << QString("  pkg_info cat1 (%1, %2 packages): string-built %3 ms, prepared %4 ms per call (%5x) %6\n").arg(
+		(full ? QString("full") : QString("simple")), QString::number(newres.infos.count()),
+		QString::number(oldms, 'f', 3), QString::number(newms, 'f', 3), QString::number(newms>0 ? oldms/newms : 0, 'f', 2),
+		(ok ? QString("OK") : QString("FAILED: results differ")) );
+      }
+    }
+  }
+  QSqlDatabase::removeDatabase(conn);
+  return failed;
+}
@@ -0,0 +1,84 @@
+// ===============================
+//  PC-BSD REST API Server - micro benchmarks
+// Available under the 3-clause BSD License
+// =================================
+#include <QCoreApplication>
+#include <QDebug>
+#include <QStringList>
+#include <QThread>
+
+#include "microbench.h"
+#include "globals.h"
+
+//Server globals used by the benchmarked classes (nothing here needs the events/dispatcher/scheduler)
+QSettings *CONFIG = new QSettings(QDir::tempPath()+"/sysadm-microbench.ini", QSettings::IniFormat);
+EventWatcher *EVENTS = 0;
+Dispatcher *DISPATCHER = 0;
+RequestScheduler *SCHEDULER = 0;
+bool WS_MODE = false;
+int BlackList_BlockMinutes = 60;
+int BlackList_AuthFailsToBlock = 5;
+int BlackList_AuthFailResetMinutes = 10;
+bool BRIDGE_ONLY = false;
+
+//The server classes log every login - keep the benchmark output readable
+void QuietOutput(QtMsgType type, const QMessageLogContext &context, const QString &msg){
+  Q_UNUSED(context);
+  if(type==QtDebugMsg){ return; }
+  QTextStream(stderr) << msg << "\n";
+}
+
+void showUsage(){
+qDebug() << "sysadm-microbench usage:";
+qDebug() << "    \"sysadm-microbench [options] <benchmark>\"";
+qDebug() << "Benchmarks:";
+qDebug() << "  \"framer\": REST input framing (pipelined, fragmented and oversized input)";
+qDebug() << "  \"tokens\": Session token lookups with 10000 live sessions (single and multi-threaded)";
+qDebug() << "  \"auth-stress\": Logins, token checks and logouts from many threads at once (checks for lost/corrupted sessions)";
+qDebug() << "  \"commands\": Running /bin/true with the old polling loop vs the asynchronous command API (one and many at once)";
+qDebug() << "  \"pkg\": pkg_info for one category, string-built SQL vs prepared statements (needs the gen-pkg-repo.sh database)";
+qDebug() << "  \"all\": Run every benchmark";
+qDebug() << "Options:";
+qDebug() << "  \"-rounds <num>\": Repeat each timed run, the best one is shown (default: 5)";
+qDebug() << "  \"-threads <num>\": Concurrent workers (default: 4x the number of CPUs)";
+qDebug() << "  \"-pkgdb <file>\": pkg repository database (default: /var/db/pkg/repo-bench.sqlite)";
+}
+
+int main( int argc, char ** argv )
+{
+  QCoreApplication A(argc, argv);
+  QTextStream out(stdout);
+  microbench_options opts;
+    opts.rounds = 5;
+    opts.threads = 4*QThread::idealThreadCount();
+    opts.pkgdb = "/var/db/pkg/repo-bench.sqlite";
+  QString bench;
+  QStringList args = A.arguments();
+  for(int i=1; i<args.length(); i++){
+    if(args[i]=="-rounds" && i+1<args.length()){ i++; opts.rounds = args[i].toInt(); }
+    else if(args[i]=="-threads" && i+1<args.length()){ i++; opts.threads = args[i].toInt(); }
+    else if(args[i]=="-pkgdb" && i+1<args.length()){ i++; opts.pkgdb = args[i]; }
+    else if(bench.isEmpty() && !args[i].startsWith("-")){ bench = args[i]; }
+    else{ showUsage(); return 1; }
+  }
+  if(opts.rounds<1){ opts.rounds = 1; }
+  if(opts.threads<1){ opts.threads = 1; }
+  QStringList known;
+    known << "all" << "framer" << "tokens" << "auth-stress" << "commands" << "pkg";
+  if(!known.contains(bench)){ showUsage(); return 1; }
+  //Sessions are created with service logins (no PAM needed)
+  CONFIG->setValue("auth/allowServiceAuth", true);
+  qInstallMessageHandler(QuietOutput);
+  bool all = (bench=="all");
+  int failed = 0;
+  if(all || bench=="framer"){ failed += benchFramer(out, opts); }
+  if(all || bench=="tokens"){ failed += benchTokens(out, opts); }
+  if(all || bench=="auth-stress"){ failed += benchAuthStress(out, opts); }
+  if(all || bench=="commands"){ failed += benchCommands(out, opts); }
+  if(bench=="pkg" || (all && QFile::exists(opts.pkgdb)) ){ failed += benchPkg(out, opts); }
+  else if(all){ out << "pkg: skipped (no "+opts.pkgdb+" - see gen-pkg-repo.sh)\n"; }
+  out << (failed==0 ? QString("All checks passed\n") : QString("%1 checks FAILED\n").arg(failed));
+  out.flush();
+  QFile::remove(CONFIG->fileName());
+  return (failed==0 ? 0 : 1);
+}
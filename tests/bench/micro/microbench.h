@@ -0,0 +1,37 @@
+// ===============================
+//  PC-BSD REST API Server - micro benchmarks
+// Available under the 3-clause BSD License
+// =================================
+// In-process benchmarks of single server pieces (no running server needed)
+//  - every benchmark also checks the results, the return value is the number of failed checks
+//=================================
+#ifndef _PCBSD_SYSADM_MICROBENCH_H
+#define _PCBSD_SYSADM_MICROBENCH_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+
+struct microbench_options{
+  int rounds; //repeat each timed run (best one is shown)
+  int threads; //concurrent workers for the multi-threaded benchmarks
+  QString pkgdb; //pkg repository database (gen-pkg-repo.sh)
+};
+
+int benchFramer(QTextStream &out, const microbench_options &opts);
+int benchTokens(QTextStream &out, const microbench_options &opts);
+int benchAuthStress(QTextStream &out, const microbench_options &opts);
+int benchCommands(QTextStream &out, const microbench_options &opts);
+int benchPkg(QTextStream &out, const microbench_options &opts);
+
+//Exact percentile from a sorted list (nearest rank)
+inline qint64 percentile(const QVector<qint64> &sorted, double pct){
+  if(sorted.isEmpty()){ return 0; }
+  int index = qBound(0, (int) (pct*sorted.size() + 0.5) - 1, sorted.size()-1);
+  return sorted[index];
+}
+
+#endif
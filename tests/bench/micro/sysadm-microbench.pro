@@ -0,0 +1,37 @@
+TEMPLATE	= app
+LANGUAGE	= C++
+
+CONFIG	+= qt warn_off release console c++11
+CONFIG	-= app_bundle
+QT = core network websockets concurrent sql
+
+TARGET = sysadm-microbench
+
+SERVER = ../../../src/server
+INCLUDEPATH += $${SERVER}
+
+HEADERS	+= microbench.h \
+		$${SERVER}/RestStructs.h \
+		$${SERVER}/AuthorizationManager.h \
+		$${SERVER}/LogManager.h \
+		$${SERVER}/library/sysadm-general.h \
+		$${SERVER}/library/sysadm-command.h \
+		$${SERVER}/library/sysadm-executor.h \
+		$${SERVER}/library/sysadm-metrics.h
+
+SOURCES	+= main.cpp \
+		bench-framer.cpp \
+		bench-auth.cpp \
+		bench-command.cpp \
+		bench-pkg.cpp \
+		$${SERVER}/RestStructs.cpp \
+		$${SERVER}/AuthorizationManager.cpp \
+		$${SERVER}/LogManager.cpp \
+		$${SERVER}/library/sysadm-general.cpp \
+		$${SERVER}/library/sysadm-command.cpp \
+		$${SERVER}/library/sysadm-executor.cpp \
+		$${SERVER}/library/sysadm-metrics.cpp
+
+QMAKE_LIBDIR = /usr/local/lib/qt5 /usr/local/lib
+INCLUDEPATH += /usr/local/include
+LIBS += -L/usr/local/lib -lpam -lutil -lssl -lcrypto
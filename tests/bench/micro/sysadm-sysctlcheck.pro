@@ -0,0 +1,16 @@
+TEMPLATE	= app
+LANGUAGE	= C++
+
+CONFIG	+= qt warn_off release console c++11
+CONFIG	-= app_bundle
+QT = core
+
+TARGET = sysadm-sysctlcheck
+
+SERVER = ../../../src/server
+INCLUDEPATH += $${SERVER}
+
+HEADERS	+= $${SERVER}/library/sysadm-sysctl.h
+
+SOURCES	+= sysctl-check.cpp \
+		$${SERVER}/library/sysadm-sysctl.cpp
@@ -0,0 +1,80 @@
+// ===============================
+//  PC-BSD REST API Server - micro benchmarks
+// Available under the 3-clause BSD License
+// =================================
+// sysadm::Sysctl reads: memory stats, CPU ticks and boot time have to look sane
+//  - only needs Qt Core: on Linux this runs the /proc backend, on FreeBSD the sysctl(3) one
+//=================================
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QThread>
+
+#include "library/sysadm-sysctl.h"
+
+using namespace sysadm;
+
+static int failed = 0;
+
+static void check(QTextStream &out, QString label, bool ok, QString value){
+  if(!ok){ failed++; }
+  out << QString("  %1: %2 %3\n").arg(label, value, (ok ? QString("OK") : QString("FAILED")) );
+}
+
+static qint64 sum(const QList<qint64> &vals){
+  qint64 total = 0;
+  for(int i=0; i<vals.length(); i++){ total += vals[i]; }
+  return total;
+}
+
+int main( int argc, char ** argv )
+{
+  QCoreApplication A(argc, argv);
+  QTextStream out(stdout);
+#ifdef __FreeBSD__
+  out << "sysctl (sysctl(3) backend):\n";
+#else
+  out << "sysctl (/proc backend):\n";
+#endif
+  //Memory
+  qint64 physmem = Sysctl::number("hw.physmem");
+  check(out, "hw.physmem", physmem > 0, QString::number(physmem));
+  qint64 pagesize = Sysctl::number("vm.stats.vm.v_page_size");
+  check(out, "vm.stats.vm.v_page_size", pagesize >= 512, QString::number(pagesize));
+  qint64 pages = Sysctl::number("vm.stats.vm.v_page_count");
+  check(out, "vm.stats.vm.v_page_count", pages > 0 && pagesize>0 && pages*pagesize <= physmem*2, QString::number(pages));
+  qint64 freepages = Sysctl::number("vm.stats.vm.v_free_count");
+  check(out, "vm.stats.vm.v_free_count", freepages > 0 && freepages <= pages, QString::number(freepages));
+  //CPUs and ticks (5 per CPU: user nice system interrupt idle)
+  qint64 ncpu = Sysctl::number("hw.ncpu");
+  check(out, "hw.ncpu", ncpu > 0, QString::number(ncpu));
+  QList<qint64> total1 = Sysctl::numbers("kern.cp_time");
+  check(out, "kern.cp_time", total1.length()==5 && sum(total1)>0, QString::number(total1.length())+" values");
+  QList<qint64> ticks1 = Sysctl::numbers("kern.cp_times");
+  check(out, "kern.cp_times", ticks1.length()>0 && ticks1.length()==5*ncpu && sum(ticks1)>0, QString::number(ticks1.length())+" values");
+  QThread::msleep(250); //a few ticks on every system (stathz is 100+)
+  QList<qint64> ticks2 = Sysctl::numbers("kern.cp_times");
+  QList<qint64> total2 = Sysctl::numbers("kern.cp_time");
+  bool increasing = (ticks2.length()==ticks1.length() && total2.length()==total1.length() && sum(ticks2)>sum(ticks1) && sum(total2)>sum(total1));
+  for(int i=0; i<ticks2.length() && increasing; i++){ increasing = (ticks2[i] >= ticks1[i]); }
+  for(int i=0; i<total2.length() && increasing; i++){ increasing = (total2[i] >= total1[i]); }
+  check(out, "ticks after 250ms", increasing, "+"+QString::number(sum(ticks2)-sum(ticks1)));
+  //Boot time: in the past, but not before this code was written
+  qint64 boot = Sysctl::bootTime();
+  qint64 now = QDateTime::currentMSecsSinceEpoch()/1000;
+  check(out, "kern.boottime", boot > 1420070400 && boot <= now, QDateTime::fromMSecsSinceEpoch(boot*1000).toString(Qt::ISODate));
+  //Text values
+  QString host = Sysctl::text("kern.hostname");
+  check(out, "kern.hostname", !host.isEmpty(), host);
+  QString release = Sysctl::text("kern.osrelease");
+  check(out, "kern.osrelease", !release.isEmpty(), release);
+  //Cost of a single read (what the sampler pays every interval)
+  QElapsedTimer timer;
+  timer.start();
+  for(int i=0; i<1000; i++){ Sysctl::numbers("kern.cp_times"); }
+  out << QString("  kern.cp_times read: %1 us\n").arg(QString::number(timer.nsecsElapsed()/1000/1000.0, 'f', 1));
+  out << (failed==0 ? QString("All checks passed\n") : QString("%1 checks FAILED\n").arg(failed));
+  out.flush();
+  return (failed==0 ? 0 : 1);
+}
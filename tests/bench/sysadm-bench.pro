@@ -0,0 +1,13 @@
+TEMPLATE	= app
+LANGUAGE	= C++
+
+CONFIG	+= qt warn_off release console c++11
+CONFIG	-= app_bundle
+QT = core network websockets
+
+TARGET = sysadm-bench
+
+HEADERS	+= BenchClient.h
+
+SOURCES	+= main.cpp \
+		BenchClient.cpp